@@ -28,6 +28,8 @@ SPI_SIZE ?= 512K
 
 # Path to spiffy
 SPIFFY ?= $(SMING_HOME)/spiffy/spiffy
+# Spiffy options, "-z" stores web files compressed
+SPIFFY_FLAGS ?=
 
 ## ESP_HOME sets the path where ESP tools and SDK are located.
 ## Windows:
@@ -319,7 +321,7 @@ else
 	$(vecho) "Checking for spiffs files"
 	$(Q) if [ -d "$(SPIFF_FILES)" ]; then \
     	echo "$(SPIFF_FILES) directory exists. Creating $(SPIFF_BIN_OUT)"; \
-    	$(SPIFFY) $(SPIFF_SIZE) $(SPIFF_FILES) $(SPIFF_BIN_OUT); \
+    	$(SPIFFY) $(SPIFFY_FLAGS) $(SPIFF_SIZE) $(SPIFF_FILES) $(SPIFF_BIN_OUT); \
 	else \
     	echo "No files found in ./$(SPIFF_FILES)."; \
     	echo "Creating empty $(SPIFF_BIN_OUT) ($$($(GET_FILESIZE) $(SMING_HOME)/compiler/data/blankfs.bin) bytes)"; \
@@ -10,6 +10,7 @@
 
 #include "src/Internals/IndentedPrint.cpp"
 #include "src/Internals/JsonParser.cpp"
+#include "src/Internals/JsonStreamWriter.cpp"
 #include "src/Internals/List.cpp"
 #include "src/Internals/Prettyfier.cpp"
 #include "src/Internals/QuotedString.cpp"
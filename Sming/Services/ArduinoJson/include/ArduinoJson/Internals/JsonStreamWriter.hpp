@@ -0,0 +1,82 @@
+// Copyright Benoit Blanchon 2014-2015
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+
+#pragma once
+
+#include "../JsonArray.hpp"
+#include "../JsonObject.hpp"
+#include "IndentedPrint.hpp"
+#include "Prettyfier.hpp"
+
+namespace ArduinoJson {
+namespace Internals {
+
+// Resumable serializer.
+// Unlike JsonPrintable::printTo(), it doesn't write the whole document at
+// once: each call to writeNext() emits a few tokens and remembers where it
+// stopped (the path of nodes and the position in the current string).
+// The output is identical to printTo() or prettyPrintTo().
+class JsonStreamWriter {
+ public:
+  explicit JsonStreamWriter(Print &sink, bool pretty = true);
+
+  // Starts serializing the specified root.
+  // The tree must not be modified until the writer is finished.
+  // Returns the number of bytes written.
+  size_t begin(const JsonObject &object) { return openObject(object); }
+  size_t begin(const JsonArray &array) { return openArray(array); }
+
+  // Writes tokens until at least minBytes were written or the document is
+  // complete. Returns the number of bytes written.
+  size_t writeNext(size_t minBytes);
+
+  // Tells if the whole document was written
+  bool finished() const { return _state == STATE_DONE; }
+
+  static const int MAX_DEPTH = 16;
+
+  // Max number of string characters written at once
+  static const int STRING_STEP = 32;
+
+ private:
+  enum State {
+    STATE_DONE,
+    STATE_VALUE,   // write _value
+    STATE_NEXT,    // write next member of the top level container
+    STATE_COLON,   // write the colon between a key and _value
+    STATE_STRING,  // write the rest of _string
+  };
+
+  struct Level {
+    bool isObject;
+    bool first;
+    JsonObject::const_iterator member;
+    JsonArray::const_iterator element;
+  };
+
+  JsonStreamWriter &operator=(const JsonStreamWriter &);  // cannot be assigned
+
+  size_t writeStep();
+  size_t writeValue();
+  size_t writeNextElement();
+  size_t writeString();
+  size_t openObject(const JsonObject &object);
+  size_t openArray(const JsonArray &array);
+
+  IndentedPrint _indented;
+  Prettyfier _prettyfier;
+  Print &_out;
+
+  State _state;
+  State _afterString;
+  const JsonVariant *_value;
+  const char *_string;
+
+  Level _levels[MAX_DEPTH];
+  int _depth;
+};
+}
+}
@@ -19,6 +19,9 @@ class QuotedString {
   // It escapes the special characters as required by the JSON specifications.
   static size_t printTo(const char *, Print &);
 
+  // Writes one char of a string, escaped if needed, without quotes.
+  static size_t printCharTo(char, Print &);
+
   // Reads a doubly-quoted string from a buffer.
   // It removes the double quotes (").
   // It unescapes the special character as required by the JSON specification,
@@ -0,0 +1,142 @@
+// Copyright Benoit Blanchon 2014-2015
+// MIT License
+//
+// Arduino JSON library
+// https://github.com/bblanchon/ArduinoJson
+
+#include "../../include/ArduinoJson/Internals/JsonStreamWriter.hpp"
+
+#include "../../include/ArduinoJson/Internals/JsonWriter.hpp"
+#include "../../include/ArduinoJson/Internals/QuotedString.hpp"
+
+using namespace ArduinoJson;
+using namespace ArduinoJson::Internals;
+
+JsonStreamWriter::JsonStreamWriter(Print &sink, bool pretty)
+    : _indented(sink),
+      _prettyfier(_indented),
+      _out(pretty ? static_cast<Print &>(_prettyfier) : sink),
+      _state(STATE_DONE),
+      _afterString(STATE_DONE),
+      _value(NULL),
+      _string(NULL),
+      _depth(0) {}
+
+size_t JsonStreamWriter::writeNext(size_t minBytes) {
+  size_t n = 0;
+  while (n < minBytes && _state != STATE_DONE) n += writeStep();
+  return n;
+}
+
+size_t JsonStreamWriter::writeStep() {
+  switch (_state) {
+    case STATE_VALUE:
+      return writeValue();
+
+    case STATE_NEXT:
+      return writeNextElement();
+
+    case STATE_COLON:
+      _state = STATE_VALUE;
+      return _out.write(':');
+
+    case STATE_STRING:
+      return writeString();
+
+    default:
+      return 0;
+  }
+}
+
+size_t JsonStreamWriter::writeValue() {
+  const JsonVariant &value = *_value;
+  _state = STATE_NEXT;
+
+  if (value.is<const JsonObject &>())
+    return openObject(value.as<const JsonObject &>());
+
+  if (value.is<const JsonArray &>())
+    return openArray(value.as<const JsonArray &>());
+
+  JsonWriter writer(_out);
+  if (value.is<const char *>()) {
+    _string = value.as<const char *>();
+    if (!_string) {
+      value.writeTo(writer);  // null
+    } else {
+      _afterString = STATE_NEXT;
+      _state = STATE_STRING;
+      return _out.write('\"');
+    }
+  } else {
+    value.writeTo(writer);
+  }
+  return writer.bytesWritten();
+}
+
+size_t JsonStreamWriter::writeNextElement() {
+  if (_depth == 0) {
+    _state = STATE_DONE;
+    return 0;
+  }
+
+  Level &level = _levels[_depth - 1];
+  bool atEnd = level.isObject ? level.member == JsonObject::const_iterator()
+                              : level.element == JsonArray::const_iterator();
+  if (atEnd) {
+    _depth--;
+    return _out.write(level.isObject ? '}' : ']');
+  }
+
+  size_t n = level.first ? 0 : _out.write(',');
+  level.first = false;
+
+  if (level.isObject) {
+    const JsonPair &pair = *level.member;
+    ++level.member;
+    _value = &pair.value;
+    _string = pair.key;
+    _afterString = STATE_COLON;
+    _state = STATE_STRING;
+    n += _out.write('\"');
+  } else {
+    _value = &*level.element;
+    ++level.element;
+    _state = STATE_VALUE;
+  }
+  return n;
+}
+
+size_t JsonStreamWriter::writeString() {
+  size_t n = 0;
+  for (int i = 0; i < STRING_STEP && *_string; i++)
+    n += QuotedString::printCharTo(*_string++, _out);
+
+  if (!*_string) {
+    _state = _afterString;
+    n += _out.write('\"');
+  }
+  return n;
+}
+
+size_t JsonStreamWriter::openObject(const JsonObject &object) {
+  if (_depth == MAX_DEPTH) return _out.print("null");
+
+  Level &level = _levels[_depth++];
+  level.isObject = true;
+  level.first = true;
+  level.member = object.begin();
+  _state = STATE_NEXT;
+  return _out.write('{');
+}
+
+size_t JsonStreamWriter::openArray(const JsonArray &array) {
+  if (_depth == MAX_DEPTH) return _out.print("null");
+
+  Level &level = _levels[_depth++];
+  level.isObject = false;
+  level.first = true;
+  level.element = array.begin();
+  _state = STATE_NEXT;
+  return _out.write('[');
+}
@@ -25,7 +25,7 @@ static inline char getSpecialChar(char c) {
   return p[0];
 }
 
-static inline size_t printCharTo(char c, Print &p) {
+size_t QuotedString::printCharTo(char c, Print &p) {
   char specialChar = getSpecialChar(c);
 
   return specialChar ? p.write('\\') + p.write(specialChar) : p.write(c);
@@ -126,6 +126,10 @@ String JsonObject::toJsonString(bool prettyPrintStyle /* = true*/) const
   else
 	  printTo(stream);
 
-  result.setString(stream.getStreamPointer(), stream.getStreamLength());
+  result.reserve(stream.getStreamLength());
+  const char* block;
+  uint16_t len;
+  while ((len = stream.getDirectBlock(block)) > 0 && stream.seek(len))
+    result.concat(block, len);
   return result;
 }
@@ -7,6 +7,7 @@
 
 #include "CommandHandler.h"
 #include "CommandDelegate.h"
+#include "FileSystem.h"
 
 CommandHandler::CommandHandler()
 {
@@ -100,6 +101,17 @@ void CommandHandler::procesStatusCommand(String commandLine, CommandOutput* comm
 	commandOutput->printf(SystemClock.getSystemTimeString().c_str());
 	commandOutput->printf("\r\n");
 	commandOutput->printf("System Start Reason : %d\r\n", system_get_rst_info()->reason);
+
+	spiffs_sming_stats fs;
+	if (fileSystemStats(&fs))
+	{
+		uint32_t reads = fs.cache_hits + fs.cache_misses;
+		commandOutput->printf("File system : %d of %d bytes used\r\n", fs.used, fs.total);
+		commandOutput->printf("File system buffers : %d files, %d cache pages\r\n", fs.max_files, fs.cache_pages);
+		commandOutput->printf("File system cache : %d hits, %d misses (%d%%)\r\n", fs.cache_hits, fs.cache_misses,
+				reads > 0 ? (int)((uint64_t)fs.cache_hits * 100 / reads) : 0);
+		commandOutput->printf("File system GC runs : %d, %d blocks in background\r\n", fs.gc_runs, fs.gc_background);
+	}
 }
 
 void CommandHandler::procesEchoCommand(String commandLine, CommandOutput* commandOutput)
@@ -140,6 +140,8 @@ typedef void (*spiffs_check_callback)(spiffs_check_type type, spiffs_check_repor
 #define SPIFFS_DIRECT                   (1<<5)
 /* If SPIFFS_CREAT and SPIFFS_EXCL are set, SPIFFS_open() shall fail if the file exists */
 #define SPIFFS_EXCL                     (1<<6)
+/* The file is read sequentially, next data page is prefetched to cache */
+#define SPIFFS_SEQUENTIAL               (1<<7)
 
 #define SPIFFS_SEEK_SET                 (0)
 #define SPIFFS_SEEK_CUR                 (1)
@@ -548,6 +550,18 @@ s32_t SPIFFS_gc_quick(spiffs *fs, u16_t max_free_pages);
  */
 s32_t SPIFFS_gc(spiffs *fs, u32_t size);
 
+/**
+ * Reclaims at most one block: erases a block with only deleted pages, or
+ * moves used pages out of the block with most deleted pages and erases it.
+ * Meant to be called repeatedly in idle time, so writes find erased blocks
+ * and don't have to run the garbage collector themselves.
+ * Returns SPIFFS_OK if a block was erased, SPIFFS_ERR_NO_DELETED_BLOCKS if
+ * there was nothing to reclaim, or other error.
+ *
+ * @param fs            the file system struct
+ */
+s32_t SPIFFS_gc_step(spiffs *fs);
+
 /**
  * Check if EOF reached.
  * @param fs            the file system struct
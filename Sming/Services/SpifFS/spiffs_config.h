@@ -67,9 +67,9 @@ typedef unsigned char u8_t;
 #define SPIFFS_CACHE_WR                 1
 #endif
 
-// Enable/disable statistics on caching. Debug/test purpose only.
+// Enable/disable statistics on caching, reported by spiffs_get_stats().
 #ifndef  SPIFFS_CACHE_STATS
-#define SPIFFS_CACHE_STATS              0
+#define SPIFFS_CACHE_STATS              1
 #endif
 #endif
 
@@ -84,9 +84,9 @@ typedef unsigned char u8_t;
 #define SPIFFS_GC_MAX_RUNS              3
 #endif
 
-// Enable/disable statistics on gc. Debug/test purpose only.
+// Enable/disable statistics on gc, reported by spiffs_get_stats().
 #ifndef SPIFFS_GC_STATS
-#define SPIFFS_GC_STATS                 0
+#define SPIFFS_GC_STATS                 1
 #endif
 
 // Garbage collecting examines all pages in a block which and sums up
@@ -193,6 +193,40 @@ s32_t spiffs_gc_check(
   return res;
 }
 
+// Reclaims at most one block: a fully deleted block is erased if there is one,
+// otherwise used pages of the best candidate are moved out and it is erased.
+// Used for incremental gc when the system is idle.
+s32_t spiffs_gc_step(
+    spiffs *fs) {
+  s32_t res = spiffs_gc_quick(fs, 0);
+  if (res != SPIFFS_ERR_NO_DELETED_BLOCKS) {
+    return res;
+  }
+  if (fs->stats_p_deleted == 0) {
+    return SPIFFS_ERR_NO_DELETED_BLOCKS;
+  }
+
+  spiffs_block_ix *cands;
+  int count;
+  res = spiffs_gc_find_candidate(fs, &cands, &count, 0);
+  SPIFFS_CHECK_RES(res);
+  if (count == 0) {
+    return SPIFFS_ERR_NO_DELETED_BLOCKS;
+  }
+  spiffs_block_ix cand = cands[0];
+  SPIFFS_GC_DBG("gc_step: cleaning block %i\n", cand);
+
+  fs->cleaning = 1;
+  res = spiffs_gc_clean(fs, cand);
+  fs->cleaning = 0;
+  SPIFFS_CHECK_RES(res);
+
+  res = spiffs_gc_erase_page_stats(fs, cand);
+  SPIFFS_CHECK_RES(res);
+
+  return spiffs_gc_erase_block(fs, cand);
+}
+
 // Updates page statistics for a block that is about to be erased
 s32_t spiffs_gc_erase_page_stats(
     spiffs *fs,
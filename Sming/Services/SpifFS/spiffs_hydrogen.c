@@ -922,6 +922,19 @@ s32_t SPIFFS_gc(spiffs *fs, u32_t size) {
   return 0;
 }
 
+s32_t SPIFFS_gc_step(spiffs *fs) {
+  s32_t res;
+  SPIFFS_API_CHECK_CFG(fs);
+  SPIFFS_API_CHECK_MOUNT(fs);
+  SPIFFS_LOCK(fs);
+
+  res = spiffs_gc_step(fs);
+
+  SPIFFS_API_CHECK_RES_UNLOCK(fs, res);
+  SPIFFS_UNLOCK(fs);
+  return SPIFFS_OK;
+}
+
 s32_t SPIFFS_eof(spiffs *fs, spiffs_file fh) {
   s32_t res;
   SPIFFS_API_CHECK_CFG(fs);
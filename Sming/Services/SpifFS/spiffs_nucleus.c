@@ -1691,6 +1691,22 @@ s32_t spiffs_object_read(
     data_spix++;
   }
 
+#if SPIFFS_CACHE
+  // prefetch following data page, only when it's listed in already loaded index page
+  if (res == SPIFFS_OK && (fd->flags & SPIFFS_SEQUENTIAL) && cur_offset < fd->size &&
+      cur_offset % SPIFFS_DATA_PAGE_SIZE(fs) == 0 &&
+      SPIFFS_OBJ_IX_ENTRY_SPAN_IX(fs, data_spix) == prev_objix_spix) {
+    if (prev_objix_spix == 0) {
+      data_pix = ((spiffs_page_ix*)((u8_t *)objix_hdr + sizeof(spiffs_page_object_ix_header)))[data_spix];
+    } else {
+      data_pix = ((spiffs_page_ix*)((u8_t *)objix + sizeof(spiffs_page_object_ix)))[SPIFFS_OBJ_IX_ENTRY(fs, data_spix)];
+    }
+    u8_t b;
+    (void)_spiffs_rd(fs, SPIFFS_OP_T_OBJ_DA | SPIFFS_OP_C_READ, fd->file_nbr,
+        SPIFFS_PAGE_TO_PADDR(fs, data_pix) + sizeof(spiffs_page_header), 1, &b);
+  }
+#endif
+
   return res;
 }
 
@@ -1,12 +1,33 @@
 #include "spiffs_sming.h"
+#include "spiffs_nucleus.h"
 
 #define LOG_PAGE_SIZE       256
 
+// Buffers sized automatically take up to this part of free heap
+#define SPIFFS_HEAP_SHARE       8
+#define SPIFFS_DEFAULT_FDS      7
+#define SPIFFS_MIN_CACHE_PAGES  2
+// spiffs doesn't use more than 32 pages of cache memory
+#define SPIFFS_MAX_CACHE_PAGES  ((LOG_PAGE_SIZE * 32 - sizeof(spiffs_cache)) / (sizeof(spiffs_cache_page) + LOG_PAGE_SIZE))
+
+#define SPIFFS_CACHE_BYTES(pages) (sizeof(spiffs_cache) + (pages) * (sizeof(spiffs_cache_page) + LOG_PAGE_SIZE))
+
 spiffs _filesystemStorageHandle;
 
-static u8_t spiffs_work_buf[LOG_PAGE_SIZE*2];
-static u8_t spiffs_fds[32*7]; // sizeof(spiffs_fd) * K
-static u8_t spiffs_cache[(LOG_PAGE_SIZE+32)*4];
+// Requested by spiffs_set_mount_config(), 0 - sized from free heap
+static u16_t spiffs_max_files = 0;
+static u16_t spiffs_cache_pages = 0;
+
+// Allocated at mount time, released by spiffs_unmount()
+static u8_t *spiffs_work_buf = NULL;
+static u8_t *spiffs_fds = NULL;
+static u8_t *spiffs_cache_buf = NULL;
+static u16_t spiffs_mounted_files = 0;
+static u16_t spiffs_mounted_pages = 0;
+
+static u32_t spiffs_background_gc_blocks = 0;
+// Changed by every format, mount and unmount
+static u32_t spiffs_generation = 0;
 
 static s32_t api_spiffs_read(u32_t addr, u32_t size, u8_t *dst)
 {
@@ -94,6 +115,64 @@ bool spiffs_format_internal(spiffs_config *cfg)
   }
   debugf("formated");
   ETS_INTR_UNLOCK();
+  spiffs_generation++;
+  return true;
+}
+
+void spiffs_set_mount_config(u16_t max_files, u16_t cache_pages)
+{
+  spiffs_max_files = max_files;
+  spiffs_cache_pages = cache_pages;
+}
+
+static void spiffs_free_buffers()
+{
+  os_free(spiffs_work_buf);
+  os_free(spiffs_fds);
+  os_free(spiffs_cache_buf);
+  spiffs_work_buf = NULL;
+  spiffs_fds = NULL;
+  spiffs_cache_buf = NULL;
+  spiffs_mounted_files = 0;
+  spiffs_mounted_pages = 0;
+}
+
+static bool spiffs_alloc_buffers()
+{
+  u32_t budget = system_get_free_heap_size() / SPIFFS_HEAP_SHARE;
+
+  u16_t files = spiffs_max_files;
+  if (files == 0)
+	  files = SPIFFS_DEFAULT_FDS;
+
+  u16_t pages = spiffs_cache_pages;
+  if (pages == 0)
+  {
+	  // Whatever is left from budget after file descriptors goes to cache
+	  u32_t used = LOG_PAGE_SIZE * 2 + files * sizeof(spiffs_fd) + SPIFFS_CACHE_BYTES(0);
+	  pages = budget > used ? (budget - used) / (sizeof(spiffs_cache_page) + LOG_PAGE_SIZE) : 0;
+	  if (pages < SPIFFS_MIN_CACHE_PAGES)
+		  pages = SPIFFS_MIN_CACHE_PAGES;
+  }
+  if (pages > SPIFFS_MAX_CACHE_PAGES)
+	  pages = SPIFFS_MAX_CACHE_PAGES;
+
+  spiffs_work_buf = (u8_t *)os_malloc(LOG_PAGE_SIZE * 2);
+  spiffs_fds = (u8_t *)os_malloc(files * sizeof(spiffs_fd));
+  if (spiffs_work_buf == NULL || spiffs_fds == NULL)
+  {
+	  spiffs_free_buffers();
+	  return false;
+  }
+
+  // Cache is optional, try smaller one when heap is short
+  while (pages > 0 && (spiffs_cache_buf = (u8_t *)os_malloc(SPIFFS_CACHE_BYTES(pages))) == NULL)
+	  pages /= 2;
+
+  spiffs_mounted_files = files;
+  spiffs_mounted_pages = pages;
+  debugf("fs buffers: %d files, %d cache pages", files, pages);
+  return true;
 }
 
 static void spiffs_mount_internal(spiffs_config *cfg)
@@ -104,6 +183,13 @@ static void spiffs_mount_internal(spiffs_config *cfg)
 	  return;
   }
 
+  spiffs_unmount();
+  if (!spiffs_alloc_buffers())
+  {
+	  SYSTEM_ERROR("Can't start file system, out of memory");
+	  return;
+  }
+
   debugf("fs.start: size:%d Kb, offset:0x%X\n", cfg->phys_size / 1024, cfg->phys_addr - INTERNAL_FLASH_START_ADDRESS);
 
   cfg->hal_read_f = api_spiffs_read;
@@ -126,11 +212,12 @@ static void spiffs_mount_internal(spiffs_config *cfg)
     cfg,
     spiffs_work_buf,
     spiffs_fds,
-    sizeof(spiffs_fds),
-    spiffs_cache,
-    sizeof(spiffs_cache),
+    spiffs_mounted_files * sizeof(spiffs_fd),
+    spiffs_cache_buf,
+    spiffs_cache_buf != NULL ? SPIFFS_CACHE_BYTES(spiffs_mounted_pages) : 0,
     NULL);
   debugf("mount res: %d\n", res);
+  spiffs_generation++;
 
   if (writeFirst)
   {
@@ -165,6 +252,60 @@ void spiffs_mount_manual(u32_t phys_addr, u32_t phys_size)
 void spiffs_unmount()
 {
 	SPIFFS_unmount(&_filesystemStorageHandle);
+	spiffs_free_buffers();
+	spiffs_generation++;
+}
+
+u32_t spiffs_get_generation()
+{
+  return spiffs_generation;
+}
+
+bool spiffs_get_stats(spiffs_sming_stats *stats)
+{
+  memset(stats, 0, sizeof(spiffs_sming_stats));
+  if (!_filesystemStorageHandle.mounted)
+	  return false;
+
+  stats->max_files = spiffs_mounted_files;
+  stats->cache_pages = spiffs_mounted_pages;
+#if SPIFFS_CACHE_STATS
+  stats->cache_hits = _filesystemStorageHandle.cache_hits;
+  stats->cache_misses = _filesystemStorageHandle.cache_misses;
+#endif
+#if SPIFFS_GC_STATS
+  stats->gc_runs = _filesystemStorageHandle.stats_gc_runs;
+#endif
+  stats->gc_background = spiffs_background_gc_blocks;
+  SPIFFS_info(&_filesystemStorageHandle, &stats->total, &stats->used);
+  return true;
+}
+
+bool spiffs_gc_background(u32_t reserve_blocks, u32_t min_free_percent)
+{
+  spiffs *fs = &_filesystemStorageHandle;
+  if (!fs->mounted || fs->stats_p_deleted == 0)
+	  return false;
+
+  // Same accounting as spiffs_gc_check(), two blocks are spare
+  s32_t total_pages = (SPIFFS_PAGES_PER_BLOCK(fs) - SPIFFS_OBJ_LOOKUP_PAGES(fs)) * (fs->block_count - 2);
+  s32_t free_pages = total_pages - fs->stats_p_allocated - fs->stats_p_deleted;
+  if (fs->free_blocks >= reserve_blocks && free_pages * 100 >= total_pages * (s32_t)min_free_percent)
+	  return false;
+
+  if (SPIFFS_gc_step(fs) != SPIFFS_OK)
+  {
+	  SPIFFS_clearerr(fs);
+	  return false;
+  }
+
+  spiffs_background_gc_blocks++;
+  return true;
+}
+
+u32_t spiffs_get_data_page_size()
+{
+  return LOG_PAGE_SIZE - sizeof(spiffs_page_header);
 }
 
 // FS formatting function
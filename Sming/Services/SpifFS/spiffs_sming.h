@@ -7,6 +7,18 @@ extern "C" {
 
 #include "spiffs.h"
 
+typedef struct
+{
+  u16_t max_files;
+  u16_t cache_pages;
+  u32_t cache_hits;
+  u32_t cache_misses;
+  u32_t gc_runs;
+  u32_t gc_background; // Blocks reclaimed by spiffs_gc_background()
+  u32_t total;
+  u32_t used;
+} spiffs_sming_stats;
+
 void spiffs_mount();
 void spiffs_mount_manual(u32_t phys_addr, u32_t phys_size);
 void spiffs_unmount();
@@ -14,6 +26,15 @@ bool spiffs_format();
 bool spiffs_format_internal(spiffs_config *cfg);
 bool spiffs_format_manual(u32_t phys_addr, u32_t phys_size);
 spiffs_config spiffs_get_storage_config();
+// Used by next mount. 0 files - default number, 0 pages - cache sized from free heap
+void spiffs_set_mount_config(u16_t max_files, u16_t cache_pages);
+bool spiffs_get_stats(spiffs_sming_stats *stats);
+u32_t spiffs_get_data_page_size();
+// Changed by every format, mount and unmount, file pages aren't valid across it
+u32_t spiffs_get_generation();
+// Reclaims one block when fewer than reserve_blocks are erased or free space
+// is below min_free_percent. Returns true if a block was reclaimed.
+bool spiffs_gc_background(u32_t reserve_blocks, u32_t min_free_percent);
 extern void test_spiffs();
 
 extern spiffs _filesystemStorageHandle;
@@ -41,14 +41,12 @@ void wsMakeFrame(const uint8_t *data, size_t dataLength,
         memcpy(&outFrame[2], &payloadLength16b, 2);
         *outLength = 4;
     } else {
-        assert(dataLength <= 0xFFFF);
-        
-        /* implementation for 64bit systems
+        // 64 bit length, network byte order
         outFrame[1] = 127;
-        dataLength = htonll(dataLength);
-        memcpy(&outFrame[2], &dataLength, 8);
+        uint64_t payloadLength64b = dataLength;
+        for (int i = 0; i < 8; i++)
+            outFrame[2 + i] = (uint8_t)(payloadLength64b >> (56 - i * 8));
         *outLength = 10;
-        */
     }
 
     if (data != NULL)
@@ -133,13 +131,48 @@ wsFrameType wsParseInputFrame(uint8_t *inputFrame, size_t inputLength,
             *dataPtr = &inputFrame[2 + payloadFieldExtraBytes + 4];
             *dataLength = payloadLength;
 		
-            size_t i;
-            for (i = 0; i < *dataLength; i++) {
-                (*dataPtr)[i] = (*dataPtr)[i] ^ maskingKey[i%4];
-            }
+            wsMaskData(*dataPtr, *dataLength, maskingKey, 0);
         }
         return frameType;
     }
 
     return WS_ERROR_FRAME;
 }
+
+void wsMaskData(uint8_t *data, size_t length,
+                const uint8_t *maskingKey, size_t maskOffset)
+{
+    size_t k = maskOffset;
+
+    // Head: single bytes up to word boundary
+    while (length > 0 && ((uintptr_t)data & 3) != 0) {
+        *data++ ^= maskingKey[k++ & 3];
+        length--;
+    }
+
+    // Key rotated to the current position, in memory byte order
+    uint8_t key[4];
+    for (int i = 0; i < 4; i++)
+        key[i] = maskingKey[(k + i) & 3];
+    uint32_t key32;
+    memcpy(&key32, key, 4);
+
+    uint32_t *words = (uint32_t *)data;
+    size_t count = length / 4;
+    while (count >= 4) {
+        words[0] ^= key32;
+        words[1] ^= key32;
+        words[2] ^= key32;
+        words[3] ^= key32;
+        words += 4;
+        count -= 4;
+    }
+    while (count-- > 0)
+        *words++ ^= key32;
+
+    // Tail: remaining bytes continue with the same key phase
+    data = (uint8_t *)words;
+    length &= 3;
+    for (size_t i = 0; i < length; i++)
+        data[i] ^= key[i];
+}
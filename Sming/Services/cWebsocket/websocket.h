@@ -80,6 +80,9 @@ enum wsState {
     WS_STATE_CLOSING
 };
 
+    // Max size of unmasked (server) frame header
+    #define WS_MAX_HEADER_LENGTH 10
+
     /**
      * @param data Pointer to input data array
      * @param dataLength Length of data array
@@ -101,4 +104,15 @@ enum wsState {
     extern wsFrameType wsParseInputFrame(uint8_t *inputFrame, size_t inputLength,
                                        uint8_t **dataPtr, size_t *dataLength);
 
+    /**
+     * Applies (or removes) the masking key to a part of frame payload.
+     * Aligned part of data is processed a word at a time.
+     * @param data Pointer to payload part, modified in place
+     * @param length Length of payload part
+     * @param maskingKey Pointer to 4 bytes of masking key
+     * @param maskOffset Offset of the part from the beginning of payload
+     */
+    extern void wsMaskData(uint8_t *data, size_t length,
+                           const uint8_t *maskingKey, size_t maskOffset);
+
 #endif	/* WEBSOCKET_H */
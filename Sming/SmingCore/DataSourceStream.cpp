@@ -10,85 +10,220 @@
 #include "../SmingCore/Network/HttpRequest.h"
 #include "WiringFrameworkDependencies.h"
 
+MemoryStreamChunk* MemoryDataStream::pool = NULL;
+int MemoryDataStream::poolCount = 0;
+
 MemoryDataStream::MemoryDataStream()
 {
-	buf = NULL;
-	pos = NULL;
+	head = NULL;
+	tail = NULL;
+	readPos = 0;
 	size = 0;
-	capacity = 0;
+	consumed = 0;
+	joined = NULL;
+	referenced = false;
+	retired = NULL;
+	retiredTail = NULL;
+	retiredBytes = 0;
 }
 
 MemoryDataStream::~MemoryDataStream()
 {
-	free(buf);
-	buf = NULL;
-	pos = NULL;
+	while (head != NULL)
+	{
+		MemoryStreamChunk* cur = head;
+		head = cur->next;
+		releaseChunk(cur);
+	}
+	while (retired != NULL)
+	{
+		MemoryStreamChunk* cur = retired;
+		retired = cur->next;
+		releaseChunk(cur);
+	}
+	tail = NULL;
 	size = 0;
+	free(joined);
+	joined = NULL;
 }
 
-size_t MemoryDataStream::write(uint8_t charToWrite)
+MemoryStreamChunk* MemoryDataStream::allocateChunk()
 {
-	return write(&charToWrite, 1);
+	MemoryStreamChunk* chunk = pool;
+	if (chunk != NULL)
+	{
+		pool = chunk->next;
+		poolCount--;
+	}
+	else
+	{
+		chunk = (MemoryStreamChunk*)malloc(sizeof(MemoryStreamChunk));
+		if (chunk == NULL) return NULL;
+	}
+	chunk->next = NULL;
+	chunk->used = 0;
+	return chunk;
 }
 
-size_t MemoryDataStream::write(const uint8_t* data, size_t len)
+void MemoryDataStream::releaseChunk(MemoryStreamChunk* chunk)
 {
-	//TODO: add queued buffers without full copy
-	if (buf == NULL)
+	if (poolCount < MEMORY_STREAM_POOL_SIZE)
 	{
-		buf = (char*)malloc(len + 1);
-		buf[len] = '\0';
-		memcpy(buf, data, len);
+		chunk->next = pool;
+		pool = chunk;
+		poolCount++;
 	}
 	else
+		free(chunk);
+}
+
+size_t MemoryDataStream::write(uint8_t charToWrite)
+{
+	if (tail == NULL || tail->used == MEMORY_STREAM_CHUNK_SIZE)
+		return write(&charToWrite, 1);
+
+	tail->data[tail->used++] = charToWrite;
+	size++;
+	return 1;
+}
+
+size_t MemoryDataStream::write(const uint8_t* data, size_t len)
+{
+	size_t written = 0;
+	while (written < len)
 	{
-		int cur = size;
-		int required = cur + len + 1;
-		if (required > capacity)
+		if (tail == NULL || tail->used == MEMORY_STREAM_CHUNK_SIZE)
 		{
-			capacity = required < 256 ? required + 128 : required + 64;
-			debugf("realloc %d -> %d", size, capacity);
-			buf = (char*)realloc(buf, capacity);
+			MemoryStreamChunk* chunk = allocateChunk();
+			if (chunk == NULL)
+			{
+				debugf("MemoryDataStream: out of memory (%d bytes)", size);
+				break;
+			}
+			if (tail == NULL)
+				head = chunk;
+			else
+				tail->next = chunk;
+			tail = chunk;
 		}
-		buf[cur + len] = '\0';
-		memcpy(buf + cur, data, len);
+
+		int part = min((int)(len - written), MEMORY_STREAM_CHUNK_SIZE - tail->used);
+		memcpy(tail->data + tail->used, data + written, part);
+		tail->used += part;
+		written += part;
 	}
-	pos = buf;
-	size += len;
-	return len;
+
+	size += written;
+	return written;
 }
 
 uint16_t MemoryDataStream::readMemoryBlock(char* data, int bufSize)
 {
-	int available = min(size - (pos - buf), bufSize);
-	memcpy(data, pos, available);
+	int available = 0;
+	int offset = readPos;
+	for (MemoryStreamChunk* chunk = head; chunk != NULL && available < bufSize; chunk = chunk->next)
+	{
+		int part = min(chunk->used - offset, bufSize - available);
+		memcpy(data + available, chunk->data + offset, part);
+		available += part;
+		offset = 0;
+	}
 	return available;
 }
 
+uint16_t MemoryDataStream::getDirectBlock(const char*& data)
+{
+	if (head == NULL) return 0;
+
+	data = head->data + readPos;
+	referenced = true;
+	return head->used - readPos;
+}
+
+const char* MemoryDataStream::getStreamPointer()
+{
+	int length = available();
+	free(joined);
+	joined = (char*)malloc(length + 1);
+	if (joined == NULL) return NULL;
+
+	readMemoryBlock(joined, length);
+	joined[length] = '\0';
+	return joined;
+}
+
 bool MemoryDataStream::seek(int len)
 {
-	if (len < 0) return false;
+	if (len < 0 || len > available()) return false;
 
-	pos += len;
+	consumed += len;
+	readPos += len;
+	while (head != NULL && readPos >= head->used)
+	{
+		// Keep last chunk for appending unless it's full
+		if (head == tail && head->used < MEMORY_STREAM_CHUNK_SIZE) break;
+
+		MemoryStreamChunk* cur = head;
+		readPos -= cur->used;
+		head = cur->next;
+		if (head == NULL) tail = NULL;
+		if (referenced)
+		{
+			// Network stack may still use this data, free it after acknowledge
+			cur->next = NULL;
+			if (retiredTail == NULL)
+				retired = cur;
+			else
+				retiredTail->next = cur;
+			retiredTail = cur;
+			retiredBytes += cur->used;
+		}
+		else
+			releaseChunk(cur);
+	}
 	return true;
 }
 
+void MemoryDataStream::releaseAcked(int position)
+{
+	// Retired chunks end where head chunk starts
+	int start = consumed - readPos - retiredBytes;
+	while (retired != NULL && start + retired->used <= position)
+	{
+		MemoryStreamChunk* cur = retired;
+		retired = cur->next;
+		start += cur->used;
+		retiredBytes -= cur->used;
+		releaseChunk(cur);
+	}
+	if (retired == NULL)
+		retiredTail = NULL;
+}
+
 bool MemoryDataStream::isFinished()
 {
-	return size == (pos - buf);
+	return size == consumed;
 }
 
 ///////////////////////////////////////////////////////////////////////////
 
 FileStream::FileStream(String fileName)
 {
-	handle = fileOpen(fileName.c_str(), eFO_ReadOnly);
-	if (handle == -1)
-	{
+	file_t file = fileOpen(fileName.c_str(), eFO_ReadOnly | eFO_Sequential);
+	if (file == -1)
 		debugf("File wasn't found: %s", fileName.c_str());
-		size = -1;
-		pos = 0;
-	}
+	attach(file);
+	debugf("send file: %s (%d bytes)", fileName.c_str(), size);
+}
+
+FileStream::FileStream(file_t file)
+{
+	attach(file);
+}
+
+void FileStream::attach(file_t file)
+{
+	handle = file;
 
 	// Get size
 	fileSeek(handle, 0, eSO_FileEnd);
@@ -96,8 +231,6 @@ FileStream::FileStream(String fileName)
 
 	fileSeek(handle, 0, eSO_FileStart);
 	pos = 0;
-
-	debugf("send file: %s (%d bytes)", fileName.c_str(), size);
 }
 
 FileStream::~FileStream()
@@ -105,28 +238,69 @@ FileStream::~FileStream()
 	fileClose(handle);
 	handle = 0;
 	pos = 0;
+	delete[] buffer;
+	buffer = NULL;
 }
 
-uint16_t FileStream::readMemoryBlock(char* data, int bufSize)
+bool FileStream::fillBuffer(int offset)
+{
+	if (buffer == NULL)
+	{
+		bufferSize = fileDataPageSize() * FILE_STREAM_BUFFER_PAGES;
+		buffer = new char[bufferSize];
+		if (buffer == NULL)
+			return false;
+	}
+
+	// Start at page boundary, so every page is read once
+	int start = offset - offset % (bufferSize / FILE_STREAM_BUFFER_PAGES);
+	if (filePos != start)
+	{
+		if (fileSeek(handle, start, eSO_FileStart) < 0)
+			return false;
+		filePos = start;
+	}
+
+	int len = (int)fileRead(handle, buffer, min(bufferSize, size - start));
+	bufferStart = start;
+	bufferLength = len > 0 ? len : 0;
+	filePos += bufferLength;
+	return offset < bufferStart + bufferLength;
+}
+
+int FileStream::readBuffered(int offset, char* data, int length)
 {
-	int len = min(bufSize, size - pos);
-	int available = fileRead(handle, data, len);
-	fileSeek(handle, pos, eSO_FileStart); // Don't move cursor now (waiting seek)
+	int available = 0;
+	while (available < length)
+	{
+		int cur = offset + available;
+		if ((cur < bufferStart || cur >= bufferStart + bufferLength) && !fillBuffer(cur))
+			break;
+
+		int part = min(length - available, bufferStart + bufferLength - cur);
+		memcpy(data + available, buffer + cur - bufferStart, part);
+		available += part;
+	}
 	return available;
 }
 
+uint16_t FileStream::readMemoryBlock(char* data, int bufSize)
+{
+	return readBuffered(pos, data, min(bufSize, size - pos));
+}
+
 bool FileStream::seek(int len)
 {
-	if (len < 0) return false;
+	if (len < 0 || pos + len > size) return false;
 
-	bool result = fileSeek(handle, len, eSO_CurrentPos) >= 0;
-	if (result) pos += len;
-	return result;
+	// File cursor is moved only when buffer is filled next time
+	pos += len;
+	return true;
 }
 
 bool FileStream::isFinished()
 {
-	return fileIsEOF(handle);
+	return pos >= size;
 }
 
 String FileStream::fileName()
@@ -146,120 +320,209 @@ bool FileStream::fileExist()
 TemplateFileStream::TemplateFileStream(String templateFileName)
 	: FileStream(templateFileName)
 {
-	state = eTES_Wait;
+	operations = NULL;
+	operationsCount = 0;
+	operationsCapacity = 0;
+	values = NULL;
+	bound = false;
+	operationIndex = 0;
+	operationPos = 0;
+
+	if (!fileExist()) return;
+
+	// Compiled on every request: checking a cached copy costs a file system lookup and
+	// reading whole template, which is more than compiling it. Small template stays in
+	// stream buffer for rendering.
+	compile();
 }
 
 TemplateFileStream::~TemplateFileStream()
 {
+	free(operations);
+	operations = NULL;
+	delete[] values;
+	values = NULL;
 }
 
-uint16_t TemplateFileStream::readMemoryBlock(char* data, int bufSize)
+void TemplateFileStream::compile()
 {
-	debugf("READ Template (%d)", state);
-	int available;
+	char block[128];
+	char name[TEMPLATE_MAX_VAR_NAME_LEN];
+	int nameLength = 0;
+	int literalStart = 0;
+	int varStart = -1;
 
-	if (state == eTES_StartVar)
+	for (int offset = 0; offset < size;)
 	{
-		if (templateData.contains(varName))
-		{
-			// Return variable value
-			debugf("StartVar %s", varName.c_str());
-			available = templateData[varName].length();
-			memcpy(data, (char*)templateData[varName].c_str(), available);
-			seek(skipBlockSize);
-			varDataPos = 0;
-			state = eTES_SendingVar;
-			return available;
-		}
-		else
+		int len = readBuffered(offset, block, min((int)sizeof(block), size - offset));
+		if (len <= 0) break;
+
+		for (int i = 0; i < len; i++, offset++)
 		{
-			debugf("var %s not found", varName.c_str());
-			state = eTES_Wait;
-			int len = FileStream::readMemoryBlock(data, bufSize);
-			return min(len, skipBlockSize);
+			char c = block[i];
+			if (varStart >= 0)
+			{
+				if (isspace(c) || offset - varStart > TEMPLATE_MAX_VAR_NAME_LEN)
+					varStart = -1; // Not a var name
+				else if (c == '}')
+				{
+					if (nameLength > 0)
+					{
+						addOperation(literalStart, varStart - literalStart, TEMPLATE_LITERAL);
+						addOperation(varStart, offset - varStart + 1, addSlot(name, nameLength));
+						literalStart = offset + 1;
+					}
+					varStart = -1;
+					continue;
+				}
+				else if (c != '{')
+				{
+					name[nameLength++] = c;
+					continue;
+				}
+			}
+
+			if (c == '{')
+			{
+				varStart = offset;
+				nameLength = 0;
+			}
 		}
 	}
-	else if (state == eTES_SendingVar)
+	addOperation(literalStart, size - literalStart, TEMPLATE_LITERAL);
+
+	debugf("template compiled: %d operations, %d variables", operationsCount, slots.count());
+}
+
+void TemplateFileStream::addOperation(uint32_t offset, uint32_t length, uint16_t slot)
+{
+	while (length > 0)
 	{
-		String *val = &templateData[varName];
-		if (varDataPos < val->length())
+		if (slot == TEMPLATE_LITERAL && operationsCount > 0)
 		{
-			debugf("continue TRANSFER variable value (not completed)");
-			available = val->length() - varDataPos;
-			memcpy(data, ((char*)val->c_str()) + varDataPos, available);
-			return available;
+			// Join with previous plain text
+			TemplateOperation& last = operations[operationsCount - 1];
+			if (last.slot == TEMPLATE_LITERAL && last.offset + last.length == offset && last.length < 0xFFFF)
+			{
+				uint16_t part = min(length, (uint32_t)(0xFFFF - last.length));
+				last.length += part;
+				offset += part;
+				length -= part;
+				continue;
+			}
 		}
-		else
+
+		if (operationsCount == operationsCapacity)
 		{
-			debugf("continue to plaint text");
-			state = eTES_Wait;
+			operationsCapacity += 8;
+			operations = (TemplateOperation*)realloc(operations, operationsCapacity * sizeof(TemplateOperation));
 		}
+		TemplateOperation& op = operations[operationsCount++];
+		op.offset = offset;
+		op.length = min(length, (uint32_t)0xFFFF);
+		op.slot = slot;
+		offset += op.length;
+		length -= op.length;
 	}
+}
 
-	int len = FileStream::readMemoryBlock(data, bufSize);
-	char* tpl = data;
-	if (tpl && len > 0)
+uint16_t TemplateFileStream::addSlot(const char* name, int length)
+{
+	String slotName;
+	slotName.setString(name, length);
+	int slot = slots.indexOf(slotName);
+	if (slot < 0)
 	{
-		char* end = tpl + len;
-		char* cur = (char*)memchr(tpl, '{', len);
-		char* lastFound = cur;
-		while (cur != NULL)
+		slot = slots.count();
+		slots.add(slotName);
+	}
+	return slot;
+}
+
+void TemplateFileStream::bindVariables()
+{
+	if (bound) return;
+
+	// Resolve names once, rendering uses slot indexes only
+	bound = true;
+	values = new const String*[slots.count()];
+	for (int i = 0; i < slots.count(); i++)
+	{
+		values[i] = templateData.contains(slots[i]) ? &templateData[slots[i]] : NULL;
+		if (values[i] == NULL)
+			debugf("var %s not found", slots[i].c_str());
+	}
+
+	while (operationIndex < operationsCount && operationLength(operationIndex) == 0)
+		operationIndex++;
+}
+
+uint16_t TemplateFileStream::operationLength(int index)
+{
+	const TemplateOperation& op = operations[index];
+	if (op.slot == TEMPLATE_LITERAL || values[op.slot] == NULL)
+		return op.length; // Unknown variables are sent as is
+	return values[op.slot]->length();
+}
+
+uint16_t TemplateFileStream::readMemoryBlock(char* data, int bufSize)
+{
+	bindVariables();
+
+	int available = 0;
+	int index = operationIndex;
+	int opPos = operationPos;
+	while (available < bufSize && index < operationsCount)
+	{
+		const TemplateOperation& op = operations[index];
+		int part = min(operationLength(index) - opPos, bufSize - available);
+		if (op.slot != TEMPLATE_LITERAL && values[op.slot] != NULL)
+			memcpy(data + available, values[op.slot]->c_str() + opPos, part);
+		else
 		{
-			lastFound = cur;
-			char* p = cur + 1;
-			for (; p < end; p++)
+			int read = readBuffered(op.offset + opPos, data + available, part);
+			if (read < part)
 			{
-				if (isspace(*p))
-					break; // Not a var name
-				else if (p - cur > TEMPLATE_MAX_VAR_NAME_LEN)
-					break; // To long for var name
-				else if (*p == '{')
-					break; // New start..
-
-				if (*p == '}')
-				{
-					int block = p - cur + 1;
-					char varname[TEMPLATE_MAX_VAR_NAME_LEN + 1] = {0};
-					memcpy(varname, cur + 1, p - cur - 1); // name without { and }
-					varName = varname;
-					state = eTES_Found;
-					varWaitSize = cur - tpl;
-					debugf("found var: %s, at %d (%d) - %d, send size %d", varName.c_str(), cur - tpl + 1, cur - tpl + getPos(), p - tpl, cur - tpl);
-					skipBlockSize = block;
-					return cur - tpl; // return only plain text from template without our variable
-				}
+				available += read;
+				break;
 			}
-			cur = (char*)memchr(p, '{', len - (p - tpl)); // continue searching..
-		}
-		if (lastFound != NULL && (lastFound - tpl) > (len - TEMPLATE_MAX_VAR_NAME_LEN))
-		{
-			debugf("trim end to %d from %d", lastFound - tpl, len);
-			len = lastFound - tpl; // It can be a incomplete variable name. Don't split it!
 		}
+		available += part;
+		index++;
+		opPos = 0;
 	}
-
-	debugf("plain template text pos: %d, len: %d", getPos(), len);
-	return len;
+	return available;
 }
 
 bool TemplateFileStream::seek(int len)
 {
 	if (len < 0) return false;
-	//debugf("SEEK: %d, (%d)", len, state);
 
-	if (state == eTES_Found)
-	{
-		//debugf("SEEK before Var: %d, (%d)", len, varWaitSize);
-		varWaitSize -= len;
-		if (varWaitSize == 0) state = eTES_StartVar;
-	}
-	else if (state == eTES_SendingVar)
+	bindVariables();
+	pos += len;
+	operationPos += len;
+	while (operationIndex < operationsCount && operationPos >= operationLength(operationIndex))
 	{
-		varDataPos += len;
-		return false; // not the end
+		operationPos -= operationLength(operationIndex);
+		operationIndex++;
 	}
+	return true;
+}
 
-	return FileStream::seek(len);
+bool TemplateFileStream::isFinished()
+{
+	bindVariables();
+	return operationIndex >= operationsCount;
+}
+
+int TemplateFileStream::available()
+{
+	bindVariables();
+
+	int total = -operationPos;
+	for (int i = operationIndex; i < operationsCount; i++)
+		total += operationLength(i);
+	return total;
 }
 
 void TemplateFileStream::setVar(String name, String value)
@@ -277,8 +540,9 @@ void TemplateFileStream::setVarsFromRequest(const HttpRequest& request)
 
 ///////////////////////////////////////////////////////////////////////////
 
-JsonObjectStream::JsonObjectStream()
-	: rootNode(buffer.createObject()), send(true)
+JsonObjectStream::JsonObjectStream(bool prettyPrint /* = true*/)
+	: rootNode(buffer.createObject()), writer(*this, prettyPrint),
+	  prettyPrint(prettyPrint), started(false), length(-1)
 {
 }
 
@@ -291,13 +555,52 @@ JsonObject& JsonObjectStream::getRoot()
 	return rootNode;
 }
 
+void JsonObjectStream::start()
+{
+	if (started) return;
+
+	started = true;
+	if (rootNode != JsonObject::invalid())
+		writer.begin(rootNode);
+}
+
 uint16_t JsonObjectStream::readMemoryBlock(char* data, int bufSize)
 {
-	if (rootNode != JsonObject::invalid() && send)
+	start();
+
+	// Render only what is requested, sent data is released by seek
+	int pending = MemoryDataStream::available();
+	if (pending < bufSize)
+		writer.writeNext(bufSize - pending);
+
+	return MemoryDataStream::readMemoryBlock(data, bufSize);
+}
+
+bool JsonObjectStream::isFinished()
+{
+	start();
+	return writer.finished() && MemoryDataStream::isFinished();
+}
+
+int JsonObjectStream::available()
+{
+	start();
+
+	if (length < 0)
 	{
-		int len = rootNode.prettyPrintTo(*this);
-		send = false;
+		// Dry run to count output size without storing it
+		class CountingPrint : public Print
+		{
+		public:
+			virtual size_t write(uint8_t) { return 1; }
+			virtual size_t write(const uint8_t* buffer, size_t size) { return size; }
+		};
+		CountingPrint counter;
+		ArduinoJson::Internals::JsonStreamWriter measure(counter, prettyPrint);
+		length = 0;
+		if (rootNode != JsonObject::invalid())
+			length = measure.begin(rootNode) + measure.writeNext((size_t)-1);
 	}
 
-	return MemoryDataStream::readMemoryBlock(data, bufSize);
+	return length - (getStreamLength() - MemoryDataStream::available());
 }
@@ -11,6 +11,7 @@
 #include <user_config.h>
 #include "../SmingCore/FileSystem.h"
 #include "../Services/ArduinoJson/ArduinoJson.h"
+#include "../Services/ArduinoJson/include/ArduinoJson/Internals/JsonStreamWriter.hpp"
 #include "../Wiring/WString.h"
 #include "../Wiring/WHashMap.h"
 
@@ -42,6 +43,33 @@ public:
 	virtual uint16_t readMemoryBlock(char* data, int bufSize) = 0;
 	virtual bool seek(int len) = 0;
 	virtual bool isFinished() = 0;
+	// Remaining data size, -1 if unknown before streaming
+	virtual int available() { return -1; }
+
+	// Optional zero-copy access to next contiguous data block.
+	// Data must stay valid and unchanged until the stream is deleted.
+	// Returns 0 if stream doesn't support it.
+	virtual uint16_t getDirectBlock(const char*& data) { return 0; }
+	// Data before this position, counted in bytes passed by seek, was acknowledged.
+	// Blocks given by getDirectBlock before it are not used anymore.
+	virtual void releaseAcked(int position) {}
+};
+
+// Memory stream data is kept in fixed size chunks, no reallocation on growth
+#ifndef MEMORY_STREAM_CHUNK_SIZE
+#define MEMORY_STREAM_CHUNK_SIZE	512
+#endif
+
+// Number of released chunks kept for reuse by all memory streams
+#ifndef MEMORY_STREAM_POOL_SIZE
+#define MEMORY_STREAM_POOL_SIZE		4
+#endif
+
+struct MemoryStreamChunk
+{
+	MemoryStreamChunk* next;
+	uint16_t used;
+	char data[MEMORY_STREAM_CHUNK_SIZE];
 };
 
 class MemoryDataStream : public Print, public IDataSourceStream
@@ -51,7 +79,8 @@ public:
 	virtual ~MemoryDataStream();
 
 	virtual StreamType getStreamType() { return eSST_Memory; }
-	const char* getStreamPointer() { return pos; }
+	// Joins all remaining data into one block, prefer readMemoryBlock/getDirectBlock
+	const char* getStreamPointer();
 	int getStreamLength() { return size; }
 
 	virtual size_t write(uint8_t charToWrite);
@@ -60,18 +89,41 @@ public:
 	virtual uint16_t readMemoryBlock(char* data, int bufSize);
 	virtual bool seek(int len);
 	virtual bool isFinished();
+	virtual int available() { return size - consumed; }
+	virtual uint16_t getDirectBlock(const char*& data);
+	virtual void releaseAcked(int position);
+
+	static int getPoolSize() { return poolCount; }
 
 private:
-	char* buf;
-	char* pos;
-	int size;
-	int capacity;
+	MemoryStreamChunk* allocateChunk();
+	void releaseChunk(MemoryStreamChunk* chunk);
+
+private:
+	MemoryStreamChunk* head; // First chunk with unread data
+	MemoryStreamChunk* tail; // Last chunk, new data appended here
+	int readPos; // Read position in head chunk
+	int size; // Total bytes written
+	int consumed; // Total bytes passed by seek
+	char* joined; // Result of getStreamPointer
+	bool referenced; // Data pointer was given out, consumed chunks can't be reused
+	MemoryStreamChunk* retired; // Consumed chunks waiting for acknowledge, oldest first
+	MemoryStreamChunk* retiredTail;
+	int retiredBytes;
+
+	static MemoryStreamChunk* pool;
+	static int poolCount;
 };
 
+// Read-ahead buffer size of FileStream, in file system pages
+#define FILE_STREAM_BUFFER_PAGES	4
+
 class FileStream : public IDataSourceStream
 {
 public:
 	FileStream(String fileName);
+	// Takes ownership of opened file
+	FileStream(file_t file);
 	virtual ~FileStream();
 
 	virtual StreamType getStreamType() { return eSST_File; }
@@ -79,23 +131,39 @@ public:
 	virtual uint16_t readMemoryBlock(char* data, int bufSize);
 	virtual bool seek(int len);
 	virtual bool isFinished();
+	virtual int available() { return size < 0 ? -1 : size - pos; }
 
 	String fileName();
 	bool fileExist();
 	inline int getPos() { return pos; }
 
-private:
+protected:
+	void attach(file_t file);
+	bool fillBuffer(int offset);
+	int readBuffered(int offset, char* data, int length);
+
+protected:
 	file_t handle;
 	int pos;
 	int size;
+
+	// Read-ahead of whole file system pages, so peeking data
+	// and seeking over it don't move file cursor back and forth
+	char* buffer = NULL;
+	int bufferSize = 0;
+	int bufferStart = 0; // File offset of buffered data
+	int bufferLength = 0;
+	int filePos = 0;
 };
 
-enum TemplateExpandState
+#define TEMPLATE_LITERAL			0xFFFF
+
+// One rendering step: copy a span of template file or emit a variable slot
+struct TemplateOperation
 {
-	eTES_Wait,
-	eTES_Found,
-	eTES_StartVar,
-	eTES_SendingVar
+	uint32_t offset; // Span in the template file, for variables it's the "{name}" text
+	uint16_t length;
+	uint16_t slot; // Variable slot or TEMPLATE_LITERAL
 };
 
 class TemplateFileStream : public FileStream
@@ -108,24 +176,36 @@ public:
 
 	virtual uint16_t readMemoryBlock(char* data, int bufSize);
 	virtual bool seek(int len);
+	virtual bool isFinished();
+	virtual int available();
 
 	void setVar(String name, String value);
 	void setVarsFromRequest(const HttpRequest& request);
 	inline TemplateVariables& variables() { return templateData; }
 
+private:
+	void compile();
+	void addOperation(uint32_t offset, uint32_t length, uint16_t slot);
+	uint16_t addSlot(const char* name, int length);
+	void bindVariables();
+	uint16_t operationLength(int index);
+
 private:
 	TemplateVariables templateData;
-	TemplateExpandState state;
-	String varName;
-	int skipBlockSize;
-	int varDataPos;
-	int varWaitSize;
+	TemplateOperation* operations;
+	int operationsCount;
+	int operationsCapacity;
+	Vector<String> slots;
+	const String** values; // Bound slot values, NULL if variable isn't set
+	bool bound;
+	int operationIndex; // Current rendering position
+	int operationPos;
 };
 
 class JsonObjectStream : public MemoryDataStream
 {
 public:
-	JsonObjectStream();
+	JsonObjectStream(bool prettyPrint = true);
 	virtual ~JsonObjectStream();
 
 	virtual StreamType getStreamType() { return eSST_JsonObject; }
@@ -133,11 +213,21 @@ public:
 	JsonObject& getRoot();
 
 	virtual uint16_t readMemoryBlock(char* data, int bufSize);
+	virtual bool isFinished();
+	virtual int available();
+	// Rendered blocks are released as soon as they are sent, so they can't be referenced
+	virtual uint16_t getDirectBlock(const char*& data) { return 0; }
+
+private:
+	void start();
 
 private:
 	DynamicJsonBuffer buffer;
 	JsonObject &rootNode;
-	bool send;
+	ArduinoJson::Internals::JsonStreamWriter writer;
+	bool prettyPrint;
+	bool started;
+	int length; // Total document length, -1 if not measured yet
 };
 
 
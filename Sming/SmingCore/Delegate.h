@@ -10,58 +10,42 @@
 
 #include <user_config.h>
 
-template<class ReturnType, typename... ParamsList>
-class IDelegateCaller
+// Function pointers, class methods and small functors are stored inside Delegate
+// and called through a static thunk, without heap allocation or virtual calls.
+// Only functors which don't fit into DELEGATE_INLINE_SIZE are moved to heap.
+class DelegateGenericClass;
+typedef void (DelegateGenericClass::*DelegateGenericMethod)();
+
+#define DELEGATE_INLINE_SIZE (sizeof(void*) + sizeof(DelegateGenericMethod))
+
+enum DelegateOperation
 {
-public:
-	virtual ~IDelegateCaller() = default;
-    virtual ReturnType invoke(ParamsList...) = 0;
-
-    __forceinline void increase()
-    {
-    	references++;
-    }
-    __forceinline void decrease()
-    {
-    	references--;
-		if (references == 0)
-			delete this;
-    }
-private:
-    uint32_t references = 1;
+	eDO_Copy,
+	eDO_Destroy
 };
 
-template< class >
-class MethodCaller;  /* undefined */
+// Placement construction of functors inside delegate storage
+struct DelegatePlacement {};
+inline void* operator new(size_t, DelegatePlacement, void* place) { return place; }
+inline void operator delete(void*, DelegatePlacement, void*) {}
 
-template< class ClassType, class ReturnType, typename... ParamsList >
-class MethodCaller<ReturnType (ClassType::*)(ParamsList ...)> : public IDelegateCaller<ReturnType, ParamsList...>
-{
-	typedef ReturnType (ClassType::*MethodDeclaration)(ParamsList ...);
-public:
-    MethodCaller( ClassType* c, MethodDeclaration m ) : mClass( c ), mMethod( m ) {}
-    ReturnType invoke(ParamsList... args)
-    {
-    	return (mClass->*mMethod)( args... );
-    }
+template<bool value>
+struct DelegateBool {};
 
-private:
-    ClassType *mClass;
-    MethodDeclaration mMethod;
+template<class ClassType, class MethodDeclaration>
+struct DelegateMethod
+{
+	ClassType* object;
+	MethodDeclaration method;
 };
 
-template< class MethodDeclaration, class ReturnType, typename... ParamsList >
-class FunctionCaller : public IDelegateCaller<ReturnType, ParamsList...>
+template<class Functor>
+struct DelegateHeapFunctor
 {
-public:
-    FunctionCaller( MethodDeclaration m ) : mMethod( m ) {}
-    ReturnType invoke(ParamsList... args)
-    {
-    	return (mMethod)( args... );
-    }
+	DelegateHeapFunctor(const Functor& f) : functor(f) {}
 
-private:
-    MethodDeclaration mMethod;
+	uint32_t references = 1;
+	Functor functor;
 };
 
 template <class>
@@ -73,90 +57,187 @@ class Delegate <ReturnType (ParamsList ...)>
 	typedef ReturnType (*FunctionDeclaration)(ParamsList...);
 	template<typename ClassType> using MethodDeclaration = ReturnType (ClassType::*)(ParamsList ...);
 
+	union Storage
+	{
+		void* align;
+		char data[DELEGATE_INLINE_SIZE];
+	};
+
+	typedef ReturnType (*Invoker)(const Storage&, ParamsList...);
+	typedef void (*Manager)(DelegateOperation, Storage&, const Storage&);
+
 public:
 	__forceinline Delegate()
 	{
-		impl = nullptr;
 	}
 
 	// Class method
 	template <class ClassType>
 	__forceinline Delegate(MethodDeclaration<ClassType> m, ClassType* c)
 	{
+		static_assert(sizeof(DelegateMethod<ClassType, MethodDeclaration<ClassType>>) <= sizeof(Storage),
+				"Method pointer doesn't fit in Delegate");
+
 		if (m != NULL)
-			impl = new MethodCaller< MethodDeclaration<ClassType> >(c, m);
-		else
-			impl = nullptr;
+		{
+			auto& stored = *reinterpret_cast<DelegateMethod<ClassType, MethodDeclaration<ClassType>>*>(&storage);
+			stored.object = c;
+			stored.method = m;
+			invoker = &invokeMethod<ClassType>;
+		}
 	}
 
 	// Function
 	__forceinline Delegate(FunctionDeclaration m)
 	{
 		if (m != NULL)
-			impl = new FunctionCaller< FunctionDeclaration, ReturnType, ParamsList... >(m);
-		else
-			impl = nullptr;
+		{
+			*reinterpret_cast<FunctionDeclaration*>(&storage) = m;
+			invoker = &invokeFunction;
+		}
+	}
+
+	// Functor or lambda. Explicit, so overloads taking plain function pointers stay unambiguous.
+	template <class Functor, class = decltype(&Functor::operator())>
+	explicit Delegate(const Functor& f)
+	{
+		assignFunctor(f, DelegateBool<sizeof(Functor) <= sizeof(Storage)
+				&& alignof(Functor) <= alignof(Storage)>());
 	}
 
 	__forceinline ~Delegate()
-    {
-    	if (impl != nullptr)
-    		impl->decrease();
-    }
-
-    __forceinline ReturnType operator()(ParamsList... params) const
-    {
-        return impl->invoke(params...);
-    }
-
-    __forceinline Delegate(Delegate&& that)
-    {
-    	impl = that.impl;
-		that.impl = nullptr;
-	}
-    __forceinline Delegate(const Delegate& that)
-    {
-    	copy(that);
-    }
-    __forceinline Delegate& operator=(const Delegate& that) // copy assignment
-    {
+	{
+		reset();
+	}
+
+	__forceinline ReturnType operator()(ParamsList... params) const
+	{
+		return invoker(storage, params...);
+	}
+
+	__forceinline Delegate(Delegate&& that)
+	{
 		copy(that);
-        return *this;
-    }
-    Delegate& operator=(Delegate&& that) // move assignment
+		that.reset();
+	}
+	__forceinline Delegate(const Delegate& that)
 	{
-    	if (this != &that)
+		copy(that);
+	}
+	__forceinline Delegate& operator=(const Delegate& that) // copy assignment
+	{
+		if (this != &that)
 		{
-			if (impl)
-				impl->decrease();
-
-			impl = that.impl;
-			that.impl = nullptr;
+			reset();
+			copy(that);
+		}
+		return *this;
+	}
+	Delegate& operator=(Delegate&& that) // move assignment
+	{
+		if (this != &that)
+		{
+			reset();
+			copy(that);
+			that.reset();
 		}
 		return *this;
 	}
 
-    // Check for nullptr
-    __forceinline operator bool() const
-    {
-        return impl != nullptr;
-    }
+	// Check for nullptr
+	__forceinline operator bool() const
+	{
+		return invoker != nullptr;
+	}
 
 protected:
-    void copy(const Delegate& other)
+	void copy(const Delegate& other)
+	{
+		invoker = other.invoker;
+		manager = other.manager;
+		if (manager != nullptr)
+			manager(eDO_Copy, storage, other.storage);
+		else
+			storage = other.storage;
+	}
+
+	void reset()
+	{
+		if (manager != nullptr)
+			manager(eDO_Destroy, storage, storage);
+		invoker = nullptr;
+		manager = nullptr;
+	}
+
+private:
+	static ReturnType invokeFunction(const Storage& s, ParamsList... args)
+	{
+		return (*reinterpret_cast<const FunctionDeclaration*>(&s))(args...);
+	}
+
+	template <class ClassType>
+	static ReturnType invokeMethod(const Storage& s, ParamsList... args)
+	{
+		auto& stored = *reinterpret_cast<const DelegateMethod<ClassType, MethodDeclaration<ClassType>>*>(&s);
+		return (stored.object->*stored.method)(args...);
+	}
+
+	// Functor is stored inline
+	template <class Functor>
+	void assignFunctor(const Functor& f, DelegateBool<true>)
+	{
+		new (DelegatePlacement(), &storage) Functor(f);
+		invoker = &invokeInlineFunctor<Functor>;
+		manager = &manageInlineFunctor<Functor>;
+	}
+
+	template <class Functor>
+	static ReturnType invokeInlineFunctor(const Storage& s, ParamsList... args)
+	{
+		return (*const_cast<Functor*>(reinterpret_cast<const Functor*>(&s)))(args...);
+	}
+
+	template <class Functor>
+	static void manageInlineFunctor(DelegateOperation op, Storage& dst, const Storage& src)
+	{
+		if (op == eDO_Copy)
+			new (DelegatePlacement(), &dst) Functor(*reinterpret_cast<const Functor*>(&src));
+		else
+			reinterpret_cast<Functor*>(&dst)->~Functor();
+	}
+
+	// Large functor is shared by copies of delegate
+	template <class Functor>
+	void assignFunctor(const Functor& f, DelegateBool<false>)
+	{
+		*reinterpret_cast<DelegateHeapFunctor<Functor>**>(&storage) = new DelegateHeapFunctor<Functor>(f);
+		invoker = &invokeHeapFunctor<Functor>;
+		manager = &manageHeapFunctor<Functor>;
+	}
+
+	template <class Functor>
+	static ReturnType invokeHeapFunctor(const Storage& s, ParamsList... args)
+	{
+		return (*reinterpret_cast<DelegateHeapFunctor<Functor>* const*>(&s))->functor(args...);
+	}
+
+	template <class Functor>
+	static void manageHeapFunctor(DelegateOperation op, Storage& dst, const Storage& src)
 	{
-		if (impl != other.impl)
+		DelegateHeapFunctor<Functor>* heap = *reinterpret_cast<DelegateHeapFunctor<Functor>* const*>(&src);
+		if (op == eDO_Copy)
 		{
-			if (impl)
-				impl->decrease();
-			impl = other.impl;
-			if (impl)
-				impl->increase();
+			heap->references++;
+			*reinterpret_cast<DelegateHeapFunctor<Functor>**>(&dst) = heap;
 		}
+		else if (--heap->references == 0)
+			delete heap;
 	}
 
 private:
-    IDelegateCaller<ReturnType, ParamsList...>* impl = nullptr;
+	Invoker invoker = nullptr;
+	Manager manager = nullptr;
+	Storage storage;
 };
 
 
@@ -6,8 +6,15 @@
  ****/
 
 #include "FileSystem.h"
+#include "Timer.h"
 #include "../Wiring/WString.h"
 
+static Timer* gcTimer = NULL;
+static int gcReserveBlocks;
+static int gcMinFreePercent;
+static bool gcWritten = false; // File system was changed since last gc tick
+static uint32_t changes = 0;
+
 file_t fileOpen(const String name, FileOpenFlags flags)
 {
   int res;
@@ -19,6 +26,11 @@ file_t fileOpen(const String name, FileOpenFlags flags)
 		  fileDelete(name);
 	  flags = (FileOpenFlags)((int)flags & ~eFO_Truncate);
   }
+  if (flags & (eFO_CreateIfNotExist | eFO_Truncate))
+  {
+	  gcWritten = true;
+	  changes++;
+  }
 
   res = SPIFFS_open(&_filesystemStorageHandle, name.c_str(), (spiffs_flags)flags, 0);
   if (res < 0)
@@ -27,6 +39,23 @@ file_t fileOpen(const String name, FileOpenFlags flags)
   return res;
 }
 
+file_t fileOpen(spiffs_page_ix page, FileOpenFlags flags)
+{
+  if (flags & eFO_Truncate)
+  {
+	  gcWritten = true;
+	  changes++;
+  }
+
+  spiffs_dirent entry;
+  entry.pix = page; // The only field used by SPIFFS
+  int res = SPIFFS_open_by_dirent(&_filesystemStorageHandle, &entry, (spiffs_flags)flags, 0);
+  if (res < 0)
+	  debugf("open errno %d\n", SPIFFS_errno(&_filesystemStorageHandle));
+
+  return res;
+}
+
 void fileClose(file_t file)
 {
   SPIFFS_close(&_filesystemStorageHandle, file);
@@ -34,6 +63,8 @@ void fileClose(file_t file)
 
 size_t fileWrite(file_t file, const void* data, size_t size)
 {
+  gcWritten = true;
+  changes++;
   int res = SPIFFS_write(&_filesystemStorageHandle, file, (void *)data, size);
   if (res < 0)
   {
@@ -86,11 +117,15 @@ int fileStats(file_t file, spiffs_stat *stat)
 
 void fileDelete(const String name)
 {
+	gcWritten = true;
+	changes++;
 	SPIFFS_remove(&_filesystemStorageHandle, name.c_str());
 }
 
 void fileDelete(file_t file)
 {
+	gcWritten = true;
+	changes++;
 	SPIFFS_fremove(&_filesystemStorageHandle, file);
 }
 
@@ -101,6 +136,47 @@ bool fileExist(const String name)
   return stat.name[0] != '\0';
 }
 
+void fileSetMountConfig(int maxOpenFiles, int cachePages)
+{
+  spiffs_set_mount_config(maxOpenFiles, cachePages);
+}
+
+bool fileSystemStats(spiffs_sming_stats* stats)
+{
+  return spiffs_get_stats(stats);
+}
+
+static void fileBackgroundGC()
+{
+  // Don't compete with writer, wait for quiet period
+  if (gcWritten)
+  {
+    gcWritten = false;
+    return;
+  }
+  if (spiffs_gc_background(gcReserveBlocks, gcMinFreePercent))
+    changes++;
+}
+
+void fileStartBackgroundGC(int intervalMs, int reserveBlocks, int minFreePercent)
+{
+  if (gcTimer == NULL)
+    gcTimer = new Timer();
+  gcReserveBlocks = reserveBlocks;
+  gcMinFreePercent = minFreePercent;
+  gcTimer->initializeMs(intervalMs, fileBackgroundGC).start();
+}
+
+void fileStopBackgroundGC()
+{
+  delete gcTimer;
+  gcTimer = NULL;
+}
+
+int fileDataPageSize()
+{
+  return spiffs_get_data_page_size();
+}
 
 int fileLastError(file_t fd)
 {
@@ -136,9 +212,17 @@ uint32_t fileGetSize(const String fileName)
 
 void fileRename(const String oldName, const String newName)
 {
+	gcWritten = true;
+	changes++;
 	SPIFFS_rename(&_filesystemStorageHandle, oldName.c_str(), newName.c_str());
 }
 
+uint32_t fileSystemChanges()
+{
+  // Format and remount also invalidate file pages
+  return changes + spiffs_get_generation();
+}
+
 Vector<String> fileList()
 {
 	Vector<String> result;
@@ -155,6 +239,21 @@ Vector<String> fileList()
 	return result;
 }
 
+bool fileOpenDir(spiffs_DIR* dir)
+{
+	return SPIFFS_opendir(&_filesystemStorageHandle, "/", dir) != NULL;
+}
+
+bool fileReadDir(spiffs_DIR* dir, spiffs_dirent* entry)
+{
+	return SPIFFS_readdir(dir, entry) != NULL;
+}
+
+void fileCloseDir(spiffs_DIR* dir)
+{
+	SPIFFS_closedir(dir);
+}
+
 String fileGetContent(const String fileName)
 {
 	file_t file = fileOpen(fileName.c_str(), eFO_ReadOnly);
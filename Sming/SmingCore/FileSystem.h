@@ -13,6 +13,11 @@
 
 class String;
 
+// Background garbage collection defaults
+#define FILE_GC_INTERVAL			500
+#define FILE_GC_RESERVE_BLOCKS		4 // spiffs collects garbage on write when 3 or less blocks are erased
+#define FILE_GC_MIN_FREE_PERCENT	10
+
 enum FileOpenFlags
 {
   eFO_ReadOnly = SPIFFS_RDONLY,
@@ -21,7 +26,8 @@ enum FileOpenFlags
   eFO_CreateIfNotExist = SPIFFS_CREAT,
   eFO_Append = SPIFFS_APPEND,
   eFO_Truncate = SPIFFS_TRUNC,
-  eFO_CreateNewAlways = eFO_CreateIfNotExist | eFO_Truncate
+  eFO_CreateNewAlways = eFO_CreateIfNotExist | eFO_Truncate,
+  eFO_Sequential = SPIFFS_SEQUENTIAL // Hint: file is read from start to end
 };
 
 static FileOpenFlags operator|(FileOpenFlags lhs, FileOpenFlags rhs)
@@ -37,6 +43,9 @@ typedef enum
 } SeekOriginFlags;
 
 file_t fileOpen(const String name, FileOpenFlags flags);
+// Opens file by index page from directory entry, without name lookup.
+// Page is valid until fileSystemChanges() changes.
+file_t fileOpen(spiffs_page_ix page, FileOpenFlags flags);
 void fileClose(file_t file);
 size_t fileWrite(file_t file, const void* data, size_t size);
 size_t fileRead(file_t file, void* data, size_t size);
@@ -51,6 +60,11 @@ void fileSetContent(const String fileName, const String& content);
 uint32_t fileGetSize(const String fileName);
 void fileRename(const String oldName, const String newName);
 Vector<String> fileList();
+bool fileOpenDir(spiffs_DIR* dir);
+bool fileReadDir(spiffs_DIR* dir, spiffs_dirent* entry);
+void fileCloseDir(spiffs_DIR* dir);
+// Counter of writes, deletes, renames, garbage collection, format and mount, which can move files in flash
+uint32_t fileSystemChanges();
 
 String fileGetContent(const String fileName);
 int fileGetContent(const String fileName, char* buffer, int bufSize);
@@ -62,4 +76,16 @@ void fileDelete(const String name);
 void fileDelete(file_t file);
 bool fileExist(const String name);
 
+// Open files limit and cache size used by next mount, 0 - chosen from free heap
+void fileSetMountConfig(int maxOpenFiles, int cachePages);
+// Buffer sizes, cache hit rate and garbage collection of mounted file system
+bool fileSystemStats(spiffs_sming_stats* stats);
+// Every intervalMs, unless file system was changed in that time, one block of deleted
+// data is reclaimed while fewer than reserveBlocks are erased or free space is low
+void fileStartBackgroundGC(int intervalMs = FILE_GC_INTERVAL, int reserveBlocks = FILE_GC_RESERVE_BLOCKS,
+		int minFreePercent = FILE_GC_MIN_FREE_PERCENT);
+void fileStopBackgroundGC();
+// Bytes of file data stored in one file system page
+int fileDataPageSize();
+
 #endif /* _SMING_CORE_FILESYSTEM_H_ */
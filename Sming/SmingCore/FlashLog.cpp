@@ -0,0 +1,238 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#include "FlashLog.h"
+#include <stddef.h>
+
+#define FLASH_LOG_ALIGN(size) (((size) + INTERNAL_FLASH_WRITE_UNIT_SIZE - 1) & ~(INTERNAL_FLASH_WRITE_UNIT_SIZE - 1))
+
+FlashLog::FlashLog()
+{
+}
+
+FlashLog::~FlashLog()
+{
+	end();
+}
+
+bool FlashLog::begin(uint32_t flashOffset, int sectors)
+{
+	end();
+	if (flashOffset % INTERNAL_FLASH_SECTOR_SIZE != 0 || sectors < 2)
+		return false;
+
+	start = flashOffset;
+	count = sectors;
+	nextSequence = 0; // Continues from records found
+	this->sectors = new FlashLogSector[count];
+	if (this->sectors == NULL)
+		return false;
+
+	// Current sector is the one used last
+	for (int i = 0; i < count; i++)
+	{
+		scanSector(i);
+		if (this->sectors[i].generation > lastGeneration)
+		{
+			lastGeneration = this->sectors[i].generation;
+			current = i;
+		}
+	}
+	debugf("flash log: %d sectors, current %d, next sequence %d", count, current, nextSequence);
+	return true;
+}
+
+void FlashLog::end()
+{
+	delete[] sectors;
+	sectors = NULL;
+	count = 0;
+	current = -1;
+	lastGeneration = 0;
+}
+
+void FlashLog::scanSector(int index)
+{
+	FlashLogSector& sector = sectors[index];
+	memset(&sector, 0, sizeof(sector));
+
+	uint32_t address = sectorAddress(index);
+	FlashLogSectorHeader header;
+	flashmem_read(&header, address, sizeof(header));
+	if (header.magic != FLASH_LOG_MAGIC || header.check != ~header.generation || header.generation == 0)
+		return; // Not used, it's erased before use
+
+	sector.generation = header.generation;
+	sector.minTime = UINT32_MAX;
+	sector.maxTime = 0;
+
+	uint8_t data[FLASH_LOG_MAX_RECORD_SIZE];
+	uint32_t offset = sizeof(header);
+	while (offset + sizeof(FlashLogRecordHeader) <= INTERNAL_FLASH_SECTOR_SIZE)
+	{
+		FlashLogRecordHeader record;
+		flashmem_read(&record, address + offset, sizeof(record));
+		if (record.sequence == UINT32_MAX && record.length == 0xFFFF)
+			break; // Free space
+
+		// Record which was being written when power was lost
+		uint32_t size = FLASH_LOG_ALIGN(sizeof(record) + record.length);
+		if (record.length > FLASH_LOG_MAX_RECORD_SIZE || offset + size > INTERNAL_FLASH_SECTOR_SIZE)
+		{
+			sector.sealed = true;
+			break;
+		}
+		flashmem_read(data, address + offset + sizeof(record), record.length);
+		if (recordCrc(record, data) != record.crc)
+		{
+			sector.sealed = true;
+			break;
+		}
+
+		if (record.timestamp < sector.minTime)
+			sector.minTime = record.timestamp;
+		if (record.timestamp > sector.maxTime)
+			sector.maxTime = record.timestamp;
+		if (record.sequence >= nextSequence)
+			nextSequence = record.sequence + 1;
+		offset += size;
+	}
+	sector.used = offset;
+	if (sector.sealed)
+		debugf("flash log: sector %d sealed at %d", index, offset);
+}
+
+bool FlashLog::openNextSector()
+{
+	int next = (current + 1) % count;
+	if (!flashmem_erase_sector(flashmem_get_sector_of_address(sectorAddress(next))))
+		return false;
+	erasedSectors++;
+
+	FlashLogSectorHeader header = { FLASH_LOG_MAGIC, lastGeneration + 1, ~(lastGeneration + 1) };
+	flashmem_write(&header, sectorAddress(next), sizeof(header));
+	writtenBytes += sizeof(header);
+
+	FlashLogSector& sector = sectors[next];
+	sector.generation = ++lastGeneration;
+	sector.minTime = UINT32_MAX;
+	sector.maxTime = 0;
+	sector.used = sizeof(header);
+	sector.sealed = false;
+	current = next;
+	return true;
+}
+
+bool FlashLog::append(uint32_t timestamp, const void* data, int length)
+{
+	if (sectors == NULL || length < 0 || length > FLASH_LOG_MAX_RECORD_SIZE)
+		return false;
+
+	uint32_t size = FLASH_LOG_ALIGN(sizeof(FlashLogRecordHeader) + length);
+	if (current < 0 || sectors[current].sealed || sectors[current].used + size > INTERNAL_FLASH_SECTOR_SIZE)
+	{
+		if (!openNextSector())
+			return false;
+	}
+
+	// Header and data are written at once, so CRC covers interrupted writes
+	uint32_t buffer[FLASH_LOG_ALIGN(sizeof(FlashLogRecordHeader) + FLASH_LOG_MAX_RECORD_SIZE) / sizeof(uint32_t)];
+	FlashLogRecordHeader* record = (FlashLogRecordHeader*)buffer;
+	uint8_t* recordData = (uint8_t*)(record + 1);
+	record->sequence = nextSequence;
+	record->timestamp = timestamp;
+	record->length = length;
+	memcpy(recordData, data, length);
+	memset(recordData + length, 0xFF, size - sizeof(FlashLogRecordHeader) - length);
+	record->crc = recordCrc(*record, recordData);
+
+	FlashLogSector& sector = sectors[current];
+	if (flashmem_write(buffer, sectorAddress(current) + sector.used, size) != size)
+	{
+		sector.sealed = true;
+		return false;
+	}
+
+	sector.used += size;
+	if (timestamp < sector.minTime)
+		sector.minTime = timestamp;
+	if (timestamp > sector.maxTime)
+		sector.maxTime = timestamp;
+	nextSequence++;
+	writtenBytes += size;
+	payloadBytes += length;
+	return true;
+}
+
+int FlashLog::read(uint32_t from, uint32_t to, FlashLogReadDelegate callback)
+{
+	if (sectors == NULL || current < 0)
+		return 0;
+
+	int found = 0;
+	uint8_t data[FLASH_LOG_MAX_RECORD_SIZE];
+	// Oldest sector follows current one
+	for (int i = 1; i <= count; i++)
+	{
+		int index = (current + i) % count;
+		const FlashLogSector& sector = sectors[index];
+		if (sector.generation == 0 || sector.maxTime < from || sector.minTime > to)
+			continue;
+
+		uint32_t address = sectorAddress(index);
+		uint32_t offset = sizeof(FlashLogSectorHeader);
+		while (offset < sector.used)
+		{
+			FlashLogRecordHeader record;
+			flashmem_read(&record, address + offset, sizeof(record));
+			if (record.timestamp >= from && record.timestamp <= to)
+			{
+				flashmem_read(data, address + offset + sizeof(record), record.length);
+				found++;
+				if (callback && !callback(record.sequence, record.timestamp, data, record.length))
+					return found;
+			}
+			offset += FLASH_LOG_ALIGN(sizeof(record) + record.length);
+		}
+	}
+	return found;
+}
+
+void FlashLog::clear()
+{
+	if (sectors == NULL)
+		return;
+
+	for (int i = 0; i < count; i++)
+	{
+		if (sectors[i].generation == 0)
+			continue;
+		flashmem_erase_sector(flashmem_get_sector_of_address(sectorAddress(i)));
+		erasedSectors++;
+		memset(&sectors[i], 0, sizeof(FlashLogSector));
+	}
+	current = -1;
+	lastGeneration = 0;
+}
+
+uint16_t FlashLog::recordCrc(const FlashLogRecordHeader& header, const uint8_t* data)
+{
+	uint16_t crc = crc16((const uint8_t*)&header, offsetof(FlashLogRecordHeader, crc));
+	return crc16(data, header.length, crc);
+}
+
+// CRC-16/CCITT
+uint16_t FlashLog::crc16(const uint8_t* data, int length, uint16_t crc /* = 0xFFFF */)
+{
+	for (int i = 0; i < length; i++)
+	{
+		crc ^= data[i] << 8;
+		for (int bit = 0; bit < 8; bit++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
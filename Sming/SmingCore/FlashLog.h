@@ -0,0 +1,99 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#ifndef _SMING_CORE_FLASHLOG_H_
+#define _SMING_CORE_FLASHLOG_H_
+
+#include "../SmingCore/Delegate.h"
+#include "../Wiring/WiringFrameworkDependencies.h"
+#include "../system/flashmem.h"
+
+#define FLASH_LOG_MAGIC				0x474F4C46 // "FLOG"
+#define FLASH_LOG_MAX_RECORD_SIZE	256
+
+// Written once when sector is taken into use
+struct FlashLogSectorHeader
+{
+	uint32_t magic;
+	uint32_t generation; // Increases with every used sector, oldest data has lowest
+	uint32_t check; // ~generation
+};
+
+// Record data follows, padded to flash write unit
+struct FlashLogRecordHeader
+{
+	uint32_t sequence;
+	uint32_t timestamp;
+	uint16_t length;
+	uint16_t crc; // Of header fields above and data
+};
+
+// RAM index of one sector
+struct FlashLogSector
+{
+	uint32_t generation; // 0 - not used
+	uint32_t minTime;
+	uint32_t maxTime;
+	uint16_t used; // Bytes from sector start
+	bool sealed; // Broken record found, nothing is appended
+};
+
+// Return false to stop reading
+typedef Delegate<bool(uint32_t sequence, uint32_t timestamp, const uint8_t* data, int length)> FlashLogReadDelegate;
+
+// Append-only record log in raw flash sectors outside of file system.
+// Records are appended to current sector, when it's full the oldest sector is
+// erased and reused. Each record has CRC, so records being written at power loss
+// are detected and skipped on next begin().
+class FlashLog
+{
+public:
+	FlashLog();
+	~FlashLog();
+
+	// Flash area offset and size in sectors, must not overlap file system or firmware.
+	// Existing records are recovered.
+	bool begin(uint32_t flashOffset, int sectors);
+	void end();
+
+	bool append(uint32_t timestamp, const void* data, int length);
+	// Reads records with timestamps in from..to range, oldest first. Returns number of records.
+	int read(uint32_t from, uint32_t to, FlashLogReadDelegate callback);
+	// Erases all records
+	void clear();
+
+	__forceinline uint32_t getNextSequence() { return nextSequence; }
+	__forceinline uint32_t getErasedSectors() { return erasedSectors; }
+	// Write amplification is getWrittenBytes() / getPayloadBytes()
+	__forceinline uint32_t getWrittenBytes() { return writtenBytes; }
+	__forceinline uint32_t getPayloadBytes() { return payloadBytes; }
+
+	static uint16_t crc16(const uint8_t* data, int length, uint16_t crc = 0xFFFF);
+
+private:
+	void scanSector(int index);
+	bool openNextSector();
+	__forceinline uint32_t sectorAddress(int index)
+	{
+		return INTERNAL_FLASH_START_ADDRESS + start + index * INTERNAL_FLASH_SECTOR_SIZE;
+	}
+	static uint16_t recordCrc(const FlashLogRecordHeader& header, const uint8_t* data);
+
+private:
+	uint32_t start = 0;
+	int count = 0;
+	FlashLogSector* sectors = NULL;
+	int current = -1;
+	uint32_t lastGeneration = 0;
+	uint32_t nextSequence = 0;
+
+	uint32_t erasedSectors = 0;
+	uint32_t writtenBytes = 0;
+	uint32_t payloadBytes = 0;
+};
+
+#endif /* _SMING_CORE_FLASHLOG_H_ */
@@ -16,6 +16,7 @@
 FTPServer::FTPServer()
 {
 	setTimeOut(900); // Update timeout
+	reuseClients = false; // Data connection keeps pointer to control connection
 }
 
 FTPServer::~FTPServer()
@@ -0,0 +1,183 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#include "HttpPathRouter.h"
+
+HttpPathNode::HttpPathNode(const char* label, int length)
+{
+	prefix.setString(label, length);
+}
+
+HttpPathNode::~HttpPathNode()
+{
+	while (children != NULL)
+	{
+		HttpPathNode* child = children;
+		children = child->next;
+		delete child;
+	}
+	delete parameter;
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+HttpPathRouter::HttpPathRouter() : root("", 0)
+{
+}
+
+HttpPathRouter::~HttpPathRouter()
+{
+}
+
+void HttpPathRouter::add(const String& path, HttpPathDelegate callback)
+{
+	const char* route = path.c_str();
+	int length = path.length();
+	HttpPathNode* node = &root;
+	int pos = 0;
+
+	while (true)
+	{
+		// Static part up to next ":name" or "*" segment
+		int end = pos;
+		while (end < length && !((route[end] == ':' || route[end] == '*') && end > 0 && route[end - 1] == '/'))
+			end++;
+		node = addStatic(node, route + pos, end - pos);
+
+		if (end == length)
+		{
+			node->handler = callback;
+			return;
+		}
+		if (route[end] == '*')
+		{
+			node->anyHandler = callback;
+			return;
+		}
+
+		// Parameter segment
+		pos = end + 1;
+		end = pos;
+		while (end < length && route[end] != '/')
+			end++;
+		if (node->parameter == NULL)
+		{
+			node->parameter = new HttpPathNode("", 0);
+			node->parameter->parameterName.setString(route + pos, end - pos);
+		}
+		else if ((int)node->parameter->parameterName.length() != end - pos
+				|| memcmp(node->parameter->parameterName.c_str(), route + pos, end - pos) != 0)
+			debugf("Path parameter name conflict: %s", route);
+		node = node->parameter;
+		pos = end;
+	}
+}
+
+HttpPathNode* HttpPathRouter::addStatic(HttpPathNode* node, const char* label, int length)
+{
+	while (length > 0)
+	{
+		HttpPathNode** link = &node->children;
+		while (*link != NULL && (*link)->prefix[0] != label[0])
+			link = &(*link)->next;
+
+		HttpPathNode* child = *link;
+		if (child == NULL)
+		{
+			child = new HttpPathNode(label, length);
+			*link = child;
+			return child;
+		}
+
+		int common = 0;
+		int max = min((int)child->prefix.length(), length);
+		while (common < max && child->prefix[common] == label[common])
+			common++;
+
+		if (common < (int)child->prefix.length())
+		{
+			// Split edge: new node takes common part
+			HttpPathNode* split = new HttpPathNode(label, common);
+			split->next = child->next;
+			child->next = NULL;
+			child->prefix = child->prefix.substring(common);
+			split->children = child;
+			*link = split;
+			child = split;
+		}
+
+		node = child;
+		label += common;
+		length -= common;
+	}
+
+	return node;
+}
+
+const HttpPathDelegate* HttpPathRouter::find(const char* path, int length, HttpPathParameters& params)
+{
+	params.count = 0;
+	return match(&root, path, 0, length, params);
+}
+
+const HttpPathDelegate* HttpPathRouter::match(HttpPathNode* node, const char* path, int pos, int length,
+											HttpPathParameters& params)
+{
+	if (pos == length && node->handler)
+		return &node->handler;
+
+	if (pos < length)
+	{
+		// Exact routes first
+		for (HttpPathNode* child = node->children; child != NULL; child = child->next)
+		{
+			if (child->prefix[0] != path[pos])
+				continue;
+
+			int size = child->prefix.length();
+			if (size <= length - pos && memcmp(child->prefix.c_str(), path + pos, size) == 0)
+			{
+				const HttpPathDelegate* found = match(child, path, pos + size, length, params);
+				if (found != NULL) return found;
+			}
+			break; // Only one edge can start with this char
+		}
+
+		// Then ":name" segment
+		if (node->parameter != NULL && params.count < HTTP_MAX_PATH_PARAMETERS)
+		{
+			int end = pos;
+			while (end < length && path[end] != '/')
+				end++;
+			if (end > pos)
+			{
+				int idx = params.count++;
+				params.names[idx] = node->parameter->parameterName.c_str();
+				params.start[idx] = pos;
+				params.length[idx] = end - pos;
+				const HttpPathDelegate* found = match(node->parameter, path, end, length, params);
+				if (found != NULL) return found;
+				params.count--;
+			}
+		}
+	}
+
+	// And finally "/*" route
+	if (node->anyHandler)
+	{
+		if (params.count < HTTP_MAX_PATH_PARAMETERS)
+		{
+			int idx = params.count++;
+			params.names[idx] = "*";
+			params.start[idx] = pos;
+			params.length[idx] = length - pos;
+		}
+		return &node->anyHandler;
+	}
+
+	return NULL;
+}
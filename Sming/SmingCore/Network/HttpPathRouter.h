@@ -0,0 +1,66 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#ifndef _SMING_CORE_NETWORK_HTTPPATHROUTER_H_
+#define _SMING_CORE_NETWORK_HTTPPATHROUTER_H_
+
+#include "../../Wiring/WString.h"
+#include "../Delegate.h"
+
+#define HTTP_MAX_PATH_PARAMETERS 4
+
+class HttpRequest;
+class HttpResponse;
+
+typedef Delegate<void(HttpRequest&, HttpResponse&)> HttpPathDelegate;
+
+// Path segments captured by ":name" and "*" routes, as offsets into request path
+struct HttpPathParameters
+{
+	uint8_t count = 0;
+	const char* names[HTTP_MAX_PATH_PARAMETERS];
+	uint16_t start[HTTP_MAX_PATH_PARAMETERS];
+	uint16_t length[HTTP_MAX_PATH_PARAMETERS];
+};
+
+class HttpPathNode
+{
+public:
+	HttpPathNode(const char* label, int length);
+	~HttpPathNode();
+
+	String prefix; // Compressed static edge
+	String parameterName; // For ":name" nodes
+	HttpPathNode* children = NULL; // Static edges, unique first chars
+	HttpPathNode* next = NULL;
+	HttpPathNode* parameter = NULL;
+	HttpPathDelegate handler;
+	HttpPathDelegate anyHandler; // "prefix/*" route
+};
+
+// Compressed trie of server paths, supported routes:
+//   "/exact/path"
+//   "/dev/:id/state" - ":id" matches one path segment
+//   "/api/*" - any path with this prefix, rest available as "*" parameter
+class HttpPathRouter
+{
+public:
+	HttpPathRouter();
+	~HttpPathRouter();
+
+	void add(const String& path, HttpPathDelegate callback);
+	const HttpPathDelegate* find(const char* path, int length, HttpPathParameters& params);
+
+private:
+	HttpPathNode* addStatic(HttpPathNode* node, const char* label, int length);
+	const HttpPathDelegate* match(HttpPathNode* node, const char* path, int pos, int length, HttpPathParameters& params);
+
+private:
+	HttpPathNode root;
+};
+
+#endif /* _SMING_CORE_NETWORK_HTTPPATHROUTER_H_ */
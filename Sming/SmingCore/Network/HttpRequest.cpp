@@ -18,7 +18,11 @@ HttpRequest::HttpRequest()
 	requestPostParameters = NULL;
 	cookies = NULL;
 	postDataProcessed = 0;
-	combinePostFrag = false;
+	parserState = eHPS_Method;
+	parsedBytes = 0;
+	bodyOffset = 0;
+	bodyEnd = 0;
+	http11 = true;
 }
 
 HttpRequest::~HttpRequest()
@@ -30,6 +34,25 @@ HttpRequest::~HttpRequest()
 	postDataProcessed = 0;
 }
 
+void HttpRequest::reset()
+{
+	method = "";
+	path = "";
+	if (requestHeaders) requestHeaders->reset();
+	if (requestGetParameters) requestGetParameters->reset();
+	if (cookies) cookies->reset();
+	delete requestPostParameters; // NULL marks first POST data segment
+	requestPostParameters = NULL;
+	pathParameters.count = 0;
+	postDataProcessed = 0;
+	postFragment = "";
+	parserState = eHPS_Method;
+	parsedBytes = 0;
+	bodyOffset = 0;
+	bodyEnd = 0;
+	http11 = true;
+}
+
 String HttpRequest::getQueryParameter(String parameterName, String defaultValue /* = "" */)
 {
 	if (requestGetParameters && requestGetParameters->contains(parameterName))
@@ -61,6 +84,15 @@ String HttpRequest::getCookie(String name, String defaultValue /* = "" */)
 	return defaultValue;
 }
 
+String HttpRequest::getPathParameter(String parameterName, String defaultValue /* = "" */)
+{
+	for (int i = 0; i < pathParameters.count; i++)
+		if (parameterName == pathParameters.names[i])
+			return String(path.c_str() + pathParameters.start[i], pathParameters.length[i]);
+
+	return defaultValue;
+}
+
 int HttpRequest::getContentLength()
 {
 	String len = getHeader("Content-Length");
@@ -74,74 +106,199 @@ String HttpRequest::getContentType()
 	return getHeader("Content-Type");
 }
 
-HttpParseResult HttpRequest::parseHeader(HttpServer *server, pbuf* buf)
+HttpParseResult HttpRequest::parseHeader(HttpServer *server, pbuf* buf, int startPos /* = 0 */)
 {
-	int headerEnd = NetUtils::pbufFindStr(buf, "\r\n\r\n");
-	if (headerEnd == -1) return eHPR_Wait;
-	if (headerEnd > NETWORK_MAX_HTTP_PARSING_LEN)
+	if (parserState == eHPS_Completed) return eHPR_Successful;
+
+	// Single pass over new data only, parser state is kept between segments
+	int ofs = 0;
+	for (pbuf* cur = buf; cur != NULL; cur = cur->next)
 	{
-		debugf("NETWORK_MAX_HTTP_PARSING_LEN");
-		return eHPR_Failed;
+		const char* data = (const char*)cur->payload;
+		int len = cur->len;
+		if (startPos >= ofs + len)
+		{
+			ofs += len;
+			continue;
+		}
+		int first = max(startPos - ofs, 0);
+		int i = first;
+		while (i < len)
+		{
+			int start = i;
+			switch (parserState)
+			{
+			case eHPS_Method:
+				while (i < len && data[i] != ' ') i++;
+				if (method.length() == 0)
+				{
+					// Skip leading empty lines
+					while (start < i && (data[start] == '\r' || data[start] == '\n')) start++;
+				}
+				method.concat(data + start, i - start);
+				if (i < len)
+				{
+					parserState = eHPS_Url;
+					i++;
+				}
+				break;
+
+			case eHPS_Url:
+				while (i < len && data[i] != ' ' && data[i] != '\n') i++;
+				path.concat(data + start, i - start);
+				if (i < len)
+				{
+					if (data[i] == '\n')
+					{
+						debugf("!BadRequest");
+						return eHPR_Failed;
+					}
+					processUrl();
+					headerValue = "";
+					parserState = eHPS_Version;
+					i++;
+				}
+				break;
+
+			case eHPS_Version:
+				while (i < len && data[i] != '\n') i++;
+				headerValue.concat(data + start, i - start);
+				if (i < len)
+				{
+					headerValue.trim();
+					http11 = headerValue != "HTTP/1.0";
+					parserState = eHPS_HeaderLine;
+					i++;
+				}
+				break;
+
+			case eHPS_SkipLine:
+				while (i < len && data[i] != '\n') i++;
+				if (i < len)
+				{
+					parserState = eHPS_HeaderLine;
+					i++;
+				}
+				break;
+
+			case eHPS_HeaderLine:
+				if (data[i] == '\r')
+					i++;
+				else if (data[i] == '\n')
+				{
+					// Empty line, header completed
+					parserState = eHPS_Completed;
+					parsedBytes += i + 1 - first;
+					bodyOffset = ofs + i + 1;
+					debugf("parsed");
+					return eHPR_Successful;
+				}
+				else
+				{
+					headerName = "";
+					parserState = eHPS_HeaderName;
+				}
+				break;
+
+			case eHPS_HeaderName:
+				while (i < len && data[i] != ':' && data[i] != '\n') i++;
+				if (i == len)
+				{
+					// Name continues in next segment
+					headerName.concat(data + start, i - start);
+					break;
+				}
+				if (data[i] == '\n')
+				{
+					// Not a header line
+					parserState = eHPS_HeaderLine;
+					i++;
+					break;
+				}
+
+				bool enabled;
+				if (headerName.length() == 0)
+				{
+					// Whole name is inside this segment: check it in place
+					enabled = server->isHeaderProcessingEnabled(data + start, i - start);
+					if (enabled) headerName.setString(data + start, i - start);
+				}
+				else
+				{
+					headerName.concat(data + start, i - start);
+					enabled = server->isHeaderProcessingEnabled(headerName);
+				}
+
+				if (enabled)
+				{
+					headerValue = "";
+					parserState = eHPS_HeaderValueStart;
+				}
+				else
+					parserState = eHPS_SkipLine;
+				i++;
+				break;
+
+			case eHPS_HeaderValueStart:
+				while (i < len && (data[i] == ' ' || data[i] == '\t')) i++;
+				if (i < len) parserState = eHPS_HeaderValue;
+				break;
+
+			case eHPS_HeaderValue:
+				while (i < len && data[i] != '\n') i++;
+				headerValue.concat(data + start, i - start);
+				if (i < len)
+				{
+					processHeader();
+					parserState = eHPS_HeaderLine;
+					i++;
+				}
+				break;
+
+			default:
+				return eHPR_Failed;
+			}
+		}
+		ofs += len;
+		parsedBytes += len - first;
 	}
 
-	int urlStart = NetUtils::pbufFindChar(buf, ' ') + 1;
-	int urlEnd = NetUtils::pbufFindChar(buf, ' ', urlStart);
-	if (urlStart == 0 || urlEnd == -1)
+	if (parsedBytes > NETWORK_MAX_HTTP_PARSING_LEN)
 	{
-		debugf("!BadRequest");
+		debugf("NETWORK_MAX_HTTP_PARSING_LEN");
 		return eHPR_Failed;
 	}
-	method = NetUtils::pbufStrCopy(buf, 0, urlStart - 1);
 
-	int urlParamsStart = NetUtils::pbufFindChar(buf, '?', urlStart);
-	if (urlParamsStart != -1 && urlParamsStart < urlEnd)
+	return eHPR_Wait;
+}
+
+void HttpRequest::processUrl()
+{
+	int urlParamsStart = path.indexOf('?');
+	if (urlParamsStart != -1)
 	{
-		path = NetUtils::pbufStrCopy(buf, urlStart, urlParamsStart - urlStart);
 		if (requestGetParameters == NULL) requestGetParameters = new HashMap<String, String>();
-		extractParsingItemsList(buf, urlParamsStart + 1, urlEnd, '&', ' ', requestGetParameters);
+		extractParsingItemsList(path.c_str() + urlParamsStart + 1, path.length() - urlParamsStart - 1,
+				'&', requestGetParameters);
+		path.remove(urlParamsStart);
 	}
-	else
-		path = NetUtils::pbufStrCopy(buf, urlStart, urlEnd - urlStart);
 	debugf("path=%s", path.c_str());
+}
 
-	int line, nextLine;
-	line = NetUtils::pbufFindStr(buf, "\r\n", urlEnd)  + 2;
-	do
+void HttpRequest::processHeader()
+{
+	headerValue.trim();
+	if (headerName == "Cookie")
 	{
-		nextLine = NetUtils::pbufFindStr(buf, "\r\n", line);
-		if (nextLine - line > 2)
-		{
-			int delim = NetUtils::pbufFindStr(buf, ":", line);
-			if (delim != -1)
-			{
-				String name = NetUtils::pbufStrCopy(buf, line, delim - line);
-				if (server->isHeaderProcessingEnabled(name))
-				{
-					if (name == "Cookie")
-					{
-						if (cookies == NULL) cookies = new HashMap<String, String>();
-						extractParsingItemsList(buf, delim + 1, nextLine, ';', '\r', cookies);
-					}
-					else
-					{
-						String value = NetUtils::pbufStrCopy(buf, delim + 1, nextLine - (delim + 1));
-						value.trim();
-						if (requestHeaders == NULL) requestHeaders = new HashMap<String, String>();
-						(*requestHeaders)[name] = value;
-						debugf("%s === %s", name.c_str(), value.c_str());
-					}
-				}
-			}
-		}
-		line = nextLine + 2;
-	} while(nextLine != -1);
-
-	if (headerEnd != -1)
+		if (cookies == NULL) cookies = new HashMap<String, String>();
+		extractParsingItemsList(headerValue.c_str(), headerValue.length(), ';', cookies);
+	}
+	else
 	{
-		debugf("parsed");
-		return eHPR_Successful;
+		if (requestHeaders == NULL) requestHeaders = new HashMap<String, String>();
+		(*requestHeaders)[headerName] = headerValue;
+		debugf("%s === %s", headerName.c_str(), headerValue.c_str());
 	}
-	return eHPR_Wait;
 }
 
 HttpParseResult HttpRequest::parsePostData(HttpServer *server, pbuf* buf)
@@ -151,83 +308,61 @@ HttpParseResult HttpRequest::parsePostData(HttpServer *server, pbuf* buf)
 	// First enter
 	if (requestPostParameters == NULL)
 	{
-		int headerEnd = NetUtils::pbufFindStr(buf, "\r\n\r\n");
-		if (headerEnd == -1) return eHPR_Failed;
-		if (headerEnd + getContentLength() > NETWORK_MAX_HTTP_PARSING_LEN)
+		if (parserState != eHPS_Completed) return eHPR_Failed;
+		if (parsedBytes + getContentLength() > NETWORK_MAX_HTTP_PARSING_LEN)
 		{
 			debugf("NETWORK_MAX_HTTP_PARSING_LEN");
 			return eHPR_Failed;
 		}
 		requestPostParameters = new HashMap<String, String>();
-		start = headerEnd + 4;
-		combinePostFrag = false;
+		start = bodyOffset;
+		postFragment = "";
 	}
-	else if (combinePostFrag)
+
+	// Data after the body belongs to next pipelined request
+	int end = start + getContentLength() - postDataProcessed;
+	if (end > buf->tot_len)
+		end = buf->tot_len;
+	bodyEnd = end;
+
+	// Item split between segments is kept until it is complete
+	postFragment += NetUtils::pbufStrCopy(buf, start, end - start);
+	postDataProcessed += end - start;
+	bool finished = postDataProcessed >= getContentLength();
+	int length = finished ? postFragment.length() : postFragment.lastIndexOf('&') + 1;
+	if (length > 0)
 	{
-		String cur = requestPostParameters->keyAt(requestPostParameters->count() - 1);
-		debugf("Continue POST frag %s", cur.c_str());
-		int delimItem = NetUtils::pbufFindChar(buf, '&', 0);
-		if (delimItem == -1)
-			delimItem = buf->tot_len;
-		else
-			combinePostFrag = false;
-		String itemValue = NetUtils::pbufStrCopy(buf, 0, delimItem);
-		//debugf("Continue POST len %d", itemValue.length());
-		char* buf = uri_unescape(NULL, 0, itemValue.c_str(), -1);
-		itemValue = buf;
-		free(buf);
-		(*requestPostParameters)[cur] += itemValue;
-		start = delimItem + 1;
-		postDataProcessed += start;
+		extractParsingItemsList(postFragment.c_str(), length, '&', requestPostParameters);
+		postFragment.remove(0, length);
 	}
 
-	bool notFinished = extractParsingItemsList(buf, start, buf->tot_len, '&', ' ', requestPostParameters);
-	if (notFinished)
-		combinePostFrag = true; // continue reading this parameter value
-	//TODO: continue for param name
-	postDataProcessed += buf->tot_len - start;
-
-	if (postDataProcessed == getContentLength())
-		return eHPR_Successful;
-	else
-		return eHPR_Wait;
+	return finished ? eHPR_Successful : eHPR_Wait;
 }
 
-bool HttpRequest::extractParsingItemsList(pbuf* buf, int startPos, int endPos, char delimChar, char endChar,
+void HttpRequest::extractParsingItemsList(const char* data, int length, char delimChar,
 													HashMap<String, String>* resultItems)
 {
-	bool continued = false;
-	int delimItem, nextItem, startItem = startPos;
-	while (startItem < endPos)
+	const char* end = data + length;
+	while (data < end)
 	{
-		delimItem = NetUtils::pbufFindStr(buf, "=", startItem);
-		if (delimItem == -1 || delimItem > endPos) break;
-		nextItem = NetUtils::pbufFindChar(buf, delimChar, delimItem + 1);
-		if (nextItem == -1)
-			nextItem = NetUtils::pbufFindChar(buf, endChar, delimItem + 1);
-		if (nextItem > endPos) break;
-
-		if (nextItem == -1)
+		const char* nextItem = (const char*)memchr(data, delimChar, end - data);
+		if (nextItem == NULL) nextItem = end;
+		const char* delimItem = (const char*)memchr(data, '=', nextItem - data);
+		if (delimItem != NULL)
 		{
-			nextItem = endPos;
-			continued = true;
+			char* nam = uri_unescape(NULL, 0, data, delimItem - data);
+			String ItemName = nam;
+			free(nam);
+			char* val = uri_unescape(NULL, 0, delimItem + 1, nextItem - delimItem - 1);
+			String ItemValue = val;
+			free(val);
+			ItemName.trim();
+			ItemValue.trim();
+			debugf("Item: %s = %s", ItemName.c_str(), ItemValue.c_str());
+			(*resultItems)[ItemName] = ItemValue;
 		}
-
-		String ItemName = NetUtils::pbufStrCopy(buf, startItem, delimItem - startItem);
-		String ItemValue = NetUtils::pbufStrCopy(buf, delimItem + 1, nextItem - delimItem - 1);
-		char* nam = uri_unescape(NULL, 0, ItemName.c_str(), -1);
-		ItemName = nam;
-		free(nam);
-		char* val = uri_unescape(NULL, 0, ItemValue.c_str(), -1);
-		ItemValue = val;
-		free(val);
-		ItemName.trim();
-		if (!continued) ItemValue.trim();
-		debugf("Item: %s = %s", ItemName.c_str(), ItemValue.c_str());
-		(*resultItems)[ItemName] = ItemValue;
-		startItem = nextItem + 1;
+		data = nextItem + 1;
 	}
-	return continued;
 }
 
 bool HttpRequest::isAjax()
@@ -236,6 +371,16 @@ bool HttpRequest::isAjax()
 	return req.equalsIgnoreCase("xmlhttprequest");
 }
 
+bool HttpRequest::isKeepAlive()
+{
+	String req = getHeader("Connection");
+	req.toLowerCase();
+	if (req.indexOf("close") != -1) return false;
+	if (req.indexOf("keep-alive") != -1) return true;
+
+	return http11; // Persistent by default since HTTP/1.1
+}
+
 bool HttpRequest::isWebSocket()
 {
 	String req = getHeader("Upgrade");
@@ -12,6 +12,7 @@
 
 #include "../Wiring/WHashMap.h"
 #include "../Wiring/WString.h"
+#include "HttpPathRouter.h"
 
 class pbuf;
 class HttpServer;
@@ -24,32 +25,55 @@ enum HttpParseResult
 	eHPR_Failed
 };
 
+// Incremental header parser position, kept between received segments
+enum HttpParserState
+{
+	eHPS_Method = 0,
+	eHPS_Url,
+	eHPS_Version,
+	eHPS_HeaderLine,
+	eHPS_HeaderName,
+	eHPS_HeaderValueStart,
+	eHPS_HeaderValue,
+	eHPS_SkipLine,
+	eHPS_Completed
+};
+
 class HttpRequest
 {
 public:
 	HttpRequest();
 	virtual ~HttpRequest();
 
+	// Prepare for next request on the same connection
+	void reset();
+
 	inline String getRequestMethod() { return method; }
-	inline String getPath() { return path; }
+	inline const String& getPath() { return path; }
 	String getContentType();
 	int getContentLength();
 
 	bool isAjax();
 	bool isWebSocket();
+	bool isKeepAlive();
 
 	String getQueryParameter(String parameterName, String defaultValue = "");
 	String getPostParameter(String parameterName, String defaultValue = "");
 	String getHeader(String headerName, String defaultValue = "");
 	String getCookie(String cookieName, String defaultValue = "");
+	// Path segment captured by ":name" or "*" server route
+	String getPathParameter(String parameterName, String defaultValue = "");
 
 public:
-	HttpParseResult parseHeader(HttpServer *server, pbuf* buf);
+	HttpParseResult parseHeader(HttpServer *server, pbuf* buf, int startPos = 0);
 	HttpParseResult parsePostData(HttpServer *server, pbuf* buf);
-	bool extractParsingItemsList(pbuf* buf, int startPos, int endPos,
-			char delimChar, char endChar,
+	void extractParsingItemsList(const char* data, int length, char delimChar,
 			HashMap<String, String> *resultItems);
 
+private:
+	void processUrl();
+	void processHeader();
+
 private:
 	String method;
 	String path;
@@ -57,10 +81,21 @@ private:
 	HashMap<String, String> *requestGetParameters;
 	HashMap<String, String> *requestPostParameters;
 	HashMap<String, String> *cookies;
+	HttpPathParameters pathParameters;
 	int postDataProcessed;
-	bool combinePostFrag;
+	String postFragment; // Unfinished item of POST data
+
+	HttpParserState parserState;
+	int parsedBytes;
+	int bodyOffset; // Start of body data in the segment which completed header
+	int bodyEnd; // End of POST data in the last parsed segment
+	String headerName;
+	String headerValue;
+	bool http11;
 
 	friend class TemplateFileStream;
+	friend class HttpServerConnection;
+	friend class HttpServer;
 };
 
 #endif /* _SMING_CORE_NETWORK_HTTPREQUEST_H_ */
@@ -10,11 +10,52 @@
 #include "HttpServerConnection.h"
 #include "../DataSourceStream.h"
 
+struct HttpStatusLine
+{
+	const char* text;
+	uint8_t length;
+};
+
+struct HttpHeaderName
+{
+	const char* name;
+	uint8_t length;
+};
+
+// Complete status lines, text after protocol matches HttpStatusCode
+#define HTTP_STATUS_LINE(code) { "HTTP/1.1 " code "\r\n", sizeof("HTTP/1.1 " code "\r\n") - 1 }
+#define HTTP_STATUS_TEXT_OFFSET 9
+
+static const HttpStatusLine statusOK = HTTP_STATUS_LINE("200 OK");
+static const HttpStatusLine statusSwitchingProtocols = HTTP_STATUS_LINE("101 Switching Protocols");
+static const HttpStatusLine statusFound = HTTP_STATUS_LINE("302 Found");
+static const HttpStatusLine statusNotModified = HTTP_STATUS_LINE("304 Not Modified");
+static const HttpStatusLine statusBadRequest = HTTP_STATUS_LINE("400 Bad Request");
+static const HttpStatusLine statusNotFound = HTTP_STATUS_LINE("404 Not Found");
+static const HttpStatusLine statusForbidden = HTTP_STATUS_LINE("403 Forbidden");
+static const HttpStatusLine statusUnauthorized = HTTP_STATUS_LINE("401 Unauthorized");
+
+#define HTTP_HEADER_NAME(name) { name, sizeof(name) - 1 }
+
+// In HttpResponseHeader order
+static const HttpHeaderName commonHeaderNames[HTTP_RESPONSE_COMMON_HEADERS] =
+{
+	HTTP_HEADER_NAME("Content-Type"),
+	HTTP_HEADER_NAME("Content-Length"),
+	HTTP_HEADER_NAME("Content-Encoding"),
+	HTTP_HEADER_NAME("Connection"),
+	HTTP_HEADER_NAME("Cache-Control"),
+	HTTP_HEADER_NAME("Location"),
+	HTTP_HEADER_NAME("Upgrade"),
+	HTTP_HEADER_NAME("ETag")
+};
+
 HttpResponse::HttpResponse()
 {
-	status = HttpStatusCode::OK;
+	status = &statusOK;
 	stream = NULL;
 	headerSent = false;
+	headerWritten = 0;
 	bodySent = false;
 }
 
@@ -25,43 +66,57 @@ HttpResponse::~HttpResponse()
 	stream = NULL;
 }
 
+void HttpResponse::reset()
+{
+	status = &statusOK;
+	delete stream;
+	stream = NULL;
+	headerSent = false;
+	headerWritten = 0;
+	bodySent = false;
+	commonHeadersSet = 0; // Values keep their buffers for next response
+	responseHeaders.reset();
+}
+
 void HttpResponse::switchingProtocols()
 {
-	status = HttpStatusCode::SwitchingProtocols;
+	status = &statusSwitchingProtocols;
 }
 void HttpResponse::badRequest()
 {
-	status = HttpStatusCode::BadRequest;
+	status = &statusBadRequest;
 }
 void HttpResponse::notFound()
 {
-	status = HttpStatusCode::NotFound;
+	status = &statusNotFound;
 }
 void HttpResponse::forbidden()
 {
-	status = HttpStatusCode::Forbidden;
+	status = &statusForbidden;
 }
 void HttpResponse::authorizationRequired()
 {
-	status = HttpStatusCode::Unauthorized;
+	status = &statusUnauthorized;
 }
 void HttpResponse::redirect(String location /* = "" */)
 {
-	status = HttpStatusCode::Found;
-	setHeader("Location", location);
+	status = &statusFound;
+	setHeader(eHRH_Location, location);
+}
+
+void HttpResponse::notModified()
+{
+	status = &statusNotModified;
 }
 
 String HttpResponse::getStatusName()
 {
-	return status;
+	return String(status->text + HTTP_STATUS_TEXT_OFFSET, status->length - HTTP_STATUS_TEXT_OFFSET - 2);
 }
 
 int HttpResponse::getStatusCode()
 {
-	int p = status.indexOf(' ');
-	if (status.length() == 0 || p == -1) return 0;
-
-	return status.substring(0, p).toInt();
+	return atoi(status->text + HTTP_STATUS_TEXT_OFFSET);
 }
 
 bool HttpResponse::hasBody()
@@ -69,11 +124,17 @@ bool HttpResponse::hasBody()
 	return stream != NULL || bodySent;
 }
 
+int HttpResponse::getContentLength()
+{
+	if (stream == NULL) return 0;
+	return stream->available();
+}
+
 ///
 
 void HttpResponse::setContentType(const String type)
 {
-	setHeader("Content-Type", type);
+	setHeader(eHRH_ContentType, type);
 }
 
 void HttpResponse::setCookie(const String name, const String value)
@@ -84,7 +145,7 @@ void HttpResponse::setCookie(const String name, const String value)
 void HttpResponse::setCache(int maxAgeSeconds, bool isPublic /* = false */)
 {
 	String chache = String(isPublic ? "public" : "private") +", max-age=" + String(maxAgeSeconds) + ", must-revalidate";
-	setHeader("Cache-Control", chache);
+	setHeader(eHRH_CacheControl, chache);
 }
 
 void HttpResponse::setAllowCrossDomainOrigin(String controlAllowOrigin)
@@ -94,14 +155,43 @@ void HttpResponse::setAllowCrossDomainOrigin(String controlAllowOrigin)
 
 void HttpResponse::setHeader(const String name, const String value)
 {
-	responseHeaders[name] = value;
+	int common = findCommonHeader(name);
+	if (common >= 0)
+		setHeader((HttpResponseHeader)common, value);
+	else
+		responseHeaders[name] = value;
+}
+
+void HttpResponse::setHeader(HttpResponseHeader header, const String value)
+{
+	commonHeaders[header] = value;
+	commonHeadersSet |= 1 << header;
 }
 
 bool HttpResponse::hasHeader(const String name)
 {
+	int common = findCommonHeader(name);
+	if (common >= 0)
+		return hasHeader((HttpResponseHeader)common);
 	return responseHeaders.contains(name);
 }
 
+bool HttpResponse::hasHeader(HttpResponseHeader header)
+{
+	return (commonHeadersSet & (1 << header)) != 0;
+}
+
+int HttpResponse::findCommonHeader(const String& name)
+{
+	for (int i = 0; i < HTTP_RESPONSE_COMMON_HEADERS; i++)
+	{
+		const HttpHeaderName& common = commonHeaderNames[i];
+		if (name.length() == common.length && strcasecmp(name.c_str(), common.name) == 0)
+			return i;
+	}
+	return -1;
+}
+
 ///
 
 void HttpResponse::sendString(const char* string)
@@ -134,25 +224,25 @@ bool HttpResponse::sendFile(String fileName, bool allowGzipFileCheck /* = true*/
 		stream = NULL;
 	}
 
-	String compressed = fileName + ".gz";
-	if (allowGzipFileCheck && fileExist(compressed))
+	// Opening is the lookup, file isn't searched for once more before
+	file_t file = -1;
+	if (allowGzipFileCheck)
 	{
-		debugf("found %s", compressed.c_str());
-		stream = new FileStream(compressed);
-		setHeader("Content-Encoding", "gzip");
+		file = fileOpen(fileName + ".gz", eFO_ReadOnly | eFO_Sequential);
+		if (file >= 0)
+			setHeader(eHRH_ContentEncoding, "gzip");
 	}
-	else if (fileExist(fileName))
-	{
-		debugf("found %s", fileName.c_str());
-		stream = new FileStream(fileName);
-	}
-	else
+	if (file < 0)
+		file = fileOpen(fileName, eFO_ReadOnly | eFO_Sequential);
+	if (file < 0)
 	{
 		notFound();
 		return false;
 	}
+	debugf("found %s", fileName.c_str());
+	stream = new FileStream(file);
 
-	if (!hasHeader("Content-Type"))
+	if (!hasHeader(eHRH_ContentType))
 	{
 		const char *mime = ContentType::fromFullFileName(fileName);
 		if (mime != NULL)
@@ -179,7 +269,7 @@ bool HttpResponse::sendTemplate(TemplateFileStream* newTemplateInstance)
 		return false;
 	}
 
-	if (!hasHeader("Content-Type"))
+	if (!hasHeader(eHRH_ContentType))
 	{
 		const char *mime = ContentType::fromFullFileName(newTemplateInstance->fileName());
 		if (mime != NULL)
@@ -198,29 +288,106 @@ bool HttpResponse::sendJsonObject(JsonObjectStream* newJsonStreamInstance)
 	}
 
 	stream = newJsonStreamInstance;
-	if (!hasHeader("Content-Type"))
+	if (!hasHeader(eHRH_ContentType))
 		setContentType(ContentType::JSON);
 }
+
+void HttpResponse::sendDataStream(IDataSourceStream* newDataStream)
+{
+	if (stream != NULL)
+	{
+		SYSTEM_ERROR("Stream already created");
+		delete stream;
+	}
+	stream = newDataStream;
+}
 ///
 
-void HttpResponse::sendHeader(HttpServerConnection &connection)
+static char* appendHeader(char* pos, const char* name, int nameLength, const String& value)
 {
-	if (headerSent) return;
+	memcpy(pos, name, nameLength);
+	pos += nameLength;
+	*pos++ = ':';
+	*pos++ = ' ';
+	memcpy(pos, value.c_str(), value.length());
+	pos += value.length();
+	*pos++ = '\r';
+	*pos++ = '\n';
+	return pos;
+}
 
-	String top = "HTTP/1.1 " + status + "\r\n";
-	connection.writeString(top.c_str(), TCP_WRITE_FLAG_MORE | TCP_WRITE_FLAG_COPY);
+int HttpResponse::getHeaderLength()
+{
+	int length = status->length + 2;
+	for (int i = 0; i < HTTP_RESPONSE_COMMON_HEADERS; i++)
+	{
+		if (commonHeadersSet & (1 << i))
+			length += commonHeaderNames[i].length + commonHeaders[i].length() + 4;
+	}
 	for (int i = 0; i < responseHeaders.count(); i++)
+		length += responseHeaders.keyAt(i).length() + responseHeaders.valueAt(i).length() + 4;
+	return length;
+}
+
+bool HttpResponse::sendHeader(HttpServerConnection &connection)
+{
+	if (headerSent) return true;
+
+	// Header is written at once, followed by start of body in the same segment.
+	// tcp_write copies data, so buffer is shared by all responses instead of taking stack.
+	static char shared[NETWORK_SEND_BUFFER_SIZE];
+	int length = getHeaderLength();
+	char* buffer = length <= NETWORK_SEND_BUFFER_SIZE ? shared : new char[length];
+	if (buffer == NULL) return false;
+
+	char* pos = buffer;
+	memcpy(pos, status->text, status->length);
+	pos += status->length;
+	for (int i = 0; i < HTTP_RESPONSE_COMMON_HEADERS; i++)
+	{
+		if (commonHeadersSet & (1 << i))
+			pos = appendHeader(pos, commonHeaderNames[i].name, commonHeaderNames[i].length, commonHeaders[i]);
+	}
+	for (int i = 0; i < responseHeaders.count(); i++)
+	{
+		const String& name = responseHeaders.keyAt(i);
+		pos = appendHeader(pos, name.c_str(), name.length(), responseHeaders.valueAt(i));
+	}
+	*pos++ = '\r';
+	*pos++ = '\n';
+
+	// Header larger than free space in send buffer is written in parts
+	int part = min((int)connection.getAvailableWriteSize(), length - headerWritten);
+	int read = 0;
+	if (buffer == shared && stream != NULL && headerWritten + part == length)
+	{
+		// Body is read ahead, stream is moved only after it was written
+		int room = min(connection.getStreamWriteSize() - part, NETWORK_SEND_BUFFER_SIZE - length);
+		if (room > 0)
+			read = stream->readMemoryBlock(pos, room);
+	}
+
+	int written = part > 0 ? connection.write(buffer + headerWritten, part + read, TCP_WRITE_FLAG_COPY | (stream != NULL ? TCP_WRITE_FLAG_MORE : 0)) : -1;
+	if (buffer != shared)
+		delete[] buffer;
+	if (written <= 0)
+		return false;
+
+	int body = max(written - part, 0);
+	headerWritten += written - body;
+	if (body > 0)
 	{
-		String write = responseHeaders.keyAt(i) + ": " + responseHeaders.valueAt(i) + "\r\n";
-		connection.writeString(write.c_str(), TCP_WRITE_FLAG_MORE | TCP_WRITE_FLAG_COPY);
+		stream->seek(body);
+		connection.spendSendBudget(body);
 	}
-	connection.writeString("\r\n");
-	headerSent = true;
+	headerSent = headerWritten == length;
+	return headerSent;
 }
 
 bool HttpResponse::sendBody(HttpServerConnection &connection)
 {
-	if (!headerSent) sendHeader(connection);
+	// Body can't be written until whole header is
+	if (!sendHeader(connection)) return false;
 	if (stream == NULL) return true;
 
 	connection.write(stream);
@@ -230,7 +397,7 @@ bool HttpResponse::sendBody(HttpServerConnection &connection)
 		connection.flush();
 		bodySent = true;
 		debugf("Stream completed");
-		delete stream; // Free memory now!
+		connection.freeStream(stream); // Free memory now or after acknowledge
 		stream = NULL;
 		return true;
 	}
@@ -16,6 +16,22 @@
 class pbuf;
 class HttpServer;
 class HttpServerConnection;
+struct HttpStatusLine;
+
+// Common headers are kept in fixed slots, their names aren't stored per response
+enum HttpResponseHeader
+{
+	eHRH_ContentType = 0,
+	eHRH_ContentLength,
+	eHRH_ContentEncoding,
+	eHRH_Connection,
+	eHRH_CacheControl,
+	eHRH_Location,
+	eHRH_Upgrade,
+	eHRH_ETag
+};
+
+#define HTTP_RESPONSE_COMMON_HEADERS 8
 
 class HttpResponse
 {
@@ -23,17 +39,23 @@ public:
 	HttpResponse();
 	virtual ~HttpResponse();
 
+	// Prepare for next response on the same connection
+	void reset();
+
 	void switchingProtocols();
 	void badRequest();
 	void notFound();
 	void forbidden();
 	void authorizationRequired();
 	void redirect(String location = "");
+	void notModified();
 
 	void setContentType(const String type);
 	void setCookie(const String name, const String value);
 	void setHeader(const String name, const String value);
+	void setHeader(HttpResponseHeader header, const String value);
 	bool hasHeader(const String name);
+	bool hasHeader(HttpResponseHeader header);
 
 	void setCache(int maxAgeSeconds = 3600, bool isPublic = false);
 	void setAllowCrossDomainOrigin(String controlAllowOrigin); // Access-Control-Allow-Origin for AJAX from a different domain
@@ -41,6 +63,7 @@ public:
 	String getStatusName();
 	int getStatusCode();
 	bool hasBody();
+	int getContentLength(); // -1 if unknown
 
 	//*** This methods processed in background
 
@@ -56,16 +79,27 @@ public:
 
 	// Build and send JSON string
 	bool sendJsonObject(JsonObjectStream* newJsonStreamInstance);
+
+	// Send any stream, it's deleted by response
+	void sendDataStream(IDataSourceStream* newDataStream);
 	//***
 
 public:
-	void sendHeader(HttpServerConnection &connection);
+	// Returns true when whole header is written
+	bool sendHeader(HttpServerConnection &connection);
 	bool sendBody(HttpServerConnection &connection);
 
+private:
+	int findCommonHeader(const String& name);
+	int getHeaderLength();
+
 private:
 	bool headerSent;
+	uint16_t headerWritten; // Part of header already written
 	bool bodySent;
-	String status;
+	const HttpStatusLine* status;
+	String commonHeaders[HTTP_RESPONSE_COMMON_HEADERS];
+	uint8_t commonHeadersSet = 0; // Bit for each used slot
 	HashMap<String, String> responseHeaders;
 
 	IDataSourceStream* stream;
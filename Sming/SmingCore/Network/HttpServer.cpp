@@ -10,6 +10,7 @@
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "HttpServerConnection.h"
+#include "HttpStaticFiles.h"
 #include "TcpClient.h"
 #include "../Wiring/WString.h"
 #include "../../Services/cWebsocket/websocket.h"
@@ -25,6 +26,7 @@ HttpServer::HttpServer()
 	enableHeaderProcessing("Host");
 	enableHeaderProcessing("Content-Type");
 	enableHeaderProcessing("Content-Length");
+	enableHeaderProcessing("Connection");
 
 	enableHeaderProcessing("Upgrade");
 }
@@ -39,6 +41,12 @@ TcpConnection* HttpServer::createClient(tcp_pcb *clientTcp)
 	return con;
 }
 
+void HttpServer::onClient(TcpClient *client)
+{
+	newConnections++;
+	TcpServer::onClient(client);
+}
+
 void HttpServer::enableHeaderProcessing(String headerName)
 {
 	for (int i = 0; i < processingHeaders.count(); i++)
@@ -55,7 +63,7 @@ void HttpServer::addPath(String path, HttpPathDelegate callback)
 	if (!path.startsWith("/"))
 		path = "/" + path;
 	debugf("'%s' registered", path.c_str());
-	paths[path] = callback;
+	paths.add(path, callback);
 }
 
 void HttpServer::setDefaultHandler(HttpPathDelegate callback)
@@ -63,6 +71,27 @@ void HttpServer::setDefaultHandler(HttpPathDelegate callback)
 	defaultHandler = callback;
 }
 
+void HttpServer::setStaticFiles(HttpStaticFiles* files)
+{
+	staticFiles = files;
+	if (files != NULL)
+		enableHeaderProcessing("If-None-Match");
+}
+
+void HttpServer::setKeepAlive(uint16_t idleTimeOut, uint16_t maxConnections /* = HTTP_KEEPALIVE_MAX_CONNECTIONS */)
+{
+	keepAliveTimeOut = idleTimeOut;
+	keepAliveMaxConnections = maxConnections;
+}
+
+bool HttpServer::isKeepAliveAllowed()
+{
+	// Caller is counted in active clients, at least one more must be free
+	uint16_t maxClients = getMaxConnections();
+	return keepAliveTimeOut > 0 && activeClients <= keepAliveMaxConnections
+			&& (maxClients == 0 || activeClients < maxClients);
+}
+
 bool HttpServer::processRequest(HttpServerConnection &connection, HttpRequest &request, HttpResponse &response)
 {
 	if (request.isWebSocket())
@@ -70,16 +99,21 @@ bool HttpServer::processRequest(HttpServerConnection &connection, HttpRequest &r
 		bool res = initWebSocket(connection, request, response);
 		if (!res) response.badRequest();
 	}
-	String path = request.getPath();
-	if (path.length() > 1 && path.endsWith("/"))
-		path = path.substring(0, path.length() - 1);
+	const String& path = request.getPath();
+	int length = path.length();
+	if (length > 1 && path[length - 1] == '/')
+		length--;
 
-	if (paths.contains(path))
+	const HttpPathDelegate* handler = paths.find(path.c_str(), length, request.pathParameters);
+	if (handler != NULL)
 	{
-		paths[path](request, response);
+		(*handler)(request, response);
 		return true;
 	}
 
+	if (staticFiles != NULL && staticFiles->send(path.c_str() + 1, length - 1, request, response))
+		return true;
+
 	if (defaultHandler)
 	{
 		debugf("Default server handler for: '%s'", path.c_str());
@@ -91,11 +125,19 @@ bool HttpServer::processRequest(HttpServerConnection &connection, HttpRequest &r
 	return false;
 }
 
-bool HttpServer::isHeaderProcessingEnabled(String name)
+bool HttpServer::isHeaderProcessingEnabled(const String& name)
+{
+	return isHeaderProcessingEnabled(name.c_str(), name.length());
+}
+
+bool HttpServer::isHeaderProcessingEnabled(const char* name, int length)
 {
 	for (int i = 0; i < processingHeaders.count(); i++)
-		if (processingHeaders[i].equals(name))
+	{
+		const String& header = processingHeaders[i];
+		if (header.length() == length && memcmp(header.c_str(), name, length) == 0)
 			return true;
+	}
 
 	return false;
 }
@@ -108,6 +150,7 @@ bool HttpServer::initWebSocket(HttpServerConnection& connection, HttpRequest& re
 	auto sock = WebSocket(&connection);
 	if (!sock.initialize(request, response))
 		return false;
+	sock.server = this;
 
 	connection.setDisconnectionHandler(HttpServerConnectionDelegate(&HttpServer::onCloseWebSocket, this)); // auto remove on close
 	response.sendHeader(connection); // Will push header before user data
@@ -120,30 +163,24 @@ bool HttpServer::initWebSocket(HttpServerConnection& connection, HttpRequest& re
 
 void HttpServer::processWebSocketFrame(pbuf *buf, HttpServerConnection& connection)
 {
-	//TODO: process splitted payload
-	uint8_t* data; size_t size;
-	wsFrameType frameType = wsParseInputFrame((uint8_t*)buf->payload, buf->len, &data, &size);
 	WebSocket* sock = getWebSocket(connection);
-
-	if (frameType == WS_TEXT_FRAME)
-	{
-		String msg;
-		msg.setString((char*)data, size);
-		debugf("WS: %s", msg.c_str());
-		if (sock && wsMessage) wsMessage(*sock, msg);
-	}
-	if (frameType == WS_BINARY_FRAME)
-	{
-		if (sock && wsMessage) wsBinary(*sock, data, size);
-	}
-	else if (frameType == WS_CLOSING_FRAME)
-	{
+	if (sock == NULL)
+		return;
+
+	// Sockets closed by handlers are removed after the frame is processed,
+	// so the decoder and other sockets in list stay valid meanwhile
+	wsProcessing = true;
+	bool res = true;
+	// Frames can be split between segments and pbufs of chain
+	for (pbuf* cur = buf; cur != NULL && res; cur = cur->next)
+		res = sock->processData((uint8_t*)cur->payload, cur->len);
+	if (!res && !sock->isClosed())
 		connection.close(); // it will be processed automatically in onCloseWebSocket callback
-	}
-	else if (frameType == WS_INCOMPLETE_FRAME || frameType == WS_ERROR_FRAME)
-		debugf("WS error reading frame: %X", frameType);
-	else
-		debugf("WS frame type: %X", frameType);
+	wsProcessing = false;
+
+	for (int i = 0; i < wsocks.count(); i++)
+		if (wsocks[i].isClosed())
+			wsocks.remove(i--);
 }
 
 void HttpServer::setWebSocketConnectionHandler(WebSocketDelegate handler)
@@ -161,11 +198,39 @@ void HttpServer::setWebSocketBinaryHandler(WebSocketBinaryDelegate handler)
 	wsBinary = handler;
 }
 
+void HttpServer::setWebSocketBinaryStreamHandler(WebSocketBinaryStreamDelegate handler)
+{
+	wsBinaryStream = handler;
+}
+
 void HttpServer::setWebSocketDisconnectionHandler(WebSocketDelegate handler)
 {
 	wsDisconnect = handler;
 }
 
+int HttpServer::broadcast(const char* message, int length, wsFrameType type)
+{
+	if (wsocks.count() == 0)
+		return 0;
+
+	WebSocketSharedFrame* frame = WebSocketSharedFrame::create(message, length, type);
+	if (frame == NULL)
+		return 0;
+
+	int count = 0;
+	for (int i = 0; i < wsocks.count(); i++)
+		if (!wsocks[i].isClosed() && wsocks[i].connection->queueWebSocketFrame(frame, true))
+			count++;
+
+	frame->release();
+	return count;
+}
+
+int HttpServer::broadcast(const String& message)
+{
+	return broadcast(message.c_str(), message.length());
+}
+
 WebSocket* HttpServer::getWebSocket(HttpServerConnection& connection)
 {
 	for (int i = 0; i < wsocks.count(); i++)
@@ -180,17 +245,22 @@ void HttpServer::removeWebSocket(HttpServerConnection& connection)
 	debugf("WS remove connection item");
 	for (int i = 0; i < wsocks.count(); i++)
 		if (wsocks[i].is(&connection))
-			wsocks.remove(i--);
+		{
+			if (wsProcessing)
+				wsocks[i].connection = NULL;
+			else
+				wsocks.remove(i--);
+		}
 }
 
 void HttpServer::onCloseWebSocket(HttpServerConnection& connection)
 {
 	WebSocket* sock = getWebSocket(connection);
 
-	removeWebSocket(connection);
-
 	debugf("WS Close");
 	if (sock && wsDisconnect) wsDisconnect(*sock);
+
+	removeWebSocket(connection);
 }
 
 void HttpServer::enableWebSockets(bool enabled)
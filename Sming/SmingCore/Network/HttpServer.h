@@ -10,34 +10,53 @@
 
 #include "TcpServer.h"
 #include "WebSocket.h"
+#include "HttpPathRouter.h"
 #include "../../Wiring/WHashMap.h"
 #include "../../Wiring/WVector.h"
 #include "../Delegate.h"
 
+// Idle time of persistent connection, in the same units as setTimeOut
+#define HTTP_KEEPALIVE_TIMEOUT 5
+// Keep connections persistent only while server has no more opened clients.
+// One client of connection pool is always left for new connections.
+#define HTTP_KEEPALIVE_MAX_CONNECTIONS 4
+
 class String;
 class HttpServerConnection;
 class HttpRequest;
 class HttpResponse;
+class HttpStaticFiles;
 
 typedef Vector<WebSocket> WebSocketsList;
 
-typedef Delegate<void(HttpRequest&, HttpResponse&)> HttpPathDelegate;
 typedef Delegate<void(WebSocket&)> WebSocketDelegate;
 typedef Delegate<void(WebSocket&, const String&)> WebSocketMessageDelegate;
 typedef Delegate<void(WebSocket&, uint8_t* data, size_t size)> WebSocketBinaryDelegate;
+/// Part of binary message, the last one has finished flag set
+typedef Delegate<void(WebSocket&, uint8_t* data, size_t size, bool finished)> WebSocketBinaryStreamDelegate;
 
 class HttpServer: public TcpServer
 {
 	friend class HttpServerConnection;
+	friend class WebSocket;
 public:
 	HttpServer();
 	virtual ~HttpServer();
 
 	void enableHeaderProcessing(String headerName);
-	bool isHeaderProcessingEnabled(String name);
+	bool isHeaderProcessingEnabled(const String& name);
+	bool isHeaderProcessingEnabled(const char* name, int length);
 
 	void addPath(String path, HttpPathDelegate callback);
 	void setDefaultHandler(HttpPathDelegate callback);
+	/// Files from index are served when no path matches, before default handler
+	void setStaticFiles(HttpStaticFiles* files);
+
+	/// HTTP/1.1 persistent connections, zero idleTimeOut disables it
+	void setKeepAlive(uint16_t idleTimeOut, uint16_t maxConnections = HTTP_KEEPALIVE_MAX_CONNECTIONS);
+	bool isKeepAliveAllowed();
+	__forceinline uint32_t getNewConnections() { return newConnections; }
+	__forceinline uint32_t getReusedConnections() { return reusedConnections; }
 
 	/// Web Sockets
 	void enableWebSockets(bool enabled);
@@ -45,10 +64,19 @@ public:
 	void setWebSocketConnectionHandler(WebSocketDelegate handler);
 	void setWebSocketMessageHandler(WebSocketMessageDelegate handler);
 	void setWebSocketBinaryHandler(WebSocketBinaryDelegate handler);
+	/// Receive binary messages as they arrive, without reassembling them in memory
+	void setWebSocketBinaryStreamHandler(WebSocketBinaryStreamDelegate handler);
 	void setWebSocketDisconnectionHandler(WebSocketDelegate handler);
 
+	/// Sends the same message to all web socket clients. Frame is encoded once
+	/// and shared by all connections. Clients which don't keep up lose their
+	/// oldest queued frame. Returns number of clients the frame was queued to.
+	int broadcast(const char* message, int length, wsFrameType type = WS_TEXT_FRAME);
+	int broadcast(const String& message);
+
 protected:
 	virtual TcpConnection* createClient(tcp_pcb *clientTcp);
+	virtual void onClient(TcpClient *client);
 	virtual bool initWebSocket(HttpServerConnection &connection, HttpRequest &request, HttpResponse &response);
 	virtual bool processRequest(HttpServerConnection &connection, HttpRequest &request, HttpResponse &response);
 	virtual void processWebSocketFrame(pbuf *buf, HttpServerConnection &connection);
@@ -60,13 +88,21 @@ protected:
 private:
 	HttpPathDelegate defaultHandler;
 	Vector<String> processingHeaders;
-	HashMap<String, HttpPathDelegate> paths;
+	HttpPathRouter paths;
+	HttpStaticFiles* staticFiles = NULL;
 	WebSocketsList wsocks;
 
+	uint16_t keepAliveTimeOut = HTTP_KEEPALIVE_TIMEOUT;
+	uint16_t keepAliveMaxConnections = HTTP_KEEPALIVE_MAX_CONNECTIONS;
+	uint32_t newConnections = 0;
+	uint32_t reusedConnections = 0;
+
 	bool wsEnabled = false;
+	bool wsProcessing = false; // Received frame is being decoded
 	WebSocketDelegate wsConnect;
 	WebSocketMessageDelegate wsMessage;
 	WebSocketBinaryDelegate wsBinary;
+	WebSocketBinaryStreamDelegate wsBinaryStream;
 	WebSocketDelegate wsDisconnect;
 };
 
@@ -15,12 +15,40 @@ HttpServerConnection::HttpServerConnection(HttpServer *parentServer, tcp_pcb *cl
 	: TcpConnection(clientTcp, true), server(parentServer), state(eHCS_Ready)
 {
 	TcpServer::totalConnections++;
-	response.setHeader("Connection", "close");
 }
 
 HttpServerConnection::~HttpServerConnection()
 {
 	TcpServer::totalConnections--;
+	freeQueued();
+}
+
+void HttpServerConnection::reset()
+{
+	freeQueued();
+	request.reset();
+	response.reset();
+	state = eHCS_Ready;
+	disconnection = nullptr;
+	keepAlive = false;
+	idle = false;
+	requestTimeOut = 0;
+	requestsCount = 0;
+	wsDroppedFrames = 0;
+	TcpConnection::reset();
+}
+
+void HttpServerConnection::freeQueued()
+{
+	if (pipelined != NULL)
+		pbuf_free(pipelined);
+	pipelined = NULL;
+
+	// Frame which is being sent stays pinned until connection is released
+	for (int i = 0; i < wsQueueCount; i++)
+		freeStream(wsQueue[(wsQueueStart + i) % WEB_SOCKET_QUEUE_SIZE]);
+	wsQueueStart = 0;
+	wsQueueCount = 0;
 }
 
 err_t HttpServerConnection::onReceive(pbuf *buf)
@@ -40,9 +68,50 @@ err_t HttpServerConnection::onReceive(pbuf *buf)
 		buf->next = dbghack;
 	}*/
 
+	if (state == eHCS_WebSocketFrames)
+	{
+		server->processWebSocketFrame(buf, *this);
+	}
+	else if (pipelined != NULL || (state != eHCS_Ready && state != eHCS_ParsePostData))
+	{
+		// Next request arrived before current response was completed
+		pbuf_ref(buf);
+		if (pipelined == NULL)
+		{
+			pipelined = buf;
+			pipelinedPos = 0;
+		}
+		else
+			pbuf_cat(pipelined, buf);
+
+		if (pipelined->tot_len - pipelinedPos > NETWORK_MAX_HTTP_PARSING_LEN)
+		{
+			debugf("PIPELINE OVERFLOW");
+			close();
+			return ERR_OK;
+		}
+	}
+	else
+		processReceived(buf, 0);
+
+	// Fire callbacks
+	TcpConnection::onReceive(buf);
+
+	return ERR_OK;
+}
+
+void HttpServerConnection::processReceived(pbuf *buf, int startPos)
+{
 	if (state == eHCS_Ready)
 	{
-		HttpParseResult res = request.parseHeader(server, buf);
+		if (idle)
+		{
+			// Persistent connection is active again
+			setTimeOut(requestTimeOut);
+			idle = false;
+		}
+
+		HttpParseResult res = request.parseHeader(server, buf, startPos);
 		if (res == eHPR_Wait)
 			debugf("HEADER WAIT");
 		else if (res == eHPR_Failed)
@@ -59,15 +128,21 @@ err_t HttpServerConnection::onReceive(pbuf *buf)
 			String contType = request.getContentType();
 			contType.toLowerCase();
 			if (request.getContentLength() > 0 && contType.indexOf(ContentType::FormUrlEncoded) != -1)
+			{
+				keepAlive = true;
 				state = eHCS_ParsePostData;
+			}
 			else
+			{
+				// Body of other content types isn't consumed here, don't reuse connection after it
+				keepAlive = request.getContentLength() <= 0;
 				state = eHCS_ParsingCompleted;
+
+				if (keepAlive)
+					keepPipelined(buf, request.bodyOffset);
+			}
 		}
 	}
-	else if (state == eHCS_WebSocketFrames)
-	{
-		server->processWebSocketFrame(buf, *this);
-	}
 
 	if (state == eHCS_ParsePostData)
 	{
@@ -84,17 +159,54 @@ err_t HttpServerConnection::onReceive(pbuf *buf)
 		{
 			debugf("POST Parsed");
 			state = eHCS_ParsingCompleted;
+			keepPipelined(buf, request.bodyEnd);
 		}
 	}
+}
 
-	// Fire callbacks
-	TcpConnection::onReceive(buf);
+void HttpServerConnection::keepPipelined(pbuf *buf, int startPos)
+{
+	if (startPos >= buf->tot_len)
+		return;
 
-	return ERR_OK;
+	// Keep pipelined requests data
+	if (buf != pipelined)
+	{
+		pbuf_ref(buf);
+		pipelined = buf;
+	}
+	pipelinedPos = startPos;
+}
+
+void HttpServerConnection::processPipelined()
+{
+	pbuf *buf = pipelined;
+	pipelined = NULL;
+	processReceived(buf, pipelinedPos); // Will keep buffer again if more requests available
+	pbuf_free(buf);
+}
+
+void HttpServerConnection::prepareNextRequest()
+{
+	debugf("Keep connection for next request");
+	request.reset();
+	response.reset();
+	state = eHCS_Ready;
+	keepAlive = false;
+
+	requestTimeOut = timeOut;
+	setTimeOut(server->keepAliveTimeOut);
+	idle = true;
+
+	if (pipelined != NULL)
+		processPipelined();
 }
 
 void HttpServerConnection::beginSendData()
 {
+	if (requestsCount++ > 0)
+		server->reusedConnections++;
+
 	if (!server->processRequest(*this, request, response))
 	{
 		response.notFound();
@@ -109,6 +221,22 @@ void HttpServerConnection::beginSendData()
 		return;
 	}
 
+	if (request.isWebSocket())
+	{
+		keepAlive = false;
+		setConnectionClass(eTCC_Stream);
+	}
+	else
+	{
+		// Persistent connection requires known response size
+		int length = response.getContentLength();
+		setConnectionClass(length >= 0 && length <= HTTP_SHORT_RESPONSE_SIZE ? eTCC_Short : eTCC_Bulk);
+		keepAlive = keepAlive && length >= 0 && request.isKeepAlive() && server->isKeepAliveAllowed();
+		if (keepAlive && !response.hasHeader(eHRH_ContentLength))
+			response.setHeader(eHRH_ContentLength, String(length));
+		response.setHeader(eHRH_Connection, keepAlive ? "keep-alive" : "close");
+	}
+
 	debugf("response sendHeader");
 	response.sendHeader(*this);
 
@@ -125,32 +253,92 @@ void HttpServerConnection::beginSendData()
 void HttpServerConnection::sendError(const char* message /* = NULL*/)
 {
 	debugf("SEND ERROR PAGE");
+	keepAlive = false;
+	setConnectionClass(eTCC_Short);
+	response.setHeader(eHRH_Connection, "close");
 	response.setContentType(ContentType::HTML);
-	response.sendHeader(*this);
 
-	writeString("<H2 color='#444'>", TCP_WRITE_FLAG_MORE);
-	const char* statusName = response.getStatusName().c_str();
-	writeString(message ? message : statusName, TCP_WRITE_FLAG_COPY);
-	writeString("</H2>");
-	state = eHCS_Sent;
+	// Written after header, which may not fit into send buffer at once
+	String page = "<H2 color='#444'>";
+	page += message ? String(message) : response.getStatusName();
+	page += "</H2>";
+	response.sendString(page);
+	state = eHCS_Sending;
 }
 
 void HttpServerConnection::onReadyToSendData(TcpConnectionEvent sourceEvent)
 {
 	TcpConnection::onReadyToSendData(sourceEvent);
 
-	if (state == eHCS_ParsingCompleted)
-		beginSendData();
+	if (state == eHCS_WebSocketFrames)
+	{
+		sendWebSocketQueue();
+		return;
+	}
+
+	do
+	{
+		if (state == eHCS_ParsingCompleted)
+			beginSendData();
+
+		if (state == eHCS_Sending)
+		{
+			debugf("response sendBody");
+			if (response.sendBody(*this))
+				state = eHCS_Sent; // Completed!
+		}
+
+		if (state != eHCS_Sent)
+			break;
+
+		transferCompleted();
+		if (!keepAlive)
+		{
+			close();
+			break;
+		}
+
+		prepareNextRequest();
+		// Pipelined request can be processed right now
+	} while (state == eHCS_ParsingCompleted && getAvailableWriteSize() > 0);
+}
 
-	if (state == eHCS_Sending)
+bool HttpServerConnection::queueWebSocketFrame(WebSocketSharedFrame* frame, bool dropOldest)
+{
+	if (wsQueueCount == WEB_SOCKET_QUEUE_SIZE)
 	{
-		debugf("response sendBody");
-		if (response.sendBody(*this))
-			state = eHCS_Sent; // Completed!
+		if (!dropOldest)
+			return false;
+
+		// Client doesn't keep up, drop the oldest frame which wasn't started yet
+		int dropped = (wsQueueStart + (wsQueue[wsQueueStart]->isStarted() ? 1 : 0)) % WEB_SOCKET_QUEUE_SIZE;
+		delete wsQueue[dropped];
+		if (dropped != wsQueueStart)
+			wsQueue[dropped] = wsQueue[wsQueueStart];
+		wsQueueStart = (wsQueueStart + 1) % WEB_SOCKET_QUEUE_SIZE;
+		wsQueueCount--;
+		wsDroppedFrames++;
 	}
 
-	if (state == eHCS_Sent)
-		close();
+	wsQueue[(wsQueueStart + wsQueueCount) % WEB_SOCKET_QUEUE_SIZE] = new WebSocketFrameStream(frame);
+	wsQueueCount++;
+	sendWebSocketQueue();
+	return true;
+}
+
+void HttpServerConnection::sendWebSocketQueue()
+{
+	while (wsQueueCount > 0 && getAvailableWriteSize() > 0)
+	{
+		WebSocketFrameStream* stream = wsQueue[wsQueueStart];
+		write(stream);
+		if (!stream->isFinished())
+			break;
+
+		freeStream(stream);
+		wsQueueStart = (wsQueueStart + 1) % WEB_SOCKET_QUEUE_SIZE;
+		wsQueueCount--;
+	}
 }
 
 void HttpServerConnection::close()
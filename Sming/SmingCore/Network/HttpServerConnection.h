@@ -14,7 +14,14 @@
 #include "../Wiring/WString.h"
 #include "../Delegate.h"
 
+// Max number of WebSocket frames waiting for free space in send buffer
+#define WEB_SOCKET_QUEUE_SIZE 4
+// Responses of known length up to this size are scheduled before bulk transfers
+#define HTTP_SHORT_RESPONSE_SIZE 4096
+
 class HttpServer;
+struct WebSocketSharedFrame;
+class WebSocketFrameStream;
 
 enum HttpConnectionState
 {
@@ -35,8 +42,17 @@ public:
 	virtual ~HttpServerConnection();
 
 	virtual void close();
+	virtual void reset();
+	virtual bool isIdle() { return idle; }
 	void setDisconnectionHandler(HttpServerConnectionDelegate handler);
 
+	// Queues encoded WebSocket frame after the frames already waiting.
+	// When queue is full, the oldest frame which wasn't started yet is dropped
+	// if dropOldest is set, otherwise the new one is refused.
+	bool queueWebSocketFrame(WebSocketSharedFrame* frame, bool dropOldest);
+	__forceinline uint8_t getWebSocketQueueDepth() { return wsQueueCount; }
+	__forceinline uint32_t getWebSocketDroppedFrames() { return wsDroppedFrames; }
+
 protected:
 	virtual err_t onReceive(pbuf *buf);
 	virtual void onReadyToSendData(TcpConnectionEvent sourceEvent);
@@ -45,6 +61,13 @@ protected:
 
 	virtual void onError(err_t err);
 
+	void processReceived(pbuf *buf, int startPos);
+	void keepPipelined(pbuf *buf, int startPos);
+	void processPipelined();
+	void prepareNextRequest();
+	void sendWebSocketQueue();
+	void freeQueued();
+
 private:
 	HttpServer *server;
 	HttpConnectionState state;
@@ -52,6 +75,18 @@ private:
 	HttpResponse response;
 	HttpServerConnectionDelegate disconnection;
 
+	bool keepAlive = false;
+	bool idle = false;
+	uint16_t requestTimeOut = 0;
+	uint16_t requestsCount = 0;
+	pbuf *pipelined = NULL; // Received data of next requests
+	int pipelinedPos = 0;
+
+	WebSocketFrameStream* wsQueue[WEB_SOCKET_QUEUE_SIZE];
+	uint8_t wsQueueStart = 0;
+	uint8_t wsQueueCount = 0;
+	uint32_t wsDroppedFrames = 0;
+
 	friend class HttpResponse;
 	friend class HttpRequest;
 };
@@ -0,0 +1,271 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#include "HttpStaticFiles.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "WebConstants.h"
+#include <stdlib.h>
+
+#define GZIP_SUFFIX			".gz"
+#define GZIP_SUFFIX_LENGTH	3
+
+static const char* sortNames = NULL; // Names buffer of files being sorted
+
+static int compareNames(const char* a, int aLength, const char* b, int bLength)
+{
+	int res = memcmp(a, b, min(aLength, bLength));
+	return res != 0 ? res : aLength - bLength;
+}
+
+static int compareFiles(const void* a, const void* b)
+{
+	const HttpStaticFile* fa = (const HttpStaticFile*)a;
+	const HttpStaticFile* fb = (const HttpStaticFile*)b;
+	int res = compareNames(sortNames + fa->nameOffset, fa->nameLength, sortNames + fb->nameOffset, fb->nameLength);
+	// Compressed file first, it is the one kept
+	return res != 0 ? res : (int)fb->gzip - (int)fa->gzip;
+}
+
+HttpStaticFiles::HttpStaticFiles()
+{
+}
+
+HttpStaticFiles::~HttpStaticFiles()
+{
+	clear();
+}
+
+bool HttpStaticFiles::build()
+{
+	clear();
+	if (!scan())
+		return false;
+
+	for (int i = 0; i < filesCount; i++)
+		hashFile(files[i]);
+	debugf("static files: %d indexed", filesCount);
+	return true;
+}
+
+void HttpStaticFiles::clear()
+{
+	delete[] files;
+	files = NULL;
+	delete[] names;
+	names = NULL;
+	filesCount = 0;
+	built = false;
+}
+
+bool HttpStaticFiles::scan()
+{
+	spiffs_DIR dir;
+	spiffs_dirent entry;
+
+	// First pass sizes buffers
+	int count = 0;
+	int namesSize = 0;
+	if (!fileOpenDir(&dir))
+		return false;
+	while (fileReadDir(&dir, &entry))
+	{
+		if (entry.type != SPIFFS_TYPE_FILE) continue;
+		count++;
+		namesSize += strlen((char*)entry.name);
+	}
+	fileCloseDir(&dir);
+	if (namesSize > UINT16_MAX)
+		return false;
+
+	HttpStaticFile* newFiles = new HttpStaticFile[count];
+	char* newNames = new char[namesSize + 1];
+	if (newFiles == NULL || newNames == NULL)
+	{
+		delete[] newFiles;
+		delete[] newNames;
+		return false;
+	}
+
+	int n = 0;
+	int offset = 0;
+	if (!fileOpenDir(&dir))
+	{
+		delete[] newFiles;
+		delete[] newNames;
+		return false;
+	}
+	while (n < count && fileReadDir(&dir, &entry))
+	{
+		const char* name = (const char*)entry.name;
+		int length = strlen(name);
+		if (entry.type != SPIFFS_TYPE_FILE || offset + length > namesSize)
+			continue;
+
+		HttpStaticFile& file = newFiles[n++];
+		memcpy(newNames + offset, name, length);
+		file.nameOffset = offset;
+		offset += length;
+
+		// Compressed file is served for name without suffix, like HttpResponse::sendFile does
+		file.gzip = length > GZIP_SUFFIX_LENGTH && memcmp(name + length - GZIP_SUFFIX_LENGTH, GZIP_SUFFIX, GZIP_SUFFIX_LENGTH) == 0;
+		file.nameLength = file.gzip ? length - GZIP_SUFFIX_LENGTH : length;
+		file.page = entry.pix;
+		file.id = entry.obj_id;
+		file.size = entry.size;
+		file.mime = ContentType::fromFullFileName(String(name, file.nameLength));
+		// File can be rewritten in place with the same object and size, so it's hashed again when sent
+		file.hashed = false;
+		file.hash = 0;
+	}
+	fileCloseDir(&dir);
+	count = n;
+
+	sortNames = newNames;
+	qsort(newFiles, count, sizeof(HttpStaticFile), compareFiles);
+	sortNames = NULL;
+
+	// Plain file is hidden by compressed one
+	int kept = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (kept > 0 && compareNames(newNames + newFiles[i].nameOffset, newFiles[i].nameLength,
+				newNames + newFiles[kept - 1].nameOffset, newFiles[kept - 1].nameLength) == 0)
+			continue;
+		newFiles[kept++] = newFiles[i];
+	}
+
+	delete[] files;
+	delete[] names;
+	files = newFiles;
+	names = newNames;
+	filesCount = kept;
+	changes = fileSystemChanges();
+	built = true;
+	return true;
+}
+
+// FNV-1a
+bool HttpStaticFiles::hashFile(HttpStaticFile& file)
+{
+	file_t handle = fileOpen(file.page, eFO_ReadOnly | eFO_Sequential);
+	if (handle < 0)
+		return false;
+
+	uint32_t hash = 2166136261;
+	uint8_t buffer[128];
+	// Reading past the end is logged as error
+	uint32_t remaining = file.size;
+	while (remaining > 0)
+	{
+		int read = (int)fileRead(handle, buffer, min(remaining, (uint32_t)sizeof(buffer)));
+		if (read <= 0)
+			break;
+		for (int i = 0; i < read; i++)
+			hash = (hash ^ buffer[i]) * 16777619;
+		remaining -= read;
+	}
+	fileClose(handle);
+
+	file.hash = hash;
+	file.hashed = remaining == 0;
+	return file.hashed;
+}
+
+int HttpStaticFiles::findIndex(HttpStaticFile* files, int count, const char* names, const char* fileName, int length)
+{
+	int low = 0;
+	int high = count - 1;
+	while (low <= high)
+	{
+		int mid = (low + high) / 2;
+		int res = compareNames(names + files[mid].nameOffset, files[mid].nameLength, fileName, length);
+		if (res == 0)
+			return mid;
+		if (res < 0)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+	return -1;
+}
+
+const HttpStaticFile* HttpStaticFiles::find(const char* fileName, int length)
+{
+	if (!built)
+		return NULL;
+
+	// Files could be moved or replaced, pages in index are valid only for unchanged file system
+	if (changes != fileSystemChanges() && !scan())
+		return NULL;
+
+	if (length == 0)
+	{
+		fileName = HTTP_STATIC_INDEX_FILE;
+		length = sizeof(HTTP_STATIC_INDEX_FILE) - 1;
+	}
+	int index = findIndex(files, filesCount, names, fileName, length);
+	return index < 0 ? NULL : &files[index];
+}
+
+String HttpStaticFiles::getETag(const HttpStaticFile& file)
+{
+	static const char hex[] = "0123456789abcdef";
+	char tag[11];
+	tag[0] = '"';
+	for (int i = 0; i < 8; i++)
+		tag[i + 1] = hex[(file.hash >> (28 - i * 4)) & 0xF];
+	tag[9] = '"';
+	tag[10] = '\0';
+	return String(tag, 10);
+}
+
+bool HttpStaticFiles::send(const String& fileName, HttpRequest& request, HttpResponse& response)
+{
+	return send(fileName.c_str(), fileName.length(), request, response);
+}
+
+bool HttpStaticFiles::send(const char* fileName, int length, HttpRequest& request, HttpResponse& response)
+{
+	HttpStaticFile* file = (HttpStaticFile*)find(fileName, length);
+	if (file == NULL)
+		return false;
+	if (!file->hashed && !hashFile(*file))
+		return false;
+
+	String tag = getETag(*file);
+	response.setHeader(eHRH_ETag, tag);
+	// Also in 304, where it must be size of full response
+	response.setHeader(eHRH_ContentLength, String(file->size));
+
+	String match = request.getHeader("If-None-Match");
+	if (match.length() > 0 && (match == "*" || match.indexOf(tag) >= 0))
+	{
+		// Browser has current content, file isn't opened
+		response.notModified();
+		notModified++;
+		return true;
+	}
+
+	file_t handle = fileOpen(file->page, eFO_ReadOnly | eFO_Sequential);
+	if (handle < 0)
+		return false;
+	spiffs_stat stat;
+	if (fileStats(handle, &stat) < 0 || stat.obj_id != file->id)
+	{
+		// Page was reused by other file, index is outdated
+		fileClose(handle);
+		return false;
+	}
+	response.sendDataStream(new FileStream(handle));
+	if (file->gzip)
+		response.setHeader(eHRH_ContentEncoding, "gzip");
+	if (file->mime != NULL && !response.hasHeader(eHRH_ContentType))
+		response.setContentType(file->mime);
+	sentFiles++;
+	return true;
+}
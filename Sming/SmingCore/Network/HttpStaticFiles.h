@@ -0,0 +1,76 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#ifndef _SMING_CORE_NETWORK_HTTPSTATICFILES_H_
+#define _SMING_CORE_NETWORK_HTTPSTATICFILES_H_
+
+#include "../FileSystem.h"
+#include "../../Wiring/WString.h"
+
+class HttpRequest;
+class HttpResponse;
+
+// Served for "/"
+#define HTTP_STATIC_INDEX_FILE "index.html"
+
+// Index entry, name is stored in shared names buffer
+struct HttpStaticFile
+{
+	uint16_t nameOffset;
+	uint8_t nameLength;
+	bool gzip; // Content is name.gz
+	bool hashed;
+	spiffs_page_ix page; // Opened without name lookup
+	spiffs_obj_id id;
+	uint32_t size;
+	uint32_t hash; // FNV-1a of content, sent as ETag
+	const char* mime;
+};
+
+// RAM index of files in file system, to serve static web assets without looking
+// up their names in flash. Responses carry ETag from file content, so browsers
+// revalidate cached files and get 304 Not Modified without file being opened.
+// Index is refreshed on next request when file system was changed.
+class HttpStaticFiles
+{
+public:
+	HttpStaticFiles();
+	~HttpStaticFiles();
+
+	// Scans file system and hashes all files, should be called at boot after mount.
+	// Files are hashed again on first request after file system is changed.
+	bool build();
+	void clear();
+
+	// Prepares response for indexed file, or 304 if request has matching If-None-Match.
+	// Returns false when file isn't in index.
+	bool send(const char* fileName, int length, HttpRequest& request, HttpResponse& response);
+	bool send(const String& fileName, HttpRequest& request, HttpResponse& response);
+	const HttpStaticFile* find(const char* fileName, int length);
+	String getETag(const HttpStaticFile& file);
+
+	__forceinline int count() { return filesCount; }
+	__forceinline uint32_t getSentFiles() { return sentFiles; }
+	__forceinline uint32_t getNotModified() { return notModified; }
+
+private:
+	bool scan();
+	bool hashFile(HttpStaticFile& file);
+	int findIndex(HttpStaticFile* files, int count, const char* names, const char* fileName, int length);
+
+private:
+	HttpStaticFile* files = NULL;
+	int filesCount = 0;
+	char* names = NULL;
+	uint32_t changes = 0; // fileSystemChanges() when scanned
+	bool built = false;
+
+	uint32_t sentFiles = 0;
+	uint32_t notModified = 0;
+};
+
+#endif /* _SMING_CORE_NETWORK_HTTPSTATICFILES_H_ */
@@ -9,19 +9,38 @@
 
 #include "../SmingCore.h"
 
+#define MQTT_QOS_MASK		0x06
+#define MQTT_DUP_FLAG		0x08
+#define MQTT_RETAIN_FLAG	0x01
+#define MQTT_PUBREL_FLAGS	0x02 // PUBREL, SUBSCRIBE and UNSUBSCRIBE have reserved bit 1 set
+
+#define MQTT_CLEAN_SESSION	0x02
+#define MQTT_PASSWORD_FLAG	0x40
+#define MQTT_USERNAME_FLAG	0x80
+
+// Max size of fixed header: type and 4 bytes of remaining length
+#define MQTT_MAX_FIXED_HEADER 5
+
+static uint8_t* putString(uint8_t* out, const char* str, int length)
+{
+	*out++ = length >> 8;
+	*out++ = length & 0xFF;
+	memcpy(out, str, length);
+	return out + length;
+}
+
 MqttClient::MqttClient(String serverHost, int serverPort, MqttStringSubscriptionCallback callback /* = NULL*/)
 	: TcpClient((bool)false)
 {
 	server = serverHost;
 	port = serverPort;
 	this->callback = callback;
-	waitingSize = 0;
-	posHeader = 0;
-	current = NULL;
+	memset(inflight, 0, sizeof(inflight));
 }
 
 MqttClient::~MqttClient()
 {
+	clearInflight();
 }
 
 bool MqttClient::connect(String clientName)
@@ -38,56 +57,280 @@ bool MqttClient::connect(String clientName, String username, String password)
 	}
 
 	debugf("MQTT start connection");
-	mqtt_init(&broker, clientName.c_str());
-	if (clientName.length() > 0)
-		mqtt_init_auth(&broker, username.c_str(), password.c_str());
-
-	int keepalive = 20; // Seconds
+	// Clean session: broker forgets our messages, so do we
+	clearInflight();
+	receivedCount = 0;
+	parserState = eMPS_Header;
 
 	TcpClient::connect(server, port);
+	setTimeOut(USHRT_MAX);
+
+	uint8_t flags = MQTT_CLEAN_SESSION;
+	int bodyLength = 10 + 2 + clientName.length();
+	if (username.length() > 0)
+	{
+		flags |= MQTT_USERNAME_FLAG;
+		bodyLength += 2 + username.length();
+		if (password.length() > 0)
+		{
+			flags |= MQTT_PASSWORD_FLAG;
+			bodyLength += 2 + password.length();
+		}
+	}
 
-	mqtt_set_alive(&broker, keepalive);
-	broker.socket_info = (void*)this;
-	broker.send = staticSendPacket;
+	int packetLength;
+	uint8_t* body;
+	uint8_t* packet = createPacket(MQTT_MSG_CONNECT, bodyLength, packetLength, body);
+	if (packet == NULL)
+		return false;
 
-	int res = mqtt_connect(&broker);
-	setTimeOut(USHRT_MAX);
-	return res > 0;
+	body = putString(body, "MQTT", 4);
+	*body++ = 4; // Protocol level: 3.1.1
+	*body++ = flags;
+	*body++ = MQTT_KEEPALIVE >> 8;
+	*body++ = MQTT_KEEPALIVE & 0xFF;
+	body = putString(body, clientName.c_str(), clientName.length());
+	if (flags & MQTT_USERNAME_FLAG)
+		body = putString(body, username.c_str(), username.length());
+	if (flags & MQTT_PASSWORD_FLAG)
+		body = putString(body, password.c_str(), password.length());
+
+	bool res = send((const char*)packet, packetLength);
+	delete[] packet;
+	return res;
 }
 
 bool MqttClient::publish(String topic, String message, bool retained /* = false*/)
 {
-	int res = mqtt_publish(&broker, topic.c_str(), message.c_str(), retained);
-	return res > 0;
+	return publish(topic, (const uint8_t*)message.c_str(), message.length(), 0, retained);
 }
 
 bool MqttClient::publishWithQoS(String topic, String message, int QoS, bool retained /* = false*/)
 {
-	int res = mqtt_publish_with_qos(&broker, topic.c_str(), message.c_str(), retained, QoS, NULL);
-	return res > 0;
+	return publish(topic, (const uint8_t*)message.c_str(), message.length(), QoS, retained);
 }
 
-int MqttClient::staticSendPacket(void* userInfo, const void* buf, unsigned int count)
+bool MqttClient::publish(const String& topic, const uint8_t* data, int size, int QoS, bool retained)
 {
-	MqttClient* client = (MqttClient*)userInfo;
-	bool sent = client->send((const char*)buf, count);
-	return sent ? count : 0;
+	if (!isProcessing() || QoS < 0 || QoS > 2)
+		return false;
+
+	int bodyLength = 2 + topic.length() + (QoS > 0 ? 2 : 0) + size;
+	if (getPendingSize() + bodyLength + MQTT_MAX_FIXED_HEADER > MQTT_MAX_QUEUE_SIZE)
+	{
+		debugf("MQTT publish: queue is full");
+		return false;
+	}
+
+	MqttInflightMessage* msg = NULL;
+	if (QoS > 0)
+	{
+		msg = findInflight(0);
+		if (msg == NULL)
+		{
+			debugf("MQTT publish: no free in-flight slot");
+			return false;
+		}
+	}
+
+	uint8_t header = MQTT_MSG_PUBLISH | (QoS << 1) | (retained ? MQTT_RETAIN_FLAG : 0);
+	int packetLength;
+	uint8_t* body;
+	uint8_t* packet = createPacket(header, bodyLength, packetLength, body);
+	if (packet == NULL)
+		return false;
+
+	body = putString(body, topic.c_str(), topic.length());
+	uint16_t id = 0;
+	if (QoS > 0)
+	{
+		id = nextMessageId();
+		*body++ = id >> 8;
+		*body++ = id & 0xFF;
+	}
+	memcpy(body, data, size);
+
+	if (!send((const char*)packet, packetLength))
+	{
+		delete[] packet;
+		return false;
+	}
+
+	if (msg == NULL)
+	{
+		delete[] packet;
+		return true;
+	}
+
+	// Kept for retransmission
+	msg->state = QoS == 1 ? eMIS_WaitPuback : eMIS_WaitPubrec;
+	msg->id = id;
+	msg->retries = 0;
+	msg->sentTick = ticks;
+	msg->packet = packet;
+	msg->length = packetLength;
+	inflightCount++;
+	return true;
 }
 
-bool MqttClient::subscribe(String topic)
+bool MqttClient::subscribe(String topic, MqttStringSubscriptionCallback handler /* = NULL*/)
 {
-	uint16_t msgId = 0;
 	debugf("subscription '%s' registered", topic.c_str());
-	int res = mqtt_subscribe(&broker, topic.c_str(), &msgId);
-	return res > 0;
+	subscriptions.add(topic, handler);
+
+	int packetLength;
+	uint8_t* body;
+	uint8_t* packet = createPacket(MQTT_MSG_SUBSCRIBE | MQTT_PUBREL_FLAGS, 2 + 2 + topic.length() + 1, packetLength, body);
+	if (packet == NULL)
+		return false;
+
+	uint16_t id = nextMessageId();
+	*body++ = id >> 8;
+	*body++ = id & 0xFF;
+	body = putString(body, topic.c_str(), topic.length());
+	*body = 0; // Requested QoS, broker delivers with QoS of each message up to it
+	bool res = send((const char*)packet, packetLength);
+	delete[] packet;
+	return res;
 }
 
 bool MqttClient::unsubscribe(String topic)
 {
-	uint16_t msgId = 0;
 	debugf("unsubscribing from '%s'", topic.c_str());
-	int res = mqtt_unsubscribe(&broker, topic.c_str(), &msgId);
-	return res > 0;
+	subscriptions.remove(topic);
+
+	int packetLength;
+	uint8_t* body;
+	uint8_t* packet = createPacket(MQTT_MSG_UNSUBSCRIBE | MQTT_PUBREL_FLAGS, 2 + 2 + topic.length(), packetLength, body);
+	if (packet == NULL)
+		return false;
+
+	uint16_t id = nextMessageId();
+	*body++ = id >> 8;
+	*body++ = id & 0xFF;
+	putString(body, topic.c_str(), topic.length());
+	bool res = send((const char*)packet, packetLength);
+	delete[] packet;
+	return res;
+}
+
+void MqttClient::setPayloadCallback(MqttPayloadCallback payloadCallback)
+{
+	this->payloadCallback = payloadCallback;
+}
+
+uint8_t* MqttClient::createPacket(uint8_t header, int bodyLength, int& packetLength, uint8_t*& body)
+{
+	uint8_t fixed[MQTT_MAX_FIXED_HEADER];
+	int pos = 0;
+	fixed[pos++] = header;
+	uint32_t length = bodyLength;
+	do
+	{
+		uint8_t digit = length & 0x7F;
+		length >>= 7;
+		fixed[pos++] = digit | (length > 0 ? 0x80 : 0);
+	} while (length > 0 && pos < MQTT_MAX_FIXED_HEADER);
+
+	packetLength = pos + bodyLength;
+	uint8_t* packet = new uint8_t[packetLength];
+	if (packet == NULL)
+		return NULL;
+	memcpy(packet, fixed, pos);
+	body = packet + pos;
+	return packet;
+}
+
+bool MqttClient::sendPacket(uint8_t header, const uint8_t* body, int bodyLength)
+{
+	int packetLength;
+	uint8_t* data;
+	uint8_t* packet = createPacket(header, bodyLength, packetLength, data);
+	if (packet == NULL)
+		return false;
+	memcpy(data, body, bodyLength);
+	bool res = send((const char*)packet, packetLength);
+	delete[] packet;
+	return res;
+}
+
+bool MqttClient::sendAck(uint8_t type, uint16_t id)
+{
+	uint8_t body[2] = { (uint8_t)(id >> 8), (uint8_t)(id & 0xFF) };
+	return sendPacket(type, body, sizeof(body));
+}
+
+uint16_t MqttClient::nextMessageId()
+{
+	// Zero isn't valid message id
+	if (++lastMessageId == 0)
+		lastMessageId = 1;
+	return lastMessageId;
+}
+
+MqttInflightMessage* MqttClient::findInflight(uint16_t id)
+{
+	for (int i = 0; i < MQTT_INFLIGHT_SIZE; i++)
+	{
+		bool free = inflight[i].state == eMIS_Free;
+		if (id == 0 ? free : (!free && inflight[i].id == id))
+			return &inflight[i];
+	}
+	return NULL;
+}
+
+void MqttClient::releaseInflight(MqttInflightMessage& msg)
+{
+	delete[] msg.packet;
+	msg.packet = NULL;
+	msg.state = eMIS_Free;
+	inflightCount--;
+}
+
+void MqttClient::clearInflight()
+{
+	for (int i = 0; i < MQTT_INFLIGHT_SIZE; i++)
+		if (inflight[i].state != eMIS_Free)
+			releaseInflight(inflight[i]);
+}
+
+void MqttClient::retryInflight()
+{
+	for (int i = 0; i < MQTT_INFLIGHT_SIZE; i++)
+	{
+		MqttInflightMessage& msg = inflight[i];
+		if (msg.state == eMIS_Free || (uint16_t)(ticks - msg.sentTick) < MQTT_RETRY_TICKS)
+			continue;
+
+		if (msg.retries >= MQTT_MAX_RETRIES)
+		{
+			debugf("MQTT message %d wasn't acknowledged, dropped", msg.id);
+			releaseInflight(msg);
+			continue;
+		}
+
+		bool sent;
+		if (msg.state == eMIS_WaitPubcomp)
+			sent = sendAck(MQTT_MSG_PUBREL | MQTT_PUBREL_FLAGS, msg.id);
+		else
+		{
+			msg.packet[0] |= MQTT_DUP_FLAG;
+			sent = send((const char*)msg.packet, msg.length);
+		}
+		if (!sent)
+			continue;
+
+		debugf("MQTT message %d sent again", msg.id);
+		msg.retries++;
+		msg.sentTick = ticks;
+		retransmissions++;
+	}
+}
+
+bool MqttClient::isSubscribed(const char* topic, int topicLength)
+{
+	MqttTopicNode* found;
+	return subscriptions.match(topic, topicLength, &found, 1) > 0;
 }
 
 void MqttClient::debugPrintResponseType(int type, int len)
@@ -131,120 +374,313 @@ err_t MqttClient::onReceive(pbuf *buf)
 	{
 		// Disconnected, close it
 		TcpClient::onReceive(buf);
+		return ERR_OK;
 	}
-	else
-	{
-		if (buf->len < 1)
+
+	// Packets can be split between segments and pbufs of chain
+	for (pbuf* cur = buf; cur != NULL; cur = cur->next)
+		if (!processData((const uint8_t*)cur->payload, cur->len))
 		{
-			// Bad packet?
-			debugf("> MQTT WRONG PACKET? (len: %d)", buf->len);
+			debugf("> MQTT WRONG PACKET");
 			close();
 			return ERR_OK;
 		}
 
-		int received = 0;
-		while (received < buf->tot_len)
+	// Fire ReadyToSend callback
+	TcpClient::onReceive(buf);
+
+	return ERR_OK;
+}
+
+bool MqttClient::processData(const uint8_t* data, int size)
+{
+	while (size > 0)
+	{
+		if (parserState == eMPS_Header)
+		{
+			packetHeader = *data++;
+			size--;
+			bodyLength = 0;
+			lengthShift = 0;
+			parserState = eMPS_Length;
+			continue;
+		}
+
+		if (parserState == eMPS_Length)
 		{
-			int type = 0;
-			if (waitingSize == 0)
+			uint8_t digit = *data++;
+			size--;
+			bodyLength |= (uint32_t)(digit & 0x7F) << lengthShift;
+			lengthShift += 7;
+			if (digit & 0x80)
 			{
-				// It's begining of new packet
-				int pos = received;
-				if (posHeader == 0)
-				{
-					//debugf("start posHeader");
-					pbuf_copy_partial(buf, &buffer[posHeader], 1, pos);
-					pos++;
-					posHeader = 1;
-				}
-				while (posHeader > 0 && pos < buf->tot_len)
-				{
-					//debugf("add posHeader");
-					pbuf_copy_partial(buf, &buffer[posHeader], 1, pos);
-					if ((buffer[posHeader] & 128) == 0)
-						posHeader = 0; // Remaining Length ended
-					else
-						posHeader++;
-					pos++;
-				}
-
-				if (posHeader == 0)
-				{
-					//debugf("start len calc");
-					// Remaining Length field processed
-					uint16_t rem_len = mqtt_parse_rem_len(buffer);
-					uint8_t rem_len_bytes = mqtt_num_rem_len_bytes(buffer);
-
-					// total packet length = remaining length + byte 1 of fixed header + remaning length part of fixed header
-					waitingSize = rem_len + rem_len_bytes + 1;
-
-					type = MQTTParseMessageType(buffer);
-					debugPrintResponseType(type, waitingSize);
-
-					// Prevent overflow
-					if (waitingSize < MQTT_MAX_BUFFER_SIZE)
-					{
-						current = buffer;
-						buffer[waitingSize] = 0;
-					}
-					else
-						current = NULL;
-				}
-				else
-					continue;
+				if (lengthShift >= 28)
+					return false; // Remaining length has 4 bytes at most
+				continue;
 			}
 
-			int available = min(waitingSize, buf->tot_len - received);
-			waitingSize -= available;
-			if (current != NULL)
+			debugPrintResponseType(MQTTParseMessageType(&packetHeader), bodyLength);
+			bodyPos = 0;
+			variableLength = 0;
+			streamed = false;
+			skipped = false;
+			ignored = false;
+			skippedId = 0;
+			parserState = eMPS_Body;
+			if (bodyLength > 0)
+				continue;
+		}
+		else
+		{
+			int len = size;
+			if (bodyLength - bodyPos < (uint32_t)len)
+				len = bodyLength - bodyPos;
+			if (!processBody(data, len))
+				return false;
+			bodyPos += len;
+			data += len;
+			size -= len;
+			if (bodyPos < bodyLength)
+				continue;
+		}
+
+		// Whole packet received
+		parserState = eMPS_Header;
+		if (!processPacket())
+			return false;
+	}
+
+	return true;
+}
+
+bool MqttClient::processBody(const uint8_t* data, int size)
+{
+	if (skipped)
+	{
+		skipBody(data, size, bodyPos);
+		return true;
+	}
+
+	bool publish = MQTTParseMessageType(&packetHeader) == MQTT_MSG_PUBLISH;
+	if (!publish || bodyLength <= MQTT_MAX_BUFFER_SIZE)
+	{
+		// Small packet is processed when completed
+		int len = min(size, MQTT_MAX_BUFFER_SIZE - (int)bodyPos);
+		if (len > 0)
+			memcpy(buffer + bodyPos, data, len);
+		return true;
+	}
+
+	// Large PUBLISH: keep topic and message id, stream payload
+	int pos = bodyPos;
+	while (size > 0 && (variableLength == 0 || pos < variableLength))
+	{
+		if (pos >= MQTT_MAX_BUFFER_SIZE)
+		{
+			debugf("MQTT topic is too long, skipped");
+			skipped = true;
+			skipBody(data, size, pos);
+			return true;
+		}
+		buffer[pos++] = *data++;
+		size--;
+		if (pos == 2)
+		{
+			int qos = (packetHeader & MQTT_QOS_MASK) >> 1;
+			variableLength = 2 + ((buffer[0] << 8) | buffer[1]) + (qos > 0 ? 2 : 0);
+		}
+	}
+	if (size == 0)
+		return true;
+
+	if (!streamed)
+	{
+		streamed = true;
+		int topicLength = (buffer[0] << 8) | buffer[1];
+		ignored = !payloadCallback || !isSubscribed((const char*)buffer + 2, topicLength);
+		if (ignored)
+			debugf("SKIP: %d", bodyLength); // Too large!
+		else
+			streamedTopic.setString((const char*)buffer + 2, topicLength);
+	}
+
+	if (!ignored)
+	{
+		uint32_t total = bodyLength - variableLength;
+		payloadCallback(streamedTopic, data, size, pos - variableLength, total);
+	}
+	return true;
+}
+
+// Message id follows topic, dropped message is still acknowledged with it
+void MqttClient::skipBody(const uint8_t* data, int size, uint32_t pos)
+{
+	for (int i = 0; i < size; i++, pos++)
+	{
+		if (pos == variableLength - 2)
+			skippedId = data[i] << 8;
+		else if (pos == variableLength - 1)
+			skippedId |= data[i];
+	}
+}
+
+bool MqttClient::processPacket()
+{
+	uint8_t type = MQTTParseMessageType(&packetHeader);
+	uint16_t id = bodyLength >= 2 ? (buffer[0] << 8) | buffer[1] : 0;
+
+	switch (type)
+	{
+	case MQTT_MSG_CONNACK:
+		if (bodyLength < 2 || buffer[1] != 0)
+		{
+			debugf("MQTT connection refused: %d", buffer[1]);
+			return false;
+		}
+		return true;
+
+	case MQTT_MSG_PUBLISH:
+		processPublish();
+		return true;
+
+	case MQTT_MSG_PUBACK:
+	case MQTT_MSG_PUBCOMP:
+	{
+		MqttInflightMessage* msg = findInflight(id);
+		MqttInflightState expected = type == MQTT_MSG_PUBACK ? eMIS_WaitPuback : eMIS_WaitPubcomp;
+		if (msg != NULL && msg->state == expected)
+			releaseInflight(*msg);
+		return true;
+	}
+
+	case MQTT_MSG_PUBREC:
+	{
+		MqttInflightMessage* msg = findInflight(id);
+		if (msg != NULL && msg->state != eMIS_WaitPuback)
+		{
+			// Message is stored by broker, no need to keep it anymore
+			delete[] msg->packet;
+			msg->packet = NULL;
+			msg->state = eMIS_WaitPubcomp;
+			msg->retries = 0;
+			msg->sentTick = ticks;
+		}
+		// PUBREL is sent even for unknown id, so broker can release it
+		sendAck(MQTT_MSG_PUBREL | MQTT_PUBREL_FLAGS, id);
+		return true;
+	}
+
+	case MQTT_MSG_PUBREL:
+		for (int i = 0; i < receivedCount; i++)
+			if (receivedIds[i] == id)
 			{
-				pbuf_copy_partial(buf, current, available, received);
-				current += available;
-
-				if (waitingSize == 0)
-				{
-					// Full packet received
-					if(type == MQTT_MSG_PUBLISH)
-					{
-						const uint8_t *ptrTopic, *ptrMsg;
-						uint16_t lenTopic, lenMsg;
-						lenTopic = mqtt_parse_pub_topic_ptr(buffer, &ptrTopic);
-						lenMsg = mqtt_parse_pub_msg_ptr(buffer, &ptrMsg);
-						// Additional check for wrong packet/parsing error
-						if (lenTopic + lenMsg < MQTT_MAX_BUFFER_SIZE)
-						{
-							debugf("%d: %d\n", lenTopic, lenMsg);
-							String topic, msg;
-							topic.setString((char*)ptrTopic, lenTopic);
-							msg.setString((char*)ptrMsg, lenMsg);
-							if (callback)
-								callback(topic, msg);
-						}
-						else
-						{
-							debugf("WRONG SIZES: %d: %d", lenTopic, lenMsg);
-						}
-					}
-				}
+				receivedIds[i] = receivedIds[--receivedCount];
+				break;
 			}
-			else
-				debugf("SKIP: %d (%d)", available, waitingSize + available); // To large!
-			received += available;
+		sendAck(MQTT_MSG_PUBCOMP, id);
+		return true;
+
+	default:
+		return true;
+	}
+}
+
+void MqttClient::processPublish()
+{
+	int qos = (packetHeader & MQTT_QOS_MASK) >> 1;
+	if (qos == 3)
+		return;
+
+	// Topic and message id must be within packet
+	uint32_t variable = 2 + (qos > 0 ? 2 : 0);
+	if (bodyLength >= 2)
+		variable += (buffer[0] << 8) | buffer[1];
+	if (bodyLength < variable)
+	{
+		debugf("MQTT PUBLISH is too short, dropped");
+		return;
+	}
+
+	bool deliver = !streamed && !skipped;
+	uint16_t id = 0;
+	if (qos > 0)
+		id = skipped ? skippedId : (buffer[variable - 2] << 8) | buffer[variable - 1];
+
+	if (qos == 2 && id != 0)
+	{
+		// Deliver once, until PUBREL forgets the id
+		for (int i = 0; i < receivedCount; i++)
+			if (receivedIds[i] == id)
+				deliver = false;
+		if (deliver)
+		{
+			if (receivedCount == MQTT_INFLIGHT_SIZE)
+				receivedCount--; // Broker exceeds window, forget the oldest one
+			receivedIds[receivedCount++] = id;
 		}
+	}
 
-		// Fire ReadyToSend callback
-		TcpClient::onReceive(buf);
+	if (deliver)
+	{
+		const uint8_t *ptrTopic, *ptrMsg;
+		buffer[bodyLength] = 0;
+		int lenTopic = (buffer[0] << 8) | buffer[1];
+		ptrTopic = buffer + 2;
+		ptrMsg = buffer + variable;
+		int lenMsg = bodyLength - variable;
+		// Topic is matched right in receive buffer, strings are made only for delivery
+		MqttTopicNode* found[MQTT_MAX_MATCHES];
+		int count = subscriptions.match((const char*)ptrTopic, lenTopic, found);
+		if (count > 0)
+		{
+			debugf("%d: %d\n", lenTopic, lenMsg);
+			// Handlers are copied, they may change subscriptions
+			MqttStringSubscriptionCallback handlers[MQTT_MAX_MATCHES];
+			int handlerCount = 0;
+			for (int i = 0; i < count; i++)
+				if (found[i]->handler)
+					handlers[handlerCount++] = found[i]->handler;
+
+			if (handlerCount > 0 || callback)
+			{
+				String topic, msg;
+				topic.setString((char*)ptrTopic, lenTopic);
+				msg.setString((char*)ptrMsg, lenMsg);
+				for (int i = 0; i < handlerCount; i++)
+					handlers[i](topic, msg);
+				if (handlerCount == 0)
+					callback(topic, msg);
+			}
+			else if (payloadCallback)
+			{
+				String topic;
+				topic.setString((char*)ptrTopic, lenTopic);
+				payloadCallback(topic, ptrMsg, lenMsg, 0, lenMsg);
+			}
+		}
 	}
 
-	return ERR_OK;
+	if (qos == 1)
+		sendAck(MQTT_MSG_PUBACK, id);
+	else if (qos == 2)
+		sendAck(MQTT_MSG_PUBREC, id);
+}
+
+err_t MqttClient::onPoll()
+{
+	ticks++;
+	return TcpClient::onPoll();
 }
 
 void MqttClient::onReadyToSendData(TcpConnectionEvent sourceEvent)
 {
 	if (sleep >= 10)
 	{
-		mqtt_ping(&broker);
+		uint8_t ping[2] = { MQTT_MSG_PINGREQ, 0 };
+		send((const char*)ping, sizeof(ping));
 		sleep = 0;
 	}
+	if (sourceEvent == eTCE_Poll && inflightCount > 0)
+		retryInflight();
 	TcpClient::onReadyToSendData(sourceEvent);
 }
@@ -8,19 +8,59 @@
 #ifndef _SMING_CORE_NETWORK_MqttClient_H_
 #define _SMING_CORE_NETWORK_MqttClient_H_
 
+// Received packets up to this size are kept in memory,
+// payload of longer PUBLISH packets is streamed to MqttPayloadCallback
 #define MQTT_MAX_BUFFER_SIZE 1024
 
+// Max number of own QoS 1/2 messages waiting for acknowledge
+#define MQTT_INFLIGHT_SIZE 4
+// Unacknowledged message is sent again after this number of poll periods (2 s each)
+#define MQTT_RETRY_TICKS 5
+#define MQTT_MAX_RETRIES 3
+// Max size of sent data which isn't acknowledged yet, publish() fails above it
+#define MQTT_MAX_QUEUE_SIZE 4096
+// Seconds
+#define MQTT_KEEPALIVE 20
+
 #include "TcpClient.h"
+#include "MqttTopicTrie.h"
 #include "../Delegate.h"
 #include "../../Wiring/WString.h"
 #include "../../Services/libemqtt/libemqtt.h"
 
-//typedef void (*MqttStringSubscriptionCallback)(String topic, String message);
-typedef Delegate<void(String topic, String message)> MqttStringSubscriptionCallback;
+// Part of PUBLISH payload, offset is position of data in the whole payload of total size
+typedef Delegate<void(const String& topic, const uint8_t* data, size_t size, size_t offset, size_t total)> MqttPayloadCallback;
 
 class MqttClient;
 class URL;
 
+enum MqttParserState
+{
+	eMPS_Header,
+	eMPS_Length,
+	eMPS_Body
+};
+
+enum MqttInflightState
+{
+	eMIS_Free = 0,
+	eMIS_WaitPuback,
+	eMIS_WaitPubrec,
+	eMIS_WaitPubcomp
+};
+
+// Own QoS 1/2 message which isn't acknowledged yet
+struct MqttInflightMessage
+{
+	MqttInflightState state;
+	uint16_t id;
+	uint8_t retries;
+	uint16_t sentTick;
+	// Encoded PUBLISH packet, kept for retransmission until PUBACK/PUBREC
+	uint8_t* packet;
+	int length;
+};
+
 class MqttClient: protected TcpClient
 {
 public:
@@ -33,28 +73,77 @@ public:
 	__forceinline bool isProcessing()  { return TcpClient::isProcessing(); }
 	__forceinline TcpClientState getConnectionState() { return TcpClient::getConnectionState(); }
 
+	// Returns false when message can't be queued now: connection is closed,
+	// too much data is waiting for acknowledge or all in-flight slots are used
 	bool publish(String topic, String message, bool retained = false);
 	bool publishWithQoS(String topic, String message, int QoS, bool retained = false);
+	bool publish(const String& topic, const uint8_t* data, int size, int QoS, bool retained);
 
-	bool subscribe(String topic);
+	// Messages matching topic are passed to handler, or to client callback when it's not set
+	bool subscribe(String topic, MqttStringSubscriptionCallback handler = NULL);
 	bool unsubscribe(String topic);
 
+	// Receive payload of messages which don't fit MQTT_MAX_BUFFER_SIZE
+	void setPayloadCallback(MqttPayloadCallback payloadCallback);
+
+	__forceinline int getInflightCount() { return inflightCount; }
+	__forceinline int getQueuedSize() { return getPendingSize(); }
+	__forceinline uint32_t getRetransmissions() { return retransmissions; }
+
 protected:
 	virtual err_t onReceive(pbuf *buf);
+	virtual err_t onPoll();
 	virtual void onReadyToSendData(TcpConnectionEvent sourceEvent);
 	void debugPrintResponseType(int type, int len);
-	static int staticSendPacket(void* userInfo, const void* buf, unsigned int count);
+
+	bool processData(const uint8_t* data, int size);
+	bool processBody(const uint8_t* data, int size);
+	void skipBody(const uint8_t* data, int size, uint32_t pos);
+	bool processPacket();
+	void processPublish();
+	bool isSubscribed(const char* topic, int topicLength);
+
+	bool sendPacket(uint8_t header, const uint8_t* body, int bodyLength);
+	bool sendAck(uint8_t type, uint16_t id);
+	uint8_t* createPacket(uint8_t header, int bodyLength, int& packetLength, uint8_t*& body);
+	uint16_t nextMessageId();
+
+	MqttInflightMessage* findInflight(uint16_t id);
+	void releaseInflight(MqttInflightMessage& msg);
+	void clearInflight();
+	void retryInflight();
 
 private:
 	String server;
 	int port;
-	mqtt_broker_handle_t broker;
-	int waitingSize;
-	uint8_t buffer[MQTT_MAX_BUFFER_SIZE + 1];
-	uint8_t *current;
-	int posHeader;
 	MqttStringSubscriptionCallback callback;
+	MqttPayloadCallback payloadCallback;
+	MqttTopicTrie subscriptions;
+
+	// Receiving
+	MqttParserState parserState = eMPS_Header;
+	uint8_t packetHeader = 0;
+	uint8_t lengthShift = 0;
+	uint32_t bodyLength = 0;
+	uint32_t bodyPos = 0;
+	uint32_t variableLength = 0; // PUBLISH topic and message id
+	bool streamed = false; // Payload is passed to payloadCallback as it comes
+	bool ignored = false; // Nobody wants streamed payload
+	bool skipped = false; // Topic doesn't fit buffer, packet is dropped
+	uint16_t skippedId = 0;
+	String streamedTopic;
+	uint8_t buffer[MQTT_MAX_BUFFER_SIZE + 1];
+
+	// Incoming QoS 2 messages waiting for PUBREL
+	uint16_t receivedIds[MQTT_INFLIGHT_SIZE];
+	uint8_t receivedCount = 0;
 
+	// Sending
+	uint16_t lastMessageId = 0;
+	MqttInflightMessage inflight[MQTT_INFLIGHT_SIZE];
+	uint8_t inflightCount = 0;
+	uint16_t ticks = 0;
+	uint32_t retransmissions = 0;
 };
 
 #endif /* _SMING_CORE_NETWORK_MqttClient_H_ */
@@ -0,0 +1,197 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#include "MqttTopicTrie.h"
+
+MqttTopicNode::MqttTopicNode(const char* name, int length)
+{
+	this->name.setString(name, length);
+}
+
+MqttTopicNode::~MqttTopicNode()
+{
+	while (children != NULL)
+	{
+		MqttTopicNode* child = children;
+		children = child->next;
+		delete child;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////
+
+MqttTopicTrie::MqttTopicTrie() : root("", 0)
+{
+}
+
+MqttTopicTrie::~MqttTopicTrie()
+{
+}
+
+MqttTopicNode* MqttTopicTrie::find(MqttTopicNode* node, const char* name, int length)
+{
+	for (MqttTopicNode* child = node->children; child != NULL; child = child->next)
+		if ((int)child->name.length() == length && memcmp(child->name.c_str(), name, length) == 0)
+			return child;
+	return NULL;
+}
+
+void MqttTopicTrie::add(const String& filter, MqttStringSubscriptionCallback handler)
+{
+	const char* str = filter.c_str();
+	int length = filter.length();
+	MqttTopicNode* node = &root;
+	int pos = 0;
+
+	while (true)
+	{
+		int end = pos;
+		while (end < length && str[end] != '/')
+			end++;
+
+		MqttTopicNode* child = find(node, str + pos, end - pos);
+		if (child == NULL)
+		{
+			// Appended, so handlers are called in order of subscription
+			MqttTopicNode** link = &node->children;
+			while (*link != NULL)
+				link = &(*link)->next;
+			child = new MqttTopicNode(str + pos, end - pos);
+			*link = child;
+		}
+		node = child;
+
+		if (end == length)
+			break;
+		pos = end + 1;
+	}
+
+	node->subscribed = true;
+	node->handler = handler;
+}
+
+bool MqttTopicTrie::remove(const String& filter)
+{
+	return remove(&root, filter.c_str(), 0, filter.length());
+}
+
+bool MqttTopicTrie::remove(MqttTopicNode* node, const char* filter, int pos, int length)
+{
+	int end = pos;
+	while (end < length && filter[end] != '/')
+		end++;
+
+	MqttTopicNode* child = find(node, filter + pos, end - pos);
+	if (child == NULL)
+		return false;
+
+	if (end < length)
+	{
+		if (!remove(child, filter, end + 1, length))
+			return false;
+	}
+	else
+	{
+		if (!child->subscribed)
+			return false;
+		child->subscribed = false;
+		child->handler = nullptr;
+	}
+
+	// Release branch which isn't used anymore
+	if (!child->subscribed && child->children == NULL)
+	{
+		MqttTopicNode** link = &node->children;
+		while (*link != child)
+			link = &(*link)->next;
+		*link = child->next;
+		delete child;
+	}
+	return true;
+}
+
+void MqttTopicTrie::clear()
+{
+	while (root.children != NULL)
+	{
+		MqttTopicNode* child = root.children;
+		root.children = child->next;
+		delete child;
+	}
+}
+
+int MqttTopicTrie::match(const char* topic, int length, MqttTopicNode** found, int maxFound)
+{
+	MqttTopicNode* branches[2][MQTT_MAX_BRANCHES];
+	MqttTopicNode** active = branches[0];
+	MqttTopicNode** next = branches[1];
+	int activeCount = 1;
+	int foundCount = 0;
+	active[0] = &root;
+
+	// Topics starting with '$' aren't matched by wildcards at first level
+	bool wildcards = length == 0 || topic[0] != '$';
+	int pos = 0;
+	while (activeCount > 0)
+	{
+		int end = pos;
+		while (end < length && topic[end] != '/')
+			end++;
+
+		int nextCount = 0;
+		for (int i = 0; i < activeCount; i++)
+			for (MqttTopicNode* child = active[i]->children; child != NULL; child = child->next)
+			{
+				const String& name = child->name;
+				bool wildcard = name.length() == 1 && (name[0] == '#' || name[0] == '+');
+				if (wildcard)
+				{
+					if (!wildcards)
+						continue;
+					if (name[0] == '#')
+					{
+						// Matches this and all remaining levels
+						if (child->subscribed && foundCount < maxFound)
+							found[foundCount++] = child;
+						continue;
+					}
+				}
+				else if ((int)name.length() != end - pos || memcmp(name.c_str(), topic + pos, end - pos) != 0)
+					continue;
+
+				if (nextCount < MQTT_MAX_BRANCHES)
+					next[nextCount++] = child;
+				else
+					debugf("MQTT too many wildcard branches");
+			}
+
+		MqttTopicNode** swap = active;
+		active = next;
+		next = swap;
+		activeCount = nextCount;
+		wildcards = true;
+
+		if (end == length)
+			break;
+		pos = end + 1;
+	}
+
+	// Whole topic consumed
+	for (int i = 0; i < activeCount; i++)
+	{
+		MqttTopicNode* node = active[i];
+		if (node->subscribed && foundCount < maxFound)
+			found[foundCount++] = node;
+
+		// "parent/#" also matches "parent"
+		for (MqttTopicNode* child = node->children; child != NULL; child = child->next)
+			if (child->subscribed && child->name.length() == 1 && child->name[0] == '#' && foundCount < maxFound)
+				found[foundCount++] = child;
+	}
+
+	return foundCount;
+}
@@ -0,0 +1,61 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#ifndef _SMING_CORE_NETWORK_MQTTTOPICTRIE_H_
+#define _SMING_CORE_NETWORK_MQTTTOPICTRIE_H_
+
+#include "../../Wiring/WString.h"
+#include "../Delegate.h"
+
+// Max number of subscriptions matching one topic
+#define MQTT_MAX_MATCHES 8
+// Max number of trie branches followed at once, each '+' level can add one
+#define MQTT_MAX_BRANCHES 8
+
+//typedef void (*MqttStringSubscriptionCallback)(String topic, String message);
+typedef Delegate<void(String topic, String message)> MqttStringSubscriptionCallback;
+
+// One level of topic filter: a name, "+" or "#"
+class MqttTopicNode
+{
+public:
+	MqttTopicNode(const char* name, int length);
+	~MqttTopicNode();
+
+	String name;
+	MqttTopicNode* children = NULL;
+	MqttTopicNode* next = NULL;
+	bool subscribed = false; // Filter ends here
+	MqttStringSubscriptionCallback handler;
+};
+
+// Subscribed topic filters split by levels, e.g. "home/+/temp" and "home/#":
+//   home -> + -> temp
+//        -> #
+// All filters matching a topic are found in one pass over its levels.
+class MqttTopicTrie
+{
+public:
+	MqttTopicTrie();
+	~MqttTopicTrie();
+
+	void add(const String& filter, MqttStringSubscriptionCallback handler);
+	bool remove(const String& filter);
+	void clear();
+
+	// Fills found with subscribed nodes matching topic, returns their number
+	int match(const char* topic, int length, MqttTopicNode** found, int maxFound = MQTT_MAX_MATCHES);
+
+private:
+	MqttTopicNode* find(MqttTopicNode* node, const char* name, int length);
+	bool remove(MqttTopicNode* node, const char* filter, int pos, int length);
+
+private:
+	MqttTopicNode root;
+};
+
+#endif /* _SMING_CORE_NETWORK_MQTTTOPICTRIE_H_ */
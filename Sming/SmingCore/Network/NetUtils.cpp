@@ -104,14 +104,32 @@ char* NetUtils::pbufAllocateStrCopy(pbuf *buf, int startPos, int length)
 
 String NetUtils::pbufStrCopy(pbuf *buf, int startPos, int length)
 {
+	StringView view = pbufStrView(buf, startPos, length);
+	if (!view.isNull())
+		return String(view);
+
 	char* stringPtr = new char[length + 1];
 	stringPtr[length] = '\0';
 	pbuf_copy_partial(buf, stringPtr, length, startPos);
-	String res = String(stringPtr);
+	String res = String(stringPtr, length);
 	delete[] stringPtr;
 	return res;
 }
 
+StringView NetUtils::pbufStrView(pbuf *buf, int startPos, int length)
+{
+	while (buf != NULL && buf->len <= startPos)
+	{
+		startPos -= buf->len;
+		buf = buf->next;
+	}
+
+	if (buf == NULL || startPos + length > buf->len)
+		return StringView();
+
+	return StringView((char*)buf->payload + startPos, length);
+}
+
 bool NetUtils::FixNetworkRouting()
 {
 //	if (ipClientRoutingFixed) return true;
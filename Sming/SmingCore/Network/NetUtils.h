@@ -8,8 +8,9 @@
 #ifndef _SMING_CORE_NETWORK_NETUTILS_H_
 #define _SMING_CORE_NETWORK_NETUTILS_H_
 
+#include "../../Wiring/WString.h"
+
 struct pbuf;
-class String;
 class TcpConnection;
 
 struct DnsLookup
@@ -27,6 +28,8 @@ public:
 	static int pbufFindStr(pbuf *buf, const char* wtf, int startPos = 0);
 	static char* pbufAllocateStrCopy(pbuf *buf, int startPos, int length);
 	static String pbufStrCopy(pbuf *buf, int startPos, int length);
+	// Returns view of data without copy, or null view if it crosses pbuf boundary
+	static StringView pbufStrView(pbuf *buf, int startPos, int length);
 
 	static bool FixNetworkRouting();
 
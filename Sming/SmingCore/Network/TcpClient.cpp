@@ -48,11 +48,22 @@ TcpClient::~TcpClient()
 {
 	if (stream != NULL)
 	{
-		delete[] stream;
+		delete stream;
 		stream = NULL;
 	}
 }
 
+void TcpClient::reset()
+{
+	delete stream;
+	stream = NULL;
+	asyncCloseAfterSent = false;
+	asyncTotalSent = 0;
+	asyncTotalLen = 0;
+	state = eTCS_Connected; // Server side client is connected when it's accepted
+	TcpConnection::reset();
+}
+
 bool TcpClient::connect(String server, int port)
 {
 	if (isProcessing()) return false;
@@ -74,7 +85,7 @@ bool TcpClient::sendString(String data, bool forceCloseAfterSent /* = false*/)
 	return send(data.c_str(), data.length(), forceCloseAfterSent);
 }
 
-bool TcpClient::send(const char* data, uint8_t len, bool forceCloseAfterSent /* = false*/)
+bool TcpClient::send(const char* data, int len, bool forceCloseAfterSent /* = false*/)
 {
 	if (state != eTCS_Connecting && state != eTCS_Connected) return false;
 
@@ -169,7 +180,7 @@ void TcpClient::pushAsyncPart()
 	{
 		flush();
 		debugf("TcpClient request completed");
-		delete stream; // Free memory now!
+		freeStream(stream); // Free memory now or after acknowledge
 		stream = NULL;
 	}
 }
@@ -202,8 +213,7 @@ void TcpClient::onError(err_t err)
 
 void TcpClient::onFinished(TcpClientState finishState)
 {
-	if (stream != NULL)
-		delete stream; // Free memory now!
+	freeStream(stream); // Free memory now or after acknowledge
 	stream = NULL;
 	// Initialize async variables for next connection
 	asyncTotalSent = 0;
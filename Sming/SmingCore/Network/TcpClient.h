@@ -46,11 +46,14 @@ public:
 	virtual bool connect(String server, int port);
 	virtual bool connect(IPAddress addr, uint16_t port);
 	virtual void close();
+	virtual void reset();
 
-	bool send(const char* data, uint8_t len, bool forceCloseAfterSent = false);
+	bool send(const char* data, int len, bool forceCloseAfterSent = false);
 	bool sendString(String data, bool forceCloseAfterSent = false);
 	__forceinline bool isProcessing()  { return state == eTCS_Connected || state == eTCS_Connecting; }
 	__forceinline TcpClientState getConnectionState() { return state; }
+	// Data passed to send() and not acknowledged yet
+	__forceinline int getPendingSize() { return asyncTotalLen - asyncTotalSent; }
 
 protected:
 	virtual err_t onConnected(err_t err);
@@ -69,8 +72,8 @@ private:
 	TcpClientEventDelegate ready = nullptr;
 	MemoryDataStream* stream = nullptr;
 	bool asyncCloseAfterSent = false;
-	int16_t asyncTotalSent = 0;
-	int16_t asyncTotalLen = 0;
+	int32_t asyncTotalSent = 0;
+	int32_t asyncTotalLen = 0;
 };
 
 #endif /* _SMING_CORE_TCPCLIENT_H_ */
@@ -6,6 +6,7 @@
  ****/
 
 #include "TcpConnection.h"
+#include "TcpServer.h"
 
 #include "../../SmingCore/DataSourceStream.h"
 #include "../../SmingCore/Platform/WDT.h"
@@ -25,11 +26,48 @@ TcpConnection::TcpConnection(tcp_pcb* connection, bool autoDestruct) : autoSelfD
 
 TcpConnection::~TcpConnection()
 {
+	if (tcp != NULL && hasReferencedData())
+		dropReferencedData(); // Can't wait for acknowledge anymore
 	close();
+	releasePinnedStreams(true);
+	if (owner != NULL)
+		owner->activeClients--;
 
 	debugf("~TCP connection");
 }
 
+void TcpConnection::reset()
+{
+	releasePinnedStreams(true);
+	referencedStream = NULL;
+	referencedUntil = 0;
+	referencedStreamUntil = 0;
+	sendingStream = NULL;
+	streamSent = 0;
+	bytesQueued = 0;
+	bytesAcked = 0;
+	bytesCopied = 0;
+	bytesReferenced = 0;
+	closeAfterAck = false;
+	sleep = 0;
+	canSend = true;
+	connectionClass = eTCC_Short;
+	transferStart = 0;
+	scheduled = false;
+	sendWaiting = false;
+	sendBudget = 0;
+}
+
+void TcpConnection::checkSelfFree()
+{
+	if (tcp != NULL) return;
+
+	if (owner != NULL)
+		owner->releaseClient(this); // Deleted or returned to pool
+	else if (autoSelfDestruct)
+		delete this;
+}
+
 bool TcpConnection::connect(String server, int port)
 {
 	if (tcp == NULL)
@@ -162,6 +200,11 @@ int TcpConnection::write(const char* data, int len, uint8_t apiflags /* = TCP_WR
    if (err == ERR_OK)
    {
 		//debugf("TCP connection send: %d (%d)", len, original);
+		bytesQueued += len;
+		if (apiflags & TCP_WRITE_FLAG_COPY)
+			bytesCopied += len;
+		else
+			bytesReferenced += len;
 		return len;
    } else {
 		//debugf("TCP connection failed with err %d (\"%s\")", err, lwip_strerr(err));
@@ -169,6 +212,20 @@ int TcpConnection::write(const char* data, int len, uint8_t apiflags /* = TCP_WR
    }
 }
 
+int TcpConnection::getStreamWriteSize()
+{
+	int size = getAvailableWriteSize();
+	if (scheduled && (uint32_t)size > sendBudget)
+		size = sendBudget;
+	return size;
+}
+
+void TcpConnection::spendSendBudget(int bytes)
+{
+	if (bytes > 0 && scheduled)
+		sendBudget -= min((uint32_t)bytes, sendBudget);
+}
+
 int TcpConnection::write(IDataSourceStream* stream)
 {
 	// Send data from DataStream
@@ -178,6 +235,12 @@ int TcpConnection::write(IDataSourceStream* stream)
 	int total = 0;
 	char buffer[NETWORK_SEND_BUFFER_SIZE];
 
+	if (stream != sendingStream)
+	{
+		sendingStream = stream;
+		streamSent = 0;
+	}
+
 	do
 	{
 		space = (tcp_sndqueuelen(tcp) < TCP_SND_QUEUELEN);
@@ -193,17 +256,36 @@ int TcpConnection::write(IDataSourceStream* stream)
 		do
 		{
 			pushCount++;
-			int read = min(NETWORK_SEND_BUFFER_SIZE, getAvailableWriteSize());
-			if (read > 0)
-				available = stream->readMemoryBlock(buffer, read);
-			else
-				available = 0;
+			int read = getStreamWriteSize();
+			const char* direct = NULL;
+			available = read > 0 ? stream->getDirectBlock(direct) : 0;
+			if (available > 0)
+			{
+				// Queue data by reference, stream is pinned until it is acknowledged
+				available = min(available, read);
+				referencedStream = stream;
+			}
+			else if (read > 0)
+				available = stream->readMemoryBlock(buffer, min(NETWORK_SEND_BUFFER_SIZE, read));
 
 			if (available > 0)
 			{
-				int written = write(buffer, available, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
-				total += written;
+				int written;
+				if (direct != NULL)
+				{
+					written = write(direct, available, TCP_WRITE_FLAG_MORE);
+					if (written > 0) referencedUntil = bytesQueued;
+				}
+				else
+					written = write(buffer, available, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
+				if (written > 0) total += written;
+				spendSendBudget(written);
 				stream->seek(max(written, 0));
+				if (written > 0)
+				{
+					streamSent += written;
+					if (direct != NULL) referencedStreamUntil = streamSent;
+				}
 				repeat = written == available && !stream->isFinished() && pushCount < 25;
 			}
 			else
@@ -214,12 +296,112 @@ int TcpConnection::write(IDataSourceStream* stream)
 	} while (repeat && space);
 
 	flush();
+
+	if (owner != NULL)
+	{
+		owner->recordQueue(connectionClass, bytesQueued - bytesAcked);
+		if (scheduled && sendBudget == 0 && !stream->isFinished())
+		{
+			// Other connections are served before this one continues
+			sendWaiting = true;
+			owner->requestSendRound();
+		}
+	}
 	return total;
 }
 
+void TcpConnection::setConnectionClass(TcpConnectionClass cls)
+{
+	connectionClass = cls;
+	transferStart = system_get_time();
+	if (scheduled)
+		sendBudget = owner->getSendQuantum(cls); // Transfer starts with budget of its class
+}
+
+void TcpConnection::transferCompleted()
+{
+	if (owner != NULL)
+		owner->recordLatency(connectionClass, system_get_time() - transferStart);
+}
+
+void TcpConnection::freeStream(IDataSourceStream* stream)
+{
+	if (stream == NULL) return;
+
+	if (stream == sendingStream)
+		sendingStream = NULL;
+	if (stream == referencedStream)
+	{
+		referencedStream = NULL;
+		if (tcp != NULL && (int32_t)(referencedUntil - bytesAcked) > 0)
+		{
+			debugf("TCP stream pinned until acknowledge");
+			pinned = new TcpPinnedStream { stream, referencedUntil, referencedStreamUntil, pinned };
+			return;
+		}
+	}
+
+	delete stream;
+}
+
+bool TcpConnection::hasReferencedData()
+{
+	if (pinned != NULL) return true;
+	return referencedStream != NULL && (int32_t)(referencedUntil - bytesAcked) > 0;
+}
+
+void TcpConnection::releasePinnedStreams(bool all)
+{
+	TcpPinnedStream** link = &pinned;
+	while (*link != NULL)
+	{
+		TcpPinnedStream* cur = *link;
+		if (all || (int32_t)(cur->until - bytesAcked) <= 0)
+		{
+			*link = cur->next;
+			delete cur->stream;
+			delete cur;
+		}
+		else
+		{
+			releaseAckedData(cur->stream, cur->until, cur->streamUntil);
+			link = &cur->next;
+		}
+	}
+
+	if (!all && referencedStream != NULL)
+		releaseAckedData(referencedStream, referencedUntil, referencedStreamUntil);
+}
+
+void TcpConnection::releaseAckedData(IDataSourceStream* stream, uint32_t until, uint32_t streamUntil)
+{
+	// Unacknowledged stream data can't be longer than all unacknowledged data
+	uint32_t unacked = (int32_t)(until - bytesAcked) > 0 ? until - bytesAcked : 0;
+	if (unacked < streamUntil)
+		stream->releaseAcked(streamUntil - unacked);
+}
+
+void TcpConnection::dropReferencedData()
+{
+	// Abort connection to free queued segments before referenced memory
+	tcp_arg(tcp, NULL);
+	tcp_err(tcp, NULL);
+	tcp_abort(tcp);
+	tcp = NULL;
+	closeAfterAck = false;
+	releasePinnedStreams(true);
+}
+
 void TcpConnection::close()
 {
 	if (tcp == NULL) return;
+	if (hasReferencedData())
+	{
+		// Referenced memory must stay valid for retransmission, close it after acknowledge
+		debugf("TCP connection closing after acknowledge");
+		closeAfterAck = true;
+		return;
+	}
 	debugf("TCP connection closing");
 
 	tcp_arg(tcp, NULL); // reset pointer to close connection on next callback
@@ -231,6 +413,7 @@ void TcpConnection::initialize(tcp_pcb* pcb)
 	tcp = pcb;
 	sleep = 0;
 	canSend = true;
+	if (tcp == NULL) return; // Not connected yet or out of memory
 	tcp_nagle_disable(tcp);
 	tcp_arg(tcp, (void*)this);
 	tcp_sent(tcp, staticOnSent);
@@ -321,6 +504,17 @@ err_t TcpConnection::staticOnReceive(void *arg, tcp_pcb *tcp, pbuf *p, err_t err
 	else
 		con->sleep = 0;
 
+	if (con->closeAfterAck)
+	{
+		// Already closed by application, just wait for acknowledge
+		if (p != NULL)
+		{
+			tcp_recved(tcp, p->tot_len);
+			pbuf_free(p);
+		}
+		return ERR_OK;
+	}
+
 	if (err != ERR_OK /*&& err != ERR_CLSD && err != ERR_RST*/)
 	{
 		debugf("Received ERROR %d", err);
@@ -350,7 +544,8 @@ err_t TcpConnection::staticOnReceive(void *arg, tcp_pcb *tcp, pbuf *p, err_t err
 	else
 	{
 		con->close();
-		closeTcpConnection(tcp);
+		if (con->tcp == NULL) // Otherwise it will be closed after acknowledge
+			closeTcpConnection(tcp);
 	}
 
 	con->checkSelfFree();
@@ -367,6 +562,19 @@ err_t TcpConnection::staticOnSent(void *arg, tcp_pcb *tcp, uint16_t len)
 	else
 		con->sleep = 0;
 
+	con->bytesAcked += len;
+	con->releasePinnedStreams(false);
+	if (con->closeAfterAck)
+	{
+		if (!con->hasReferencedData())
+		{
+			con->closeAfterAck = false;
+			con->TcpConnection::close();
+		}
+		con->checkSelfFree();
+		return ERR_OK;
+	}
+
 	err_t res = con->onSent(len);
 	con->checkSelfFree();
 	//debugf("<staticOnSent");
@@ -387,6 +595,16 @@ err_t TcpConnection::staticOnPoll(void *arg, tcp_pcb *tcp)
 	//	return ERR_OK;
 
 	con->sleep++;
+	if (con->closeAfterAck)
+	{
+		if (con->sleep < con->timeOut || con->timeOut == USHRT_MAX)
+			return ERR_OK;
+
+		debugf("TCP acknowledge wait timeout");
+		con->dropReferencedData();
+		con->checkSelfFree();
+		return ERR_ABRT;
+	}
 	err_t res = con->onPoll();
 	con->checkSelfFree();
 	//debugf("<staticOnPoll");
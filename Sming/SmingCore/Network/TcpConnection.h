@@ -27,13 +27,37 @@ enum TcpConnectionEvent
 	eTCE_Poll
 };
 
+// Traffic class of current transfer, server schedules and measures connections by it
+enum TcpConnectionClass
+{
+	// Short responses, served first
+	eTCC_Short = 0,
+	// Long-lived streams, like WebSocket
+	eTCC_Stream,
+	// Large transfers
+	eTCC_Bulk
+};
+
+#define TCP_CONNECTION_CLASSES 3
+
 struct pbuf;
 class String;
 class IDataSourceStream;
 class IPAddress;
+class TcpServer;
+
+// Stream with data queued by reference, waiting for acknowledge
+struct TcpPinnedStream
+{
+	IDataSourceStream* stream;
+	uint32_t until; // Position in sent data after last referenced byte
+	uint32_t streamUntil; // Position in stream after last referenced byte
+	TcpPinnedStream* next;
+};
 
 class TcpConnection
 {
+	friend class TcpServer;
 public:
 	TcpConnection(bool autoDestruct);
 	TcpConnection(tcp_pcb* connection, bool autoDestruct);
@@ -43,6 +67,10 @@ public:
 	virtual bool connect(String server, int port);
 	virtual bool connect(IPAddress addr, uint16_t port);
 	virtual void close();
+	// Returns closed connection to its state after construction, so server can reuse it
+	virtual void reset();
+	// Waits for next request, server may close it to make room for new connection
+	virtual bool isIdle() { return false; }
 
 	// return -1 on error
 	int writeString(const char* data, uint8_t apiflags = TCP_WRITE_FLAG_COPY);
@@ -50,9 +78,23 @@ public:
 	// return -1 on error
 	virtual int write(const char* data, int len, uint8_t apiflags = TCP_WRITE_FLAG_COPY); // flags: TCP_WRITE_FLAG_COPY, TCP_WRITE_FLAG_MORE
 	int write(IDataSourceStream* stream);
-	__forceinline uint16_t getAvailableWriteSize() { return (canSend && tcp) ? tcp_sndbuf(tcp) : 0; }
+	__forceinline uint16_t getAvailableWriteSize() { return (canSend && tcp && !sendWaiting) ? tcp_sndbuf(tcp) : 0; }
+	// Stream data which can be written now, limited by send budget of scheduled connection
+	int getStreamWriteSize();
+	// Accounts stream data written without write(IDataSourceStream*)
+	void spendSendBudget(int bytes);
 	void flush();
 
+	// Delete stream now or when all data referenced from it is acknowledged
+	void freeStream(IDataSourceStream* stream);
+	__forceinline uint32_t getBytesCopied() { return bytesCopied; }
+	__forceinline uint32_t getBytesReferenced() { return bytesReferenced; }
+
+	// Starts transfer of given class, its latency is recorded by transferCompleted()
+	void setConnectionClass(TcpConnectionClass cls);
+	__forceinline TcpConnectionClass getConnectionClass() { return connectionClass; }
+	void transferCompleted();
+
 	void setTimeOut(uint16_t waitTimeOut);
 	IPAddress getRemoteIp()  { return (tcp == NULL) ? INADDR_NONE : IPAddress(tcp->remote_ip);};
 	uint16_t getRemotePort() { return (tcp == NULL) ? 0 : tcp->remote_port; };
@@ -76,8 +118,13 @@ protected:
 	static void closeTcpConnection(tcp_pcb *tpcb);
 	void initialize(tcp_pcb* pcb);
 
+	bool hasReferencedData();
+	void releasePinnedStreams(bool all);
+	void dropReferencedData();
+
 private:
-	inline void checkSelfFree() { if (tcp == NULL && autoSelfDestruct) delete this; }
+	void checkSelfFree();
+	void releaseAckedData(IDataSourceStream* stream, uint32_t until, uint32_t streamUntil);
 
 protected:
 	tcp_pcb *tcp;
@@ -85,6 +132,26 @@ protected:
 	uint16_t timeOut;
 	bool canSend;
 	bool autoSelfDestruct;
+	TcpServer* owner = NULL; // Server which accepted connection, until it's released
+
+private:
+	uint32_t bytesQueued = 0;
+	uint32_t bytesAcked = 0;
+	uint32_t bytesCopied = 0;
+	uint32_t bytesReferenced = 0;
+	IDataSourceStream* referencedStream = NULL;
+	uint32_t referencedUntil = 0;
+	uint32_t referencedStreamUntil = 0;
+	IDataSourceStream* sendingStream = NULL;
+	uint32_t streamSent = 0; // Bytes taken from sendingStream
+	TcpPinnedStream* pinned = NULL;
+	bool closeAfterAck = false;
+
+	TcpConnectionClass connectionClass = eTCC_Short;
+	uint32_t transferStart = 0;
+	bool scheduled = false; // Stream writes are limited by send budget from server
+	bool sendWaiting = false; // Budget is used up, waiting for next scheduler round
+	uint32_t sendBudget = 0;
 };
 
 #endif /* _SMING_CORE_TCPCONNECTION_H_ */
@@ -13,6 +13,9 @@
 
 int16_t TcpServer::totalConnections = 0;
 
+// Send quantum multiplier of connection classes
+static const uint8_t classWeight[TCP_CONNECTION_CLASSES] = { 4, 2, 1 };
+
 TcpServer::TcpServer() : TcpConnection(false)
 {
 	timeOut = 40;
@@ -50,6 +53,7 @@ TcpServer::TcpServer(TcpClientDataDelegate clientReceiveDataHandler)
 
 TcpServer::~TcpServer()
 {
+	freePool();
 }
 
 TcpConnection* TcpServer::createClient(tcp_pcb *clientTcp)
@@ -82,6 +86,32 @@ void TcpServer::setTimeOut(uint16_t waitTimeOut)
 	timeOut = waitTimeOut;
 }
 
+void TcpServer::setMaxConnections(uint16_t maxClients)
+{
+	if (pool != NULL)
+	{
+		debugf("TcpServer max connections can't be changed after listen");
+		return;
+	}
+	maxConnections = maxClients;
+}
+
+void TcpServer::setSendQuantum(uint16_t bytes)
+{
+	sendQuantum = bytes;
+}
+
+uint32_t TcpServer::getSendQuantum(TcpConnectionClass cls)
+{
+	return sendQuantum * classWeight[cls];
+}
+
+void TcpServer::setAdmissionLimits(uint32_t minFreeHeap, uint32_t maxQueuedBytes)
+{
+	this->minFreeHeap = minFreeHeap;
+	this->maxQueuedBytes = maxQueuedBytes;
+}
+
 bool TcpServer::listen(int port)
 {
 	if (tcp == NULL)
@@ -93,19 +123,26 @@ bool TcpServer::listen(int port)
 	tcp = tcp_listen(tcp);
 	tcp_accept(tcp, staticAccept);
 
+	// Allocate clients while heap isn't fragmented yet
+	if (reuseClients && maxConnections > 0 && pool == NULL)
+	{
+		pool = new TcpConnection*[maxConnections];
+		for (int i = 0; i < maxConnections; i++)
+		{
+			pool[i] = createClient(NULL);
+			if (pool[i] != NULL)
+				pool[i]->autoSelfDestruct = false;
+		}
+		debugf("TcpServer pool: %d clients, free heap %d", maxConnections, system_get_free_heap_size());
+	}
+	sendRoundTimer.initializeUs(TCP_SERVER_SEND_ROUND_US, TimerDelegate(&TcpServer::sendRound, this));
+
 	//stateTimer.initializeMs(3500, list_mem).start();
 	return true;
 }
 
 err_t TcpServer::onAccept(tcp_pcb *clientTcp, err_t err)
 {
-	// Anti DDoS :-)
-	if (system_get_free_heap_size() < 6500)
-	{
-		debugf("\r\n\r\nCONNECTION DROPPED\r\n\t(%d)\r\n\r\n", system_get_free_heap_size());
-		return ERR_MEM;
-	}
-
 	#ifdef NETWORK_DEBUG
 	debugf("onAccept state: %d K=%d", err, totalConnections);
 	list_mem();
@@ -117,17 +154,194 @@ err_t TcpServer::onAccept(tcp_pcb *clientTcp, err_t err)
 		return err;
 	}
 
-	TcpConnection* client = createClient(clientTcp);
-	if (client == NULL) return ERR_MEM;
+	if (maxConnections > 0 && activeClients >= maxConnections && !evictIdleClient())
+	{
+		rejectedClients++;
+		debugf("TcpServer connection refused, %d clients active", activeClients);
+		return ERR_MEM;
+	}
+	if (isOverloaded())
+	{
+		rejectedClients++;
+		debugf("TcpServer connection refused, free heap %d", system_get_free_heap_size());
+		return ERR_MEM;
+	}
+
+	TcpConnection* client = pool != NULL ? acquireClient(clientTcp) : createClient(clientTcp);
+	if (client == NULL)
+	{
+		rejectedClients++;
+		return ERR_MEM;
+	}
+	client->owner = this;
+	if (pool != NULL && sendQuantum > 0)
+	{
+		// Scheduler serves pooled clients only
+		client->scheduled = true;
+		client->sendBudget = getSendQuantum(client->connectionClass);
+	}
+	activeClients++;
+	if (activeClients > peakClients)
+		peakClients = activeClients;
 	client->setTimeOut(timeOut);
 	onClient((TcpClient*)client);
 
 	return ERR_OK;
 }
 
+TcpConnection* TcpServer::acquireClient(tcp_pcb *clientTcp)
+{
+	for (int i = 0; i < maxConnections; i++)
+	{
+		TcpConnection* client = pool[i];
+		if (client != NULL && client->owner == NULL)
+		{
+			client->initialize(clientTcp);
+			return client;
+		}
+	}
+	return NULL;
+}
+
+void TcpServer::releaseClient(TcpConnection* client)
+{
+	client->owner = NULL;
+	activeClients--;
+
+	for (int i = 0; pool != NULL && i < maxConnections; i++)
+	{
+		if (pool[i] == client)
+		{
+			client->reset();
+			return;
+		}
+	}
+	if (client->autoSelfDestruct)
+		delete client;
+}
+
+void TcpServer::freePool()
+{
+	if (pool == NULL) return;
+
+	for (int i = 0; i < maxConnections; i++)
+	{
+		if (pool[i] == NULL) continue;
+		if (pool[i]->owner == NULL)
+			delete pool[i];
+		else
+		{
+			// Still connected, it's deleted when closed
+			pool[i]->owner = NULL;
+			pool[i]->autoSelfDestruct = true;
+			activeClients--;
+		}
+	}
+	delete[] pool;
+	pool = NULL;
+}
+
+bool TcpServer::evictIdleClient()
+{
+	for (int i = 0; pool != NULL && i < maxConnections; i++)
+	{
+		TcpConnection* client = pool[i];
+		// Client with unacknowledged referenced data isn't released on close
+		if (client == NULL || client->owner == NULL || !client->isIdle() || client->hasReferencedData())
+			continue;
+
+		debugf("TcpServer idle client closed for new connection");
+		client->close();
+		client->checkSelfFree();
+		evictedClients++;
+		return true;
+	}
+	return false;
+}
+
+bool TcpServer::isOverloaded()
+{
+	return system_get_free_heap_size() < minFreeHeap || getQueuedBytes() > maxQueuedBytes;
+}
+
+uint32_t TcpServer::getQueuedBytes()
+{
+	uint32_t queued = 0;
+	for (int i = 0; pool != NULL && i < maxConnections; i++)
+	{
+		if (pool[i] != NULL && pool[i]->owner != NULL)
+			queued += pool[i]->bytesQueued - pool[i]->bytesAcked;
+	}
+	return queued;
+}
+
+void TcpServer::requestSendRound()
+{
+	if (roundPending) return;
+	roundPending = true;
+	sendRoundTimer.startOnce();
+}
+
+// Deficit round robin: each client gets quantum of its class every round,
+// clients which used up budget continue with what was left plus the new quantum
+void TcpServer::sendRound()
+{
+	roundPending = false;
+	if (pool == NULL) return;
+
+	// Short responses are served first, then streams and bulk transfers
+	for (int cls = 0; cls < TCP_CONNECTION_CLASSES; cls++)
+	{
+		uint32_t quantum = getSendQuantum((TcpConnectionClass)cls);
+		for (int n = 0; n < maxConnections; n++)
+		{
+			TcpConnection* client = pool[(roundStart + n) % maxConnections];
+			if (client == NULL || client->owner != this || !client->scheduled || client->connectionClass != cls)
+				continue;
+			if (!client->sendWaiting)
+			{
+				client->sendBudget = quantum; // Idle clients don't accumulate budget
+				continue;
+			}
+
+			client->sendBudget += quantum;
+			client->sendWaiting = false;
+			if (client->getAvailableWriteSize() > 0)
+				client->onReadyToSendData(eTCE_Sent);
+			client->checkSelfFree();
+		}
+	}
+	roundStart = (roundStart + 1) % maxConnections;
+}
+
+static uint8_t histogramBucket(uint32_t value, uint32_t first)
+{
+	uint8_t i = 0;
+	while (i < TCP_SERVER_HISTOGRAM_SIZE - 1 && value >= (first << i))
+		i++;
+	return i;
+}
+
+void TcpServer::recordQueue(TcpConnectionClass cls, uint32_t bytes)
+{
+	classStats[cls].queueHistogram[histogramBucket(bytes, 256)]++;
+}
+
+void TcpServer::recordLatency(TcpConnectionClass cls, uint32_t us)
+{
+	classStats[cls].transfers++;
+	classStats[cls].latencyHistogram[histogramBucket(us, 1000)]++;
+}
+
+void TcpServer::resetStats()
+{
+	memset(classStats, 0, sizeof(classStats));
+	peakClients = activeClients;
+	rejectedClients = 0;
+}
+
 void TcpServer::onClient(TcpClient *client)
 {
-	activeClients++;
 	debugf("TcpServer onClient  %s, activeClients = %d\r\n ",client->getRemoteIp().toString().c_str(),activeClients);
 	if (clientConnectDelegate)
 	{
@@ -137,7 +351,6 @@ void TcpServer::onClient(TcpClient *client)
 
 void TcpServer::onClientComplete(TcpClient& client, bool succesfull)
 {
-	activeClients--;
 	debugf("TcpSever onComplete : %s activeClients = %d\r\n",client.getRemoteIp().toString().c_str(),activeClients );
 	if (clientCompleteDelegate)
 	{
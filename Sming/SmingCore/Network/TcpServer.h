@@ -10,6 +10,28 @@
 
 #include "TcpConnection.h"
 #include "TcpClient.h"
+#include "../Timer.h"
+
+// Default max number of simultaneous clients, objects for them are allocated on listen()
+#define TCP_SERVER_MAX_CONNECTIONS 4
+// Bytes bulk transfer may queue per scheduler round, streams get 2x and short responses 4x
+#define TCP_SERVER_SEND_QUANTUM 1460
+// Delay of scheduler round after some connection used up its budget
+#define TCP_SERVER_SEND_ROUND_US 500
+// Default admission limits, new connections are refused below free heap or above unacknowledged bytes
+#define TCP_SERVER_MIN_FREE_HEAP 6500
+#define TCP_SERVER_MAX_QUEUED_BYTES 16384
+
+#define TCP_SERVER_HISTOGRAM_SIZE 8
+
+struct TcpClassStats
+{
+	uint32_t transfers;
+	// Bucket i counts values below (256 << i) bytes, last one the rest
+	uint32_t queueHistogram[TCP_SERVER_HISTOGRAM_SIZE];
+	// Bucket i counts transfers faster than (1 << i) ms, last one the rest
+	uint32_t latencyHistogram[TCP_SERVER_HISTOGRAM_SIZE];
+};
 
 typedef Delegate<void(TcpClient* client)> TcpClientConnectDelegate;
 
@@ -25,6 +47,24 @@ public:
 	virtual bool listen(int port);
 	void setTimeOut(uint16_t waitTimeOut);
 
+	// Connections above the limit are refused, unless an idle client can be closed for them.
+	// Clients are preallocated on listen() and reused, zero disables both. Must be called before listen().
+	void setMaxConnections(uint16_t maxClients);
+	__forceinline uint16_t getMaxConnections() { return maxConnections; }
+	__forceinline uint16_t getPeakConnections() { return peakClients; }
+	__forceinline uint32_t getRejectedConnections() { return rejectedClients; }
+	__forceinline uint32_t getEvictedConnections() { return evictedClients; }
+
+	// Bytes bulk transfer of pooled client may queue per scheduler round, zero disables scheduling
+	void setSendQuantum(uint16_t bytes);
+	// Send budget given to client of that class every round
+	uint32_t getSendQuantum(TcpConnectionClass cls);
+	void setAdmissionLimits(uint32_t minFreeHeap, uint32_t maxQueuedBytes);
+	// Bytes sent by pooled clients and not acknowledged yet
+	uint32_t getQueuedBytes();
+	__forceinline const TcpClassStats& getClassStats(TcpConnectionClass cls) { return classStats[cls]; }
+	void resetStats();
+
 protected:
 	// Overload this method in your derived class!
 	virtual TcpConnection* createClient(tcp_pcb *clientTcp);
@@ -36,6 +76,21 @@ protected:
 
 	static err_t staticAccept(void *arg, tcp_pcb *new_tcp, err_t err);
 
+	TcpConnection* acquireClient(tcp_pcb *clientTcp);
+	void releaseClient(TcpConnection* client);
+	void freePool();
+	bool evictIdleClient();
+
+	bool isOverloaded();
+	void requestSendRound();
+	void sendRound();
+	void recordQueue(TcpConnectionClass cls, uint32_t bytes);
+	void recordLatency(TcpConnectionClass cls, uint32_t us);
+
+protected:
+	// Disabled by servers which clients can't be reset
+	bool reuseClients = true;
+
 public:
 	static int16_t totalConnections;
 	uint16_t activeClients = 0;
@@ -45,6 +100,22 @@ private:
 	TcpClientDataDelegate clientReceiveDelegate = NULL;
 	TcpClientCompleteDelegate clientCompleteDelegate = NULL;
 	TcpClientConnectDelegate clientConnectDelegate = NULL;
+
+	uint16_t maxConnections = TCP_SERVER_MAX_CONNECTIONS;
+	uint16_t peakClients = 0;
+	uint32_t rejectedClients = 0;
+	uint32_t evictedClients = 0;
+	TcpConnection** pool = NULL;
+
+	uint16_t sendQuantum = TCP_SERVER_SEND_QUANTUM;
+	uint32_t minFreeHeap = TCP_SERVER_MIN_FREE_HEAP;
+	uint32_t maxQueuedBytes = TCP_SERVER_MAX_QUEUED_BYTES;
+	Timer sendRoundTimer;
+	bool roundPending = false;
+	uint16_t roundStart = 0; // Pool index served first in its class
+	TcpClassStats classStats[TCP_CONNECTION_CLASSES] = {};
+
+	friend class TcpConnection;
 };
 
 #endif /* _SMING_CORE_TCPSERVER_H_ */
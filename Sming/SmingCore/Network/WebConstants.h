@@ -80,6 +80,7 @@ namespace HttpStatusCode
 	static const char* OK = "200 OK";
 	static const char* SwitchingProtocols = "101 Switching Protocols";
 	static const char* Found = "302 Found";
+	static const char* NotModified = "304 Not Modified";
 
 	static const char* BadRequest = "400 Bad Request";
 	static const char* NotFound = "404 Not Found";
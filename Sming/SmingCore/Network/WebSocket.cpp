@@ -6,6 +6,7 @@
  ****/
 
 #include "WebSocket.h"
+#include "HttpServer.h"
 #include "../../Services/WebHelpers/aw-sha1.h"
 #include "../../Services/WebHelpers/base64.h"
 
@@ -29,29 +30,344 @@ bool WebSocket::initialize(HttpRequest& request, HttpResponse& response)
 	sha1(data, hash.c_str(), hash.length());
 	base64_encode(SHA1_SIZE, data, SHA1_SIZE * 4, secure);
 	response.switchingProtocols();
-	response.setHeader("Connection", "Upgrade");
-	response.setHeader("Upgrade", "websocket");
+	response.setHeader(eHRH_Connection, "Upgrade");
+	response.setHeader(eHRH_Upgrade, "websocket");
 	response.setHeader("Sec-WebSocket-Accept", secure);
 	return true;
 }
 
-void WebSocket::send(const char* message, int length, wsFrameType type)
+bool WebSocket::send(const char* message, int length, wsFrameType type)
 {
-	uint8_t frameHeader[16] = {0};
-	size_t headSize = sizeof(frameHeader);
-	wsMakeFrame(nullptr, length, frameHeader, &headSize, type);
-	connection->write((char*)frameHeader, headSize, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE);
-	connection->writeString(message, TCP_WRITE_FLAG_COPY);
+	if (connection == NULL)
+		return false; // Closed while its frame is processed
+
+	uint8_t frame[WS_MAX_HEADER_LENGTH + WEB_SOCKET_COALESCE_SIZE];
+	size_t headSize = WS_MAX_HEADER_LENGTH;
+	wsMakeFrame(nullptr, length, frame, &headSize, type);
+
+	// Frame must be queued whole, partially written frame would break the stream.
+	// Frames already waiting in queue must go first.
+	if (connection->getWebSocketQueueDepth() > 0 || connection->getAvailableWriteSize() < headSize + length)
+	{
+		WebSocketSharedFrame* shared = WebSocketSharedFrame::create(message, length, type);
+		if (shared == NULL)
+			return false;
+		bool queued = connection->queueWebSocketFrame(shared, false);
+		shared->release();
+		if (!queued)
+			debugf("WS send: queue is full");
+		return queued;
+	}
+
+	if (length <= WEB_SOCKET_COALESCE_SIZE)
+	{
+		// Header and payload in one write
+		memcpy(frame + headSize, message, length);
+		if (connection->write((char*)frame, headSize + length, TCP_WRITE_FLAG_COPY) < 0)
+			return false;
+	}
+	else
+	{
+		// lwIP joins both parts into the same segment
+		if (connection->write((char*)frame, headSize, TCP_WRITE_FLAG_COPY | TCP_WRITE_FLAG_MORE) < 0)
+			return false;
+		if (connection->write(message, length, TCP_WRITE_FLAG_COPY) < 0)
+		{
+			debugf("WS send: frame is broken");
+			connection->close();
+			return false;
+		}
+	}
 	connection->flush();
+	return true;
+}
+
+bool WebSocket::sendString(const String& message)
+{
+	return send(message.c_str(), message.length());
+}
+
+bool WebSocket::sendBinary(const uint8_t* data, int size)
+{
+	return send((char*)data, size, WS_BINARY_FRAME);
+}
+
+
+void WebSocket::sendClose(uint16_t status)
+{
+	char payload[2] = { (char)(status >> 8), (char)(status & 0xFF) };
+	send(payload, sizeof(payload), WS_CLOSING_FRAME);
+}
+
+bool WebSocket::processData(uint8_t* data, size_t size)
+{
+	while (size > 0)
+	{
+		if (headerPos < headerLength)
+		{
+			size_t len = min(size, (size_t)(headerLength - headerPos));
+			memcpy(header + headerPos, data, len);
+			headerPos += len;
+			data += len;
+			size -= len;
+
+			if (headerPos == 2)
+			{
+				// Now we know the length of the whole header
+				uint8_t length = header[1] & 0x7F;
+				headerLength = 2 + 4 + (length == 126 ? 2 : length == 127 ? 8 : 0);
+			}
+			if (headerPos < headerLength)
+				continue;
+
+			if (!beginFrame())
+				return false;
+			// Handlers may close connection, nothing more is decoded then
+			if (payloadLength == 0 && (!endFrame() || connection == NULL))
+				return false;
+			continue;
+		}
+
+		size_t len = size;
+		if (payloadLength - payloadPos < len)
+			len = payloadLength - payloadPos;
+		wsMaskData(data, len, header + headerLength - 4, (size_t)payloadPos);
+		size_t pos = payloadPos;
+		payloadPos += len;
+		if (!processPayload(data, len, pos) || connection == NULL)
+			return false;
+		data += len;
+		size -= len;
+
+		if (payloadPos == payloadLength && (!endFrame() || connection == NULL))
+			return false;
+	}
+
+	return true;
+}
+
+bool WebSocket::beginFrame()
+{
+	frameFin = (header[0] & 0x80) != 0;
+	frameOpcode = header[0] & 0x0F;
+	payloadPos = 0;
+
+	if ((header[0] & 0x70) != 0 || (header[1] & 0x80) == 0)
+	{
+		// No extensions negotiated and client frames must be masked
+		debugf("WS invalid frame header");
+		sendClose(WEB_SOCKET_CLOSE_PROTOCOL_ERROR);
+		return false;
+	}
+
+	uint8_t length = header[1] & 0x7F;
+	if (length == 126)
+		payloadLength = (header[2] << 8) | header[3];
+	else if (length == 127)
+	{
+		payloadLength = 0;
+		for (int i = 2; i < 10; i++)
+			payloadLength = (payloadLength << 8) | header[i];
+		if (payloadLength >> 63)
+		{
+			sendClose(WEB_SOCKET_CLOSE_PROTOCOL_ERROR);
+			return false;
+		}
+	}
+	else
+		payloadLength = length;
+
+	if (frameOpcode >= WS_CLOSING_FRAME)
+	{
+		// Control frames can be injected in the middle of fragmented message
+		bool valid = frameOpcode == WS_CLOSING_FRAME || frameOpcode == WS_PING_FRAME || frameOpcode == WS_PONG_FRAME;
+		if (!valid || !frameFin || payloadLength > WEB_SOCKET_MAX_CONTROL_LENGTH)
+		{
+			debugf("WS invalid control frame: %X", frameOpcode);
+			sendClose(WEB_SOCKET_CLOSE_PROTOCOL_ERROR);
+			return false;
+		}
+		return true;
+	}
+
+	if (frameOpcode == WEB_SOCKET_CONTINUATION_FRAME)
+	{
+		if (messageOpcode == 0)
+		{
+			debugf("WS unexpected continuation frame");
+			sendClose(WEB_SOCKET_CLOSE_PROTOCOL_ERROR);
+			return false;
+		}
+	}
+	else if (messageOpcode != 0 || (frameOpcode != WS_TEXT_FRAME && frameOpcode != WS_BINARY_FRAME))
+	{
+		debugf("WS unexpected frame: %X", frameOpcode);
+		sendClose(WEB_SOCKET_CLOSE_PROTOCOL_ERROR);
+		return false;
+	}
+	else
+	{
+		messageOpcode = frameOpcode;
+		messageLength = 0;
+		messageDelivered = false;
+		message = "";
+	}
+
+	bool streamed = messageOpcode == WS_BINARY_FRAME && server && server->wsBinaryStream;
+	if (!streamed)
+	{
+		if (payloadLength > WEB_SOCKET_MAX_MESSAGE_LENGTH - messageLength)
+		{
+			debugf("WS message is too big");
+			sendClose(WEB_SOCKET_CLOSE_TOO_BIG);
+			return false;
+		}
+		if (frameFin && !message.reserve(messageLength + payloadLength))
+		{
+			sendClose(WEB_SOCKET_CLOSE_TOO_BIG);
+			return false;
+		}
+	}
+	messageLength += payloadLength;
+
+	return true;
+}
+
+bool WebSocket::processPayload(uint8_t* data, size_t size, size_t pos)
+{
+	if (frameOpcode >= WS_CLOSING_FRAME)
+	{
+		memcpy(control + pos, data, size);
+		return true;
+	}
+
+	// Handlers are called last, decoder state is updated before them
+	if (messageOpcode == WS_BINARY_FRAME && server && server->wsBinaryStream)
+	{
+		bool finished = frameFin && payloadPos == payloadLength;
+		messageDelivered = finished;
+		server->wsBinaryStream(*this, data, size, finished);
+		return true;
+	}
+
+	if (messageOpcode == WS_BINARY_FRAME && message.length() == 0 && frameFin && size == payloadLength)
+	{
+		// The whole message is here, no need to copy it
+		messageDelivered = true;
+		if (server && server->wsBinary)
+			server->wsBinary(*this, data, size);
+		return true;
+	}
+
+	return message.concat((const char*)data, size);
+}
+
+bool WebSocket::endFrame()
+{
+	headerPos = 0;
+	headerLength = 2;
+
+	if (frameOpcode == WS_PING_FRAME)
+	{
+		send((const char*)control, payloadLength, WS_PONG_FRAME);
+		return true;
+	}
+	if (frameOpcode == WS_PONG_FRAME)
+		return true;
+	if (frameOpcode == WS_CLOSING_FRAME)
+	{
+		debugf("WS closing frame");
+		// Echo status code and close, it will be processed automatically in HttpServer::onCloseWebSocket
+		send((const char*)control, payloadLength >= 2 ? 2 : 0, WS_CLOSING_FRAME);
+		return false;
+	}
+
+	if (!frameFin)
+		return true;
+
+	uint8_t opcode = messageOpcode;
+	messageOpcode = 0;
+	if (messageDelivered)
+		return true;
+
+	// Memory is released after handler, until next fragmented message
+	String received(static_cast<String&&>(message));
+	if (server != NULL)
+	{
+		if (opcode == WS_TEXT_FRAME)
+		{
+			debugf("WS: %s", received.c_str());
+			if (server->wsMessage)
+				server->wsMessage(*this, received);
+		}
+		else if (server->wsBinaryStream)
+			server->wsBinaryStream(*this, NULL, 0, true); // Empty final fragment
+		else if (server->wsBinary)
+			server->wsBinary(*this, (uint8_t*)received.c_str(), received.length());
+	}
+	return true;
+}
+
+WebSocketSharedFrame* WebSocketSharedFrame::create(const char* message, int length, wsFrameType type)
+{
+	uint8_t header[WS_MAX_HEADER_LENGTH];
+	size_t headSize = sizeof(header);
+	wsMakeFrame(nullptr, length, header, &headSize, type);
+	if (headSize + length > 0xFFFF)
+	{
+		debugf("WS frame is too big to be queued");
+		return NULL;
+	}
+
+	char* data = new char[headSize + length];
+	if (data == NULL)
+		return NULL;
+	memcpy(data, header, headSize);
+	memcpy(data + headSize, message, length);
+
+	WebSocketSharedFrame* frame = new WebSocketSharedFrame();
+	frame->references = 1;
+	frame->length = headSize + length;
+	frame->data = data;
+	return frame;
 }
 
-void WebSocket::sendString(const String& message)
+void WebSocketSharedFrame::release()
 {
-	send(message.c_str(), message.length());
+	if (--references > 0)
+		return;
+	delete[] data;
+	delete this;
 }
 
-void WebSocket::sendBinary(const uint8_t* data, int size)
+WebSocketFrameStream::WebSocketFrameStream(WebSocketSharedFrame* sharedFrame)
+	: frame(sharedFrame)
 {
-	send((char*)data, size, WS_BINARY_FRAME);
+	frame->references++;
 }
 
+WebSocketFrameStream::~WebSocketFrameStream()
+{
+	frame->release();
+}
+
+uint16_t WebSocketFrameStream::readMemoryBlock(char* data, int bufSize)
+{
+	int len = min(bufSize, available());
+	memcpy(data, frame->data + pos, len);
+	return len;
+}
+
+bool WebSocketFrameStream::seek(int len)
+{
+	if (len < 0 || len > available())
+		return false;
+	pos += len;
+	return true;
+}
+
+uint16_t WebSocketFrameStream::getDirectBlock(const char*& data)
+{
+	data = frame->data + pos;
+	return available();
+}
@@ -13,25 +13,111 @@
 #include "../../Wiring/WHashMap.h"
 #include "../../Wiring/WVector.h"
 #include "../Delegate.h"
+#include "../DataSourceStream.h"
 #include "../../Services/cWebsocket/websocket.h"
 
+// Max length of reassembled message, longer messages close the connection.
+// Binary messages received by a binary stream handler aren't limited.
+#define WEB_SOCKET_MAX_MESSAGE_LENGTH 4096
+// Control frames can't have longer payload
+#define WEB_SOCKET_MAX_CONTROL_LENGTH 125
+
+// Frames with payload up to this size are built in one buffer and written at once
+#define WEB_SOCKET_COALESCE_SIZE 256
+
+#define WEB_SOCKET_CONTINUATION_FRAME 0x00
+
+// Close status codes
+#define WEB_SOCKET_CLOSE_NORMAL 1000
+#define WEB_SOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define WEB_SOCKET_CLOSE_TOO_BIG 1009
+
 class HttpServer;
 
+// Encoded frame, shared by all connections it is queued on
+struct WebSocketSharedFrame
+{
+	static WebSocketSharedFrame* create(const char* message, int length, wsFrameType type);
+	void release();
+
+	uint16_t references;
+	uint16_t length;
+	char* data;
+};
+
+// Frame waiting in connection queue. Data is queued to TCP by reference,
+// so the stream is pinned by the connection until it is acknowledged.
+class WebSocketFrameStream : public IDataSourceStream
+{
+public:
+	WebSocketFrameStream(WebSocketSharedFrame* sharedFrame);
+	virtual ~WebSocketFrameStream();
+
+	virtual StreamType getStreamType() { return eSST_User; }
+	virtual uint16_t readMemoryBlock(char* data, int bufSize);
+	virtual bool seek(int len);
+	virtual bool isFinished() { return pos >= frame->length; }
+	virtual int available() { return frame->length - pos; }
+	virtual uint16_t getDirectBlock(const char*& data);
+
+	__forceinline bool isStarted() { return pos > 0; }
+
+private:
+	WebSocketSharedFrame* frame;
+	uint16_t pos = 0;
+};
+
 class WebSocket
 {
 	friend class HttpServer;
 public:
 	WebSocket(HttpServerConnection* conn);
-	virtual void send(const char* message, int length, wsFrameType type = WS_TEXT_FRAME);
-	void sendString(const String& message);
-	void sendBinary(const uint8_t* data, int size);
+	// Returns false when frame can't be queued now
+	virtual bool send(const char* message, int length, wsFrameType type = WS_TEXT_FRAME);
+	bool sendString(const String& message);
+	bool sendBinary(const uint8_t* data, int size);
+
+	// Frames waiting for free space in send buffer
+	__forceinline uint8_t getQueueDepth() { return connection ? connection->getWebSocketQueueDepth() : 0; }
+	// Broadcasted frames dropped because the client didn't keep up
+	__forceinline uint32_t getDroppedFrames() { return connection ? connection->getWebSocketDroppedFrames() : 0; }
+	// Connection was closed, socket is removed when received frame is processed
+	__forceinline bool isClosed() { return connection == NULL; }
 
 protected:
 	bool initialize(HttpRequest &request, HttpResponse &response);
 	bool is(HttpServerConnection* conn) { return connection == conn; }
 
+	// Feeds received data to frame decoder. Frames may be split at any point
+	// and one call may contain several frames. Payload is unmasked in place.
+	// Returns false when connection must be closed, or was closed by a handler.
+	bool processData(uint8_t* data, size_t size);
+
+private:
+	bool beginFrame();
+	bool processPayload(uint8_t* data, size_t size, size_t pos);
+	bool endFrame();
+	void sendClose(uint16_t status);
+
 private:
 	HttpServerConnection* connection;
+	HttpServer* server = NULL;
+
+	// Frame header: 2 bytes, up to 8 bytes of extended length and masking key
+	uint8_t header[14];
+	uint8_t headerPos = 0;
+	uint8_t headerLength = 2;
+	uint8_t frameOpcode = 0;
+	bool frameFin = false;
+	uint64_t payloadLength = 0;
+	uint64_t payloadPos = 0;
+
+	// Opcode of fragmented message in progress, or zero
+	uint8_t messageOpcode = 0;
+	uint32_t messageLength = 0;
+	bool messageDelivered = false;
+	String message;
+	uint8_t control[WEB_SOCKET_MAX_CONTROL_LENGTH];
 };
 
 #endif /* SMINGCORE_NETWORK_WEBSOCKET_H_ */
@@ -19,6 +19,7 @@
 #include "Digital.h"
 #include "ESP8266EX.h"
 #include "FileSystem.h"
+#include "FlashLog.h"
 #include "HardwareSerial.h"
 #include "Interrupts.h"
 #include "PWM.h"
@@ -37,6 +38,7 @@
 #include "Network/HttpServer.h"
 #include "Network/HttpRequest.h"
 #include "Network/HttpResponse.h"
+#include "Network/HttpStaticFiles.h"
 #include "Network/FTPServer.h"
 #include "Network/NetUtils.h"
 #include "Network/TcpClient.h"
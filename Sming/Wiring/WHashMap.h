@@ -19,8 +19,79 @@
 #define HASHMAP_H
 
 #include "Countable.h"
+#include "WString.h"
 
-template<typename K, typename V>
+/*
+|| @description
+|| | Hash functions used by HashMap. Add an overload for your own key type
+|| | or pass a hasher class as third HashMap template parameter.
+|| | Enums and pointers are hashed by value. Other keys without a hash
+|| | function still work, but lookups become linear.
+|| #
+*/
+template<bool B, typename T = void> struct HashMapEnableIf {};
+template<typename T> struct HashMapEnableIf<true, T> { typedef T type; };
+template<typename T> struct HashMapIsEnum { static const bool value = __is_enum(T); };
+
+template<typename T>
+inline typename HashMapEnableIf<HashMapIsEnum<T>::value, uint32_t>::type hashMapHash(const T& key)
+{
+  return (uint32_t)key * 2654435761u;
+}
+
+template<typename T>
+inline typename HashMapEnableIf<!HashMapIsEnum<T>::value, uint32_t>::type hashMapHash(const T& key)
+{
+  return 0;
+}
+
+template<typename T>
+inline uint32_t hashMapHash(T* const& key)
+{
+  // Low bits of aligned pointers are zero, fold high bits of product into them
+  uint32_t hash = (uint32_t)(uintptr_t)key * 2654435761u;
+  return hash ^ (hash >> 16);
+}
+
+inline uint32_t hashMapHash(const String& key)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  const char* p = key.c_str();
+  for (unsigned int i = 0; i < key.length(); i++)
+  {
+    hash = (hash ^ (uint8_t)p[i]) * 16777619u;
+  }
+  return hash;
+}
+
+inline uint32_t hashMapHash(const long& key) { return (uint32_t)key * 2654435761u; }
+inline uint32_t hashMapHash(const unsigned long& key) { return (uint32_t)key * 2654435761u; }
+inline uint32_t hashMapHash(const int& key) { return (uint32_t)key * 2654435761u; }
+inline uint32_t hashMapHash(const unsigned int& key) { return (uint32_t)key * 2654435761u; }
+inline uint32_t hashMapHash(const short& key) { return (uint32_t)key * 2654435761u; }
+inline uint32_t hashMapHash(const unsigned short& key) { return (uint32_t)key * 2654435761u; }
+inline uint32_t hashMapHash(const char& key) { return (uint32_t)key * 2654435761u; }
+inline uint32_t hashMapHash(const unsigned char& key) { return (uint32_t)key * 2654435761u; }
+
+template<typename K>
+struct HashMapHasher
+{
+  uint32_t operator()(const K& key) const
+  {
+    return hashMapHash(key);
+  }
+};
+
+/*
+|| @description
+|| | Keys and values are stored inline in insertion order, so keyAt()/valueAt()
+|| | indexes are stable. An open addressing table (linear probing) of entry
+|| | indexes is used for lookups.
+|| | Note: references returned by operator[] are valid until next insertion.
+|| #
+*/
+template<typename K, typename V, typename H = HashMapHasher<K> >
 class HashMap
 {
   public:
@@ -32,6 +103,7 @@ class HashMap
     || #
     ||
     || @parameter compare optional function for comparing a key against another (for complex types)
+    ||            hash isn't used in this case, lookups are linear
     */
     HashMap(comparator compare = 0)
     {
@@ -40,6 +112,9 @@ class HashMap
       size = 0;
       keys = NULL;
       values = NULL;
+      hashes = NULL;
+      buckets = NULL;
+      bucketsCount = 0;
     }
 
     ~HashMap()
@@ -68,9 +143,9 @@ class HashMap
     ||
     || @return The key at index idx
     */
-    K keyAt(unsigned int idx) const
+    const K& keyAt(unsigned int idx) const
     {
-      return *keys[idx];
+      return keys[idx];
     }
 
     /*
@@ -82,16 +157,15 @@ class HashMap
     ||
     || @return The value at index idx
     */
-    V valueAt(unsigned int idx) const
+    const V& valueAt(unsigned int idx) const
     {
-      return *values[idx];
+      return values[idx];
     }
 
     /*
     || @description
-    || | An indexer for accessing and assigning a value to a key
-    || | If a key is used that exists, it returns the value for that key
-    || | If there exists no value for that key, the key is added
+    || | An indexer for accessing a value of a key
+    || | If there exists no value for that key, null value is returned
     || #
     ||
     || @parameter key the key to get the value for
@@ -100,7 +174,8 @@ class HashMap
     */
     const V& operator[](const K key) const
     {
-      return operator[](key);
+      int index = indexOf(key);
+      return index < 0 ? nil : values[index];
     }
 
     /*
@@ -116,47 +191,49 @@ class HashMap
     */
     V& operator[](const K key)
     {
-      if (contains(key))
+      uint32_t hash = hasher(key);
+      int index = find(key, hash);
+      if (index >= 0)
       {
-        return *values[indexOf(key)];
+        return values[index];
       }
       if (currentIndex >= size)
       {
-    	  allocate(currentIndex + 1);
+    	  // Entry count and index in buckets are 16 bit
+    	  allocate(min(currentIndex + (currentIndex >> 1) + 2, INT16_MAX));
       }
-      *keys[currentIndex] = key;
-      *values[currentIndex] = nil;
-      currentIndex++;
-      return *values[currentIndex - 1];
+      index = currentIndex++;
+      keys[index] = key;
+      values[index] = nil;
+      hashes[index] = (uint16_t)hash;
+      link(index);
+      return values[index];
     }
 
     void allocate(int newSize)
     {
     	if (newSize <= size) return;
 
-    	K** nkeys = new K*[newSize];
-    	V** nvalues = new V*[newSize];
+    	K* nkeys = new K[newSize];
+    	V* nvalues = new V[newSize];
+    	uint16_t* nhashes = new uint16_t[newSize];
 
-    	if (keys != NULL)
+    	for (int i = 0; i < currentIndex; i++)
     	{
-			for (int i = 0; i < size; i++)
-			{
-				nkeys[i] = keys[i];
-				nvalues[i] = values[i];
-			}
-
-			delete[] keys;
-			delete[] values;
+    		nkeys[i] = static_cast<K&&>(keys[i]);
+    		nvalues[i] = static_cast<V&&>(values[i]);
+    		nhashes[i] = hashes[i];
     	}
-		for (int i = size; i < newSize; i++)
-		{
-			nkeys[i] = new K();
-			nvalues[i] = new V();
-		}
 
+    	delete[] keys;
+    	delete[] values;
+    	delete[] hashes;
     	keys = nkeys;
     	values = nvalues;
+    	hashes = nhashes;
     	size = newSize;
+
+    	rebuild();
     }
 
     /*
@@ -168,26 +245,9 @@ class HashMap
     ||
     || @return The index of the key, or -1 if key does not exist
     */
-    unsigned int indexOf(K key) const
+    int indexOf(K key) const
     {
-      for (int i = 0; i < currentIndex; i++)
-      {
-        if (cb_comparator)
-        {
-          if (cb_comparator(key, *keys[i]))
-          {
-            return i;
-          }
-        }
-        else
-        {
-          if (key == *keys[i])
-          {
-            return i;
-          }
-        }
-      }
-      return -1;
+      return find(key, hasher(key));
     }
 
     /*
@@ -201,29 +261,12 @@ class HashMap
     */
     bool contains(K key) const
     {
-      for (int i = 0; i < currentIndex; i++)
-      {
-        if (cb_comparator)
-        {
-          if (cb_comparator(key, *keys[i]))
-          {
-            return true;
-          }
-        }
-        else
-        {
-          if (key == *keys[i])
-          {
-            return true;
-          }
-        }
-      }
-      return false;
+      return indexOf(key) >= 0;
     }
 
     /*
     || @description
-    || | Check if a key is contained within this HashMap
+    || | Remove a key from this HashMap, order of remaining keys is kept
     || #
     ||
     || @parameter key the key to remove from this HashMap
@@ -231,38 +274,62 @@ class HashMap
     void remove(K key)
     {
       int index = indexOf(key);
-      if (contains(key))
+      if (index < 0) return;
+
+      for (int i = index; i < currentIndex - 1; i++)
       {
-        for (int i = index; i < size - 1; i++)
-        {
-          *keys[i] = *keys[i + 1];
-          *values[i] = *values[i + 1];
-        }
-        currentIndex--;
+        keys[i] = static_cast<K&&>(keys[i + 1]);
+        values[i] = static_cast<V&&>(values[i + 1]);
+        hashes[i] = hashes[i + 1];
       }
+      currentIndex--;
+      keys[currentIndex] = K();
+      values[currentIndex] = nil;
+      rebuild();
     }
 
+    /*
+    || @description
+    || | Remove all keys, but keep allocated storage for next ones
+    || #
+    */
+    void reset()
+    {
+      for (int i = 0; i < currentIndex; i++)
+      {
+        keys[i] = K();
+        values[i] = nil;
+      }
+      currentIndex = 0;
+      if (bucketsCount > 0)
+      {
+        memset(buckets, 0, bucketsCount * sizeof(uint16_t));
+      }
+    }
+
+    /*
+    || @description
+    || | Remove all keys and free storage
+    || #
+    */
     void clear()
     {
-    	if (keys != NULL)
-    	{
-    		for (int i = 0; i < size; i++)
-			{
-				delete keys[i];
-				delete values[i];
-			}
-			delete[] keys;
-			delete[] values;
-			keys = NULL;
-			values = NULL;
-    	}
+    	delete[] keys;
+    	delete[] values;
+    	delete[] hashes;
+    	delete[] buckets;
+    	keys = NULL;
+    	values = NULL;
+    	hashes = NULL;
+    	buckets = NULL;
+    	bucketsCount = 0;
     	currentIndex = 0;
     	size = 0;
     }
 
-    void setMultiple(const HashMap<K, V>& map)
+    void setMultiple(const HashMap<K, V, H>& map)
     {
-    	for (int i = 0; i < map.count(); i++)
+    	for (unsigned int i = 0; i < map.count(); i++)
     	{
     		(*this)[map.keyAt(i)] = map.valueAt(i);
     	}
@@ -273,16 +340,84 @@ class HashMap
       nil = nullv;
     }
 
+  private:
+    int find(const K& key, uint32_t hash) const
+    {
+      if (cb_comparator)
+      {
+        for (int i = 0; i < currentIndex; i++)
+        {
+          if (cb_comparator(key, keys[i]))
+          {
+            return i;
+          }
+        }
+        return -1;
+      }
+
+      if (bucketsCount == 0) return -1;
+
+      uint32_t mask = bucketsCount - 1;
+      for (uint32_t b = hash & mask; buckets[b] != 0; b = (b + 1) & mask)
+      {
+        int i = buckets[b] - 1;
+        if (hashes[i] == (uint16_t)hash && keys[i] == key)
+        {
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    void link(int index)
+    {
+      if (cb_comparator) return;
+
+      uint32_t mask = bucketsCount - 1;
+      uint32_t b = hashes[index] & mask;
+      while (buckets[b] != 0)
+      {
+        b = (b + 1) & mask;
+      }
+      buckets[b] = index + 1;
+    }
+
+    void rebuild()
+    {
+      if (cb_comparator) return;
+
+      // Keep load factor at or below 1/2, up to 65536 buckets for 32767 entries
+      // which are all reached by 16 bits of stored hashes
+      uint32_t count = 4;
+      while (count < (uint32_t)size * 2 && count < 0x10000) count <<= 1;
+      if (count != bucketsCount)
+      {
+        delete[] buckets;
+        buckets = new uint16_t[count];
+        bucketsCount = count;
+      }
+      memset(buckets, 0, count * sizeof(uint16_t));
+      for (int i = 0; i < currentIndex; i++)
+      {
+        link(i);
+      }
+    }
+
   protected:
-    K **keys;
-    V **values;
+    K *keys;
+    V *values;
     V nil;
     int16_t currentIndex;
     int16_t size;
     comparator cb_comparator;
 
   private:
-    HashMap(const HashMap<K, V>& that);
+    uint16_t* hashes; // Low bits of key hashes
+    uint16_t* buckets; // Entry index + 1, zero for empty bucket
+    uint32_t bucketsCount;
+    H hasher;
+
+    HashMap(const HashMap<K, V, H>& that);
 };
 
 #endif
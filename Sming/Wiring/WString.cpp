@@ -41,6 +41,12 @@ String::String(const String &value)
   *this = value;
 }
 
+String::String(const StringView &view)
+{
+  init();
+  if (view.data()) copy(view.data(), view.length());
+}
+
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
 String::String(String &&rval)
 {
@@ -119,7 +125,7 @@ String::String(double value, unsigned char decimalPlaces)
 
 String::~String()
 {
-	free(buffer);
+	if (!isInline()) free(buffer);
 }
 
 void String::setString(const char *cstr, int length /* = -1 */)
@@ -146,7 +152,7 @@ inline void String::init(void)
 
 void String::invalidate(void)
 {
-  if (buffer) free(buffer);
+  if (buffer && !isInline()) free(buffer);
   buffer = NULL;
   capacity = len = 0;
 }
@@ -164,7 +170,21 @@ unsigned char String::reserve(unsigned int size)
 
 unsigned char String::changeBuffer(unsigned int maxStrLen)
 {
-  char *newbuffer = (char *)realloc(buffer, maxStrLen + 1);
+  if (STRING_SSO_CAPACITY > 0 && maxStrLen <= STRING_SSO_CAPACITY && (buffer == NULL || isInline()))
+  {
+    buffer = sso;
+    capacity = STRING_SSO_CAPACITY;
+    return 1;
+  }
+
+  char *newbuffer;
+  if (isInline())
+  {
+    newbuffer = (char *)malloc(maxStrLen + 1);
+    if (newbuffer) memcpy(newbuffer, sso, len + 1);
+  }
+  else
+    newbuffer = (char *)realloc(buffer, maxStrLen + 1);
   if (newbuffer)
   {
     buffer = newbuffer;
@@ -186,7 +206,7 @@ String & String::copy(const char *cstr, unsigned int length)
     return *this;
   }
   len = length;
-  strncpy(buffer, cstr, length);
+  memmove(buffer, cstr, length);
   buffer[length] = 0;
   return *this;
 }
@@ -194,7 +214,14 @@ String & String::copy(const char *cstr, unsigned int length)
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
 void String::move(String &rhs)
 {
-  if (buffer)
+  if (rhs.isInline())
+  {
+    // Inline data can't be taken over, copy it
+    copy(rhs.buffer, rhs.len);
+    rhs.invalidate();
+    return;
+  }
+  if (buffer && !isInline())
 	  free(buffer);
   buffer = rhs.buffer;
   capacity = rhs.capacity;
@@ -252,8 +279,9 @@ unsigned char String::concat(const char *cstr, unsigned int length)
   if (!cstr) return 0;
   if (length == 0) return 1;
   if (!reserve(newlen)) return 0;
-  strcpy(buffer + len, cstr);
+  memcpy(buffer + len, cstr, length);
   len = newlen;
+  buffer[len] = 0;
   return 1;
 }
 
@@ -594,10 +622,7 @@ String String::substring(unsigned int left, unsigned int right) const
   String out;
   if (left > len) return out;
   if (right > len) right = len;
-  char temp = buffer[right];  // save the replaced character
-  buffer[right] = '\0';
-  out = buffer + left;  // pointer arithmetic
-  buffer[right] = temp;  //restore character
+  out.copy(buffer + left, right - left);
   return out;
 }
 
@@ -708,7 +733,7 @@ void String::trim(void)
   char *end = buffer + len - 1;
   while (isspace(*end) && end >= begin) end--;
   len = end + 1 - begin;
-  if (begin > buffer) memcpy(buffer, begin, len);
+  if (begin > buffer) memmove(buffer, begin, len);
   buffer[len] = 0;
 }
 
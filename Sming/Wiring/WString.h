@@ -34,9 +34,16 @@
 //     -felide-constructors
 //     -std=c++0x
 
+// Strings up to this length are stored inside the object, without heap allocation.
+// 0 keeps every String on heap.
+#ifndef STRING_SSO_CAPACITY
+#define STRING_SSO_CAPACITY 11
+#endif
+
 // An inherited class for holding the result of a concatenation.  These
 // result objects are assumed to be writable by subsequent concatenations.
 class StringSumHelper;
+class StringView;
 
 // The string class
 class String
@@ -56,6 +63,7 @@ class String
     IRAM_ATTR String(const char *cstr = "");
     IRAM_ATTR String(const char *cstr, unsigned int length);
     IRAM_ATTR String(const String &str);
+    explicit String(const StringView &view);
 #ifdef __GXX_EXPERIMENTAL_CXX0X__
     IRAM_ATTR String(String && rval);
     IRAM_ATTR String(StringSumHelper && rval);
@@ -99,6 +107,7 @@ class String
     // concatenation is considered unsucessful.
     unsigned char concat(const String &str);
     unsigned char concat(const char *cstr);
+    unsigned char IRAM_ATTR concat(const char *cstr, unsigned int length);
     unsigned char concat(char c);
     unsigned char concat(unsigned char c);
     unsigned char concat(int num);
@@ -254,11 +263,12 @@ class String
     uint16_t capacity;  // the array length minus one (for the '\0')
     uint16_t len;       // the String length (not counting the '\0')
     //unsigned char flags;    // unused, for future features
+    char sso[STRING_SSO_CAPACITY + 1]; // buffer points here for short strings
   protected:
+    bool isInline() const { return buffer == sso; }
     void IRAM_ATTR init(void);
     void IRAM_ATTR invalidate(void);
     unsigned char IRAM_ATTR changeBuffer(unsigned int maxStrLen);
-    unsigned char IRAM_ATTR concat(const char *cstr, unsigned int length);
 
     // copy and move
     String & copy(const char *cstr, unsigned int length);
@@ -282,6 +292,79 @@ class StringSumHelper : public String
     StringSumHelper(double num) : String(num) {}
 };
 
+// Non-owning reference to a part of a string or network buffer.
+// Data is not zero terminated and must outlive the view.
+class StringView
+{
+  public:
+    StringView() : ptr(NULL), len(0) {}
+    StringView(const char *data, unsigned int length) : ptr(data), len(length) {}
+    StringView(const char *cstr) : ptr(cstr), len(cstr ? strlen(cstr) : 0) {}
+    StringView(const String &str) : ptr(str.c_str()), len(str.length()) {}
+
+    const char *data() const { return ptr; }
+    unsigned int length() const { return len; }
+    bool isNull() const { return ptr == NULL; }
+    char operator [](unsigned int index) const { return ptr[index]; }
+
+    bool equals(const char *cstr, unsigned int length) const
+    {
+      return len == length && (len == 0 || memcmp(ptr, cstr, len) == 0);
+    }
+    bool equals(const StringView &view) const { return equals(view.ptr, view.len); }
+    bool equalsIgnoreCase(const StringView &view) const
+    {
+      if (len != view.len) return false;
+      for (unsigned int i = 0; i < len; i++)
+      {
+        if (tolower(ptr[i]) != tolower(view.ptr[i])) return false;
+      }
+      return true;
+    }
+    bool operator == (const StringView &view) const { return equals(view); }
+    bool operator != (const StringView &view) const { return !equals(view); }
+    bool startsWith(const StringView &prefix) const
+    {
+      return prefix.len <= len && memcmp(ptr, prefix.ptr, prefix.len) == 0;
+    }
+
+    int indexOf(char ch, unsigned int fromIndex = 0) const
+    {
+      if (fromIndex >= len) return -1;
+      const char *found = (const char *)memchr(ptr + fromIndex, ch, len - fromIndex);
+      return found ? found - ptr : -1;
+    }
+    StringView substring(unsigned int beginIndex, unsigned int endIndex) const
+    {
+      if (endIndex > len) endIndex = len;
+      if (beginIndex > endIndex) beginIndex = endIndex;
+      return StringView(ptr + beginIndex, endIndex - beginIndex);
+    }
+    StringView trim() const
+    {
+      unsigned int begin = 0, end = len;
+      while (begin < end && isspace(ptr[begin])) begin++;
+      while (end > begin && isspace(ptr[end - 1])) end--;
+      return StringView(ptr + begin, end - begin);
+    }
+
+    long toInt() const
+    {
+      long result = 0;
+      bool negative = len > 0 && ptr[0] == '-';
+      for (unsigned int i = negative ? 1 : 0; i < len && isdigit(ptr[i]); i++)
+      {
+        result = result * 10 + (ptr[i] - '0');
+      }
+      return negative ? -result : result;
+    }
+    String toString() const { return String(ptr, len); }
+
+  private:
+    const char *ptr;
+    unsigned int len;
+};
+
 #endif  // __cplusplus
 #endif
 // WSTRING_H
@@ -0,0 +1,272 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// Delegate construction, copy and call time and heap allocations, for class
+// methods, functions and lambdas, against the former Delegate which allocated
+// a reference counted caller and called it through virtual invoke().
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include "../host.h"
+#include "Delegate.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static long allocations = 0;
+
+extern "C" void* malloc(size_t size)
+{
+	allocations++;
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+	allocations++;
+	return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr)
+{
+	__libc_free(ptr);
+}
+
+// Former Delegate
+template<class ReturnType, typename... ParamsList>
+class IFormerCaller
+{
+public:
+	virtual ~IFormerCaller() = default;
+	virtual ReturnType invoke(ParamsList...) = 0;
+
+	void increase() { references++; }
+	void decrease()
+	{
+		references--;
+		if (references == 0)
+			delete this;
+	}
+
+private:
+	uint32_t references = 1;
+};
+
+template<class ClassType, class ReturnType, typename... ParamsList>
+class FormerMethodCaller : public IFormerCaller<ReturnType, ParamsList...>
+{
+	typedef ReturnType (ClassType::*MethodDeclaration)(ParamsList...);
+public:
+	FormerMethodCaller(ClassType* c, MethodDeclaration m) : mClass(c), mMethod(m) {}
+	ReturnType invoke(ParamsList... args) { return (mClass->*mMethod)(args...); }
+
+private:
+	ClassType* mClass;
+	MethodDeclaration mMethod;
+};
+
+template<class ReturnType, typename... ParamsList>
+class FormerFunctionCaller : public IFormerCaller<ReturnType, ParamsList...>
+{
+	typedef ReturnType (*FunctionDeclaration)(ParamsList...);
+public:
+	FormerFunctionCaller(FunctionDeclaration m) : mMethod(m) {}
+	ReturnType invoke(ParamsList... args) { return mMethod(args...); }
+
+private:
+	FunctionDeclaration mMethod;
+};
+
+template<class>
+class FormerDelegate;
+
+template<class ReturnType, class... ParamsList>
+class FormerDelegate<ReturnType(ParamsList...)>
+{
+	typedef ReturnType (*FunctionDeclaration)(ParamsList...);
+	template<typename ClassType> using MethodDeclaration = ReturnType (ClassType::*)(ParamsList...);
+
+public:
+	FormerDelegate() {}
+
+	template<class ClassType>
+	FormerDelegate(MethodDeclaration<ClassType> m, ClassType* c)
+	{
+		impl = new FormerMethodCaller<ClassType, ReturnType, ParamsList...>(c, m);
+	}
+
+	FormerDelegate(FunctionDeclaration m) { impl = new FormerFunctionCaller<ReturnType, ParamsList...>(m); }
+
+	~FormerDelegate()
+	{
+		if (impl != nullptr)
+			impl->decrease();
+	}
+
+	ReturnType operator()(ParamsList... params) const { return impl->invoke(params...); }
+
+	FormerDelegate(const FormerDelegate& that) { copy(that); }
+	FormerDelegate& operator=(const FormerDelegate& that)
+	{
+		copy(that);
+		return *this;
+	}
+
+private:
+	void copy(const FormerDelegate& other)
+	{
+		if (impl != other.impl)
+		{
+			if (impl)
+				impl->decrease();
+			impl = other.impl;
+			if (impl)
+				impl->increase();
+		}
+	}
+
+	IFormerCaller<ReturnType, ParamsList...>* impl = nullptr;
+};
+
+#define OPERATIONS 2000000
+#define CALLED 64
+
+class Sensor
+{
+public:
+	void onValue(int value) { total += value; }
+
+	long total = 0;
+};
+
+static long functionTotal = 0;
+
+static void onValue(int value)
+{
+	functionTotal += value;
+}
+
+// Keeps compiler from removing delegates which are never called
+static const void* volatile escaped;
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+struct Result
+{
+	double construct;
+	double copy;
+	double call;
+	double allocations;
+	long total;
+};
+
+template<class D>
+static void measure(const char* name, const D& source, Result& result)
+{
+	long before = allocations;
+	double t = now();
+	for (int i = 0; i < OPERATIONS; i++)
+	{
+		D copy(source);
+		escaped = &copy;
+	}
+	result.copy = (now() - t) * 1e9 / OPERATIONS;
+	result.allocations += (double)(allocations - before) / OPERATIONS;
+
+	// Called from table, like timers and event handlers
+	D* table = new D[CALLED];
+	for (int i = 0; i < CALLED; i++)
+		table[i] = source;
+	t = now();
+	for (int i = 0; i < OPERATIONS; i++)
+		table[i % CALLED](i & 0xFF);
+	result.call = (now() - t) * 1e9 / OPERATIONS;
+	delete[] table;
+
+	host_printf("%-26s construct %5.1f ns, copy %5.1f ns, call %5.1f ns, %4.2f allocations\n", name,
+		result.construct, result.copy, result.call, result.allocations);
+}
+
+template<class D>
+static void method(const char* name, Result& result)
+{
+	Sensor sensor;
+	long before = allocations;
+	double t = now();
+	for (int i = 0; i < OPERATIONS; i++)
+	{
+		D d(&Sensor::onValue, &sensor);
+		escaped = &d;
+	}
+	result.construct = (now() - t) * 1e9 / OPERATIONS;
+	result.allocations = (double)(allocations - before) / OPERATIONS;
+	measure(name, D(&Sensor::onValue, &sensor), result);
+	result.total = sensor.total;
+}
+
+template<class D>
+static void function(const char* name, Result& result)
+{
+	functionTotal = 0;
+	long before = allocations;
+	double t = now();
+	for (int i = 0; i < OPERATIONS; i++)
+	{
+		D d(onValue);
+		escaped = &d;
+	}
+	result.construct = (now() - t) * 1e9 / OPERATIONS;
+	result.allocations = (double)(allocations - before) / OPERATIONS;
+	measure(name, D(onValue), result);
+	result.total = functionTotal;
+}
+
+int main()
+{
+	typedef Delegate<void(int)> NewDelegate;
+	typedef FormerDelegate<void(int)> OldDelegate;
+	Result current, former;
+	bool ok = true;
+
+	method<NewDelegate>("method", current);
+	method<OldDelegate>("method (former)", former);
+	ok &= current.total == former.total && current.allocations == 0;
+
+	function<NewDelegate>("function", current);
+	function<OldDelegate>("function (former)", former);
+	ok &= current.total == former.total && current.allocations == 0;
+
+	// Former Delegate didn't take functors
+	Sensor sensor;
+	long before = allocations;
+	double t = now();
+	for (int i = 0; i < OPERATIONS; i++)
+	{
+		NewDelegate d([&sensor](int value) { sensor.total += value; });
+		escaped = &d;
+	}
+	current.construct = (now() - t) * 1e9 / OPERATIONS;
+	current.allocations = (double)(allocations - before) / OPERATIONS;
+	measure("lambda", NewDelegate([&sensor](int value) { sensor.total += value; }), current);
+	ok &= sensor.total == former.total && current.allocations == 0;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// Static file throughput and flash reads of FileStream in SPIFFS, against the
+// former stream, which read a block, moved file cursor back to keep position
+// until seek() and moved it forward again. First files are read in TCP sized
+// blocks, then sent by HttpServer over emulated TCP. Sent data must be the same.
+// Usage: FileStreamBench [flash file]
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "../host.h"
+#include "FileSystem.h"
+#include "DataSourceStream.h"
+#include "Network/HttpServer.h"
+#include "Network/HttpRequest.h"
+#include "Network/HttpResponse.h"
+
+#define PORT 80
+#define BLOCK_SIZE 1460
+#define REPEAT 20
+
+// Former FileStream
+class FormerFileStream : public IDataSourceStream
+{
+public:
+	FormerFileStream(String fileName)
+	{
+		handle = fileOpen(fileName.c_str(), eFO_ReadOnly);
+		fileSeek(handle, 0, eSO_FileEnd);
+		size = fileTell(handle);
+		fileSeek(handle, 0, eSO_FileStart);
+	}
+
+	virtual ~FormerFileStream() { fileClose(handle); }
+
+	virtual StreamType getStreamType() { return eSST_File; }
+
+	virtual uint16_t readMemoryBlock(char* data, int bufSize)
+	{
+		int len = min(bufSize, size - pos);
+		int available = fileRead(handle, data, len);
+		fileSeek(handle, pos, eSO_FileStart); // Don't move cursor now (waiting seek)
+		return available;
+	}
+
+	virtual bool seek(int len)
+	{
+		if (len < 0) return false;
+		bool result = fileSeek(handle, len, eSO_CurrentPos) >= 0;
+		if (result) pos += len;
+		return result;
+	}
+
+	virtual bool isFinished() { return fileIsEOF(handle); }
+
+private:
+	file_t handle;
+	int pos = 0;
+	int size = 0;
+};
+
+static double cpuTime()
+{
+	timespec t;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static uint32_t flashReads()
+{
+	host_flash_stats stats;
+	host_flash_get_stats(&stats);
+	return stats.reads;
+}
+
+static String fileName(int size)
+{
+	return "file" + String(size / 1024) + "k.bin";
+}
+
+static String fileContent(int size)
+{
+	String content;
+	content.reserve(size);
+	for (int i = 0; i < size; i++)
+		content += (char)('a' + (i * 13 + i / 256) % 26);
+	return content;
+}
+
+// Stream is read like TcpConnection does, block is taken when it's sent
+template<typename S>
+static String readAll(const String& name)
+{
+	S stream(name);
+	String result;
+	char block[BLOCK_SIZE + 1];
+	while (!stream.isFinished())
+	{
+		int len = stream.readMemoryBlock(block, BLOCK_SIZE);
+		if (len == 0)
+			break;
+		block[len] = '\0';
+		result += block;
+		stream.seek(len);
+	}
+	return result;
+}
+
+template<typename S>
+static bool measureRead(const char* name, int size)
+{
+	String fileName = ::fileName(size);
+	String expected = fileContent(size);
+	// Cache is warmed up first, file system pages of other files are in it
+	bool same = readAll<S>(fileName) == expected;
+	uint32_t reads = flashReads();
+	double t = cpuTime();
+	for (int i = 0; i < REPEAT; i++)
+		same &= readAll<S>(fileName) == expected;
+	t = cpuTime() - t;
+	host_printf("%-17s %4d KB file: %6.1f MB/s, %5u flash reads per file%s\n", name, size / 1024,
+		(double)size * REPEAT / t / 1e6, (flashReads() - reads) / REPEAT, same ? "" : " - MISMATCH");
+	return same;
+}
+
+static void onFile(HttpRequest& request, HttpResponse& response)
+{
+	String path = request.getPath();
+	if (path.startsWith("/former/"))
+		response.sendDataStream(new FormerFileStream(path.substring(8)));
+	else
+		response.sendFile(path.substring(1), false);
+}
+
+// Response to one request, segments are acknowledged one by one
+static String fetch(const String& path)
+{
+	tcp_pcb* pcb = host_tcp_accept(PORT);
+	String request = "GET " + path + " HTTP/1.1\r\nHost: device\r\nConnection: close\r\n\r\n";
+	host_tcp_receive(pcb, request.c_str(), request.length(), 0);
+
+	String response;
+	char data[TCP_MSS + 1];
+	time_t deadline = time(NULL) + 10;
+	while ((!host_tcp_closed(pcb) || host_tcp_unacked(pcb) > 0) && time(NULL) < deadline)
+	{
+		if (host_tcp_unacked(pcb) == 0)
+		{
+			// Transfer continues from timer, connection is closed from lwIP poll
+			int64_t wait = host_service_timers();
+			host_tcp_poll(pcb);
+			if (host_tcp_unacked(pcb) == 0 && wait > 0)
+				usleep(min(wait, (int64_t)1000));
+			continue;
+		}
+		while (host_tcp_available(pcb) > 0)
+		{
+			int len = host_tcp_read(pcb, data, TCP_MSS);
+			data[len] = '\0';
+			response += data;
+		}
+		host_tcp_ack(pcb, min(host_tcp_unacked(pcb), (uint32_t)TCP_MSS));
+	}
+	host_tcp_free(pcb);
+	return response;
+}
+
+static bool measureSend(const char* name, const char* prefix, int size)
+{
+	String path = String(prefix) + fileName(size);
+	String expected = fileContent(size);
+	fetch(path);
+	bool same = true;
+	uint32_t reads = flashReads();
+	double t = cpuTime();
+	for (int i = 0; i < REPEAT; i++)
+	{
+		String response = fetch(path);
+		int body = response.indexOf("\r\n\r\n");
+		same &= body > 0 && response.substring(body + 4) == expected;
+	}
+	t = cpuTime() - t;
+	host_printf("%-17s %4d KB file: %6.1f MB/s, %5u flash reads per file%s\n", name, size / 1024,
+		(double)size * REPEAT / t / 1e6, (flashReads() - reads) / REPEAT, same ? "" : " - MISMATCH");
+	return same;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* flashFile = argc > 1 ? argv[1] : "file_stream_bench.bin";
+	remove(flashFile);
+	if (!host_flash_init(flashFile))
+		return 1;
+	host_set_quiet(true);
+	spiffs_mount();
+
+	int sizes[] = { 4 * 1024, 32 * 1024, 100 * 1024 };
+	const int sizesCount = sizeof(sizes) / sizeof(sizes[0]);
+	for (int i = 0; i < sizesCount; i++)
+		fileSetContent(fileName(sizes[i]), fileContent(sizes[i]));
+
+	bool ok = true;
+	for (int i = 0; i < sizesCount; i++)
+	{
+		ok &= measureRead<FileStream>("read", sizes[i]);
+		ok &= measureRead<FormerFileStream>("read (former)", sizes[i]);
+	}
+
+	HttpServer server;
+	server.setDefaultHandler(onFile);
+	server.listen(PORT);
+	for (int i = 0; i < sizesCount; i++)
+	{
+		ok &= measureSend("HTTP", "/", sizes[i]);
+		ok &= measureSend("HTTP (former)", "/former/", sizes[i]);
+	}
+
+	spiffs_unmount();
+	host_flash_end();
+	remove(flashFile);
+	return ok ? 0 : 1;
+}
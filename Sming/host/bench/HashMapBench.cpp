@@ -0,0 +1,122 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// HashMap lookup latency and memory used per entry at 8, 32 and 256 entries.
+// Linear scan over keyAt(), like lookups were done before hashing, is the baseline.
+
+#include <user_config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../host.h"
+#include "WHashMap.h"
+
+#define LOOKUPS 2000000
+
+// Storage arrays of the map are allocated with new[]
+static size_t allocated = 0;
+// Keeps lookups from being optimised out
+static volatile long sink;
+
+void* operator new[](size_t size)
+{
+	size_t* p = (size_t*)malloc(size + sizeof(size_t));
+	*p = size;
+	allocated += size;
+	return p + 1;
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	if (ptr == NULL)
+		return;
+	size_t* p = (size_t*)ptr - 1;
+	allocated -= *p;
+	free(p);
+}
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+template<typename K>
+static int linearFind(const HashMap<K, int>& map, const K& key)
+{
+	for (unsigned i = 0; i < map.count(); i++)
+	{
+		if (map.keyAt(i) == key)
+			return i;
+	}
+	return -1;
+}
+
+template<typename K>
+static void run(const char* name, K* keys, K* missing, int count)
+{
+	size_t before = allocated;
+	HashMap<K, int>* map = new HashMap<K, int>();
+	for (int i = 0; i < count; i++)
+		(*map)[keys[i]] = i;
+	size_t bytes = allocated - before;
+
+	long sum = 0;
+	double t = now();
+	for (int i = 0; i < LOOKUPS; i++)
+		sum += map->indexOf(keys[i % count]);
+	double hit = (now() - t) * 1e9 / LOOKUPS;
+
+	t = now();
+	for (int i = 0; i < LOOKUPS; i++)
+		sum += map->indexOf(missing[i % count]);
+	double miss = (now() - t) * 1e9 / LOOKUPS;
+
+	t = now();
+	for (int i = 0; i < LOOKUPS; i++)
+		sum += linearFind(*map, keys[i % count]);
+	double linear = (now() - t) * 1e9 / LOOKUPS;
+
+	sink = sum;
+	host_printf("%-6s %3d entries: hit %6.1f ns, miss %6.1f ns, linear %7.1f ns, %5.1f bytes/entry (%d for key and value)\n",
+		name, count, hit, miss, linear, (double)bytes / count, (int)(sizeof(K) + sizeof(int)));
+	delete map;
+}
+
+int main()
+{
+	int sizes[] = { 8, 32, 256 };
+	for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+	{
+		int count = sizes[s];
+		String* names = new String[count];
+		String* otherNames = new String[count];
+		int* numbers = new int[count];
+		int* otherNumbers = new int[count];
+		for (int i = 0; i < count; i++)
+		{
+			// Like HTTP header names, sharing prefix
+			char buf[32];
+			sprintf(buf, "X-Header-%d", i);
+			names[i] = buf;
+			sprintf(buf, "X-Missing-%d", i);
+			otherNames[i] = buf;
+			numbers[i] = i * 7;
+			otherNumbers[i] = i * 7 + 3;
+		}
+
+		run("String", names, otherNames, count);
+		run("int", numbers, otherNumbers, count);
+
+		delete[] names;
+		delete[] otherNames;
+		delete[] numbers;
+		delete[] otherNumbers;
+	}
+	return 0;
+}
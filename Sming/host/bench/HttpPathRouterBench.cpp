@@ -0,0 +1,143 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// HttpPathRouter lookup time against HashMap of exact paths, which the server
+// used before, for 10, 50 and 200 routes. Found handlers are checked to be the
+// same for both. Lookup of ":id" and "*" routes is reported for the router only.
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include "../host.h"
+#include "WHashMap.h"
+#include "Network/HttpPathRouter.h"
+
+#define LOOKUPS 1000000
+
+// Only looked up, never called
+static void onPath(HttpRequest& request, HttpResponse& response)
+{
+}
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static bool run(int routesCount)
+{
+	HttpPathRouter router;
+	HashMap<String, HttpPathDelegate> paths;
+	HttpPathDelegate handler(onPath);
+	char buf[64];
+	for (int i = 0; i < routesCount; i++)
+	{
+		// Like pages and API of device web interface, sharing prefixes
+		switch (i % 4)
+		{
+		case 0:
+			sprintf(buf, "/page%d.html", i);
+			break;
+		case 1:
+			sprintf(buf, "/api/sensor%d", i);
+			break;
+		case 2:
+			sprintf(buf, "/api/sensor%d/history", i);
+			break;
+		default:
+			sprintf(buf, "/settings/group%d/item", i);
+		}
+		router.add(buf, handler);
+		paths[buf] = handler;
+	}
+
+	// Half of requests miss
+	const int requestsCount = 64;
+	String requests[requestsCount];
+	for (int i = 0; i < requestsCount; i++)
+	{
+		int route = i * 7 % (routesCount * 2);
+		switch (route % 4)
+		{
+		case 0:
+			sprintf(buf, "/page%d.html", route);
+			break;
+		case 1:
+			sprintf(buf, "/api/sensor%d", route);
+			break;
+		case 2:
+			sprintf(buf, "/api/sensor%d/history", route);
+			break;
+		default:
+			sprintf(buf, "/settings/group%d/item", route);
+		}
+		requests[i] = buf;
+	}
+
+	HttpPathParameters params;
+	long routerFound = 0;
+	double t = now();
+	for (int i = 0; i < LOOKUPS; i++)
+	{
+		const String& path = requests[i % requestsCount];
+		if (router.find(path.c_str(), path.length(), params) != NULL)
+			routerFound++;
+	}
+	double routerTime = (now() - t) * 1e9 / LOOKUPS;
+
+	// Server looked up paths with contains() and operator[]
+	long mapFound = 0;
+	t = now();
+	for (int i = 0; i < LOOKUPS; i++)
+	{
+		const String& path = requests[i % requestsCount];
+		if (paths.contains(path) && paths[path])
+			mapFound++;
+	}
+	double mapTime = (now() - t) * 1e9 / LOOKUPS;
+
+	// Routes with parameters, not supported by HashMap
+	HttpPathRouter paramRouter;
+	for (int i = 0; i < routesCount; i++)
+	{
+		sprintf(buf, "/dev%d/:id/state", i);
+		paramRouter.add(buf, handler);
+	}
+	paramRouter.add("/files/*", handler);
+	for (int i = 0; i < requestsCount; i++)
+	{
+		if (i % 2)
+			sprintf(buf, "/dev%d/lamp%d/state", i * 7 % routesCount, i);
+		else
+			sprintf(buf, "/files/www/img%d.png", i);
+		requests[i] = buf;
+	}
+	long paramFound = 0;
+	t = now();
+	for (int i = 0; i < LOOKUPS; i++)
+	{
+		const String& path = requests[i % requestsCount];
+		if (paramRouter.find(path.c_str(), path.length(), params) != NULL)
+			paramFound++;
+	}
+	double paramTime = (now() - t) * 1e9 / LOOKUPS;
+
+	host_printf("%3d routes: router %6.1f ns, HashMap %6.1f ns, with parameters %6.1f ns%s\n",
+		routesCount, routerTime, mapTime, paramTime,
+		routerFound == mapFound && paramFound == LOOKUPS ? "" : " - MISMATCH");
+	return routerFound == mapFound && paramFound == LOOKUPS;
+}
+
+int main()
+{
+	bool ok = run(10);
+	ok &= run(50);
+	ok &= run(200);
+	return ok ? 0 : 1;
+}
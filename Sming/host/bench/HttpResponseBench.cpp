@@ -0,0 +1,186 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// HTTP response writing on emulated TCP: tcp_write calls, segments and heap
+// allocations per response. Header and 12 byte body are written by HttpResponse,
+// against the former writer, which made a String of each header line and wrote
+// lines one by one. Then whole keep-alive requests and responses go through HttpServer.
+
+#include <user_config.h>
+#include <stdio.h>
+#include "../host.h"
+#include "WHashMap.h"
+#include "DataSourceStream.h"
+#include "Network/HttpServer.h"
+#include "Network/HttpServerConnection.h"
+#include "Network/HttpRequest.h"
+#include "Network/HttpResponse.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static long allocations = 0;
+
+extern "C" void* malloc(size_t size)
+{
+	allocations++;
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+	allocations++;
+	return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void* ptr)
+{
+	__libc_free(ptr);
+}
+
+#define PORT 80
+#define RESPONSES 1000
+#define BODY "Hello world!"
+
+// Former HttpResponse header writing
+class FormerResponse
+{
+public:
+	void setHeader(const String name, const String value) { headers[name] = value; }
+
+	void send(TcpConnection& connection, IDataSourceStream* stream)
+	{
+		String top = "HTTP/1.1 " + status + "\r\n";
+		connection.writeString(top.c_str(), TCP_WRITE_FLAG_MORE | TCP_WRITE_FLAG_COPY);
+		for (int i = 0; i < headers.count(); i++)
+		{
+			String write = headers.keyAt(i) + ": " + headers.valueAt(i) + "\r\n";
+			connection.writeString(write.c_str(), TCP_WRITE_FLAG_MORE | TCP_WRITE_FLAG_COPY);
+		}
+		connection.writeString("\r\n");
+		connection.write(stream);
+		connection.flush();
+		connection.freeStream(stream);
+	}
+
+private:
+	String status = "200 OK";
+	HashMap<String, String> headers;
+};
+
+static void onPage(HttpRequest& request, HttpResponse& response)
+{
+	response.setContentType(ContentType::HTML);
+	response.sendString(BODY);
+}
+
+struct Counters
+{
+	long allocations;
+	host_tcp_stats stats;
+};
+
+static void start(Counters& counters)
+{
+	host_tcp_reset_stats();
+	counters.allocations = allocations;
+}
+
+// Everything sent is taken and acknowledged
+static uint32_t drain(tcp_pcb* pcb)
+{
+	uint32_t received = 0;
+	while (host_tcp_available(pcb) > 0 || host_tcp_unacked(pcb) > 0)
+	{
+		received += host_tcp_read(pcb, NULL, host_tcp_available(pcb));
+		host_tcp_ack(pcb, host_tcp_unacked(pcb));
+	}
+	return received;
+}
+
+static void report(const char* name, Counters& counters, uint32_t received)
+{
+	host_tcp_get_stats(&counters.stats);
+	host_printf("%-18s %5.1f allocations, %4.1f tcp_write, %4.1f segments, %5.1f bytes per response\n", name,
+		(double)(allocations - counters.allocations) / RESPONSES, (double)counters.stats.writes / RESPONSES,
+		(double)counters.stats.segments / RESPONSES, (double)received / RESPONSES);
+}
+
+int main()
+{
+	host_set_quiet(true);
+
+	HttpServer server;
+	server.setDefaultHandler(onPage);
+	server.listen(PORT);
+
+	// Connection accepted by server is used to write responses directly
+	tcp_pcb* pcb = host_tcp_accept(PORT);
+	HttpServerConnection* connection = (HttpServerConnection*)pcb->callback_arg;
+	Counters counters;
+	bool ok = true;
+
+	start(counters);
+	uint32_t received = 0;
+	for (int i = 0; i < RESPONSES; i++)
+	{
+		// Server gives each response send budget of its class
+		connection->setConnectionClass(eTCC_Short);
+		HttpResponse response;
+		response.setContentType(ContentType::HTML);
+		response.setHeader(eHRH_Connection, "keep-alive");
+		response.setHeader(eHRH_ContentLength, String(sizeof(BODY) - 1));
+		response.sendString(BODY);
+		response.sendBody(*connection);
+		received += drain(pcb);
+	}
+	report("HttpResponse", counters, received);
+	uint32_t current = received;
+
+	start(counters);
+	received = 0;
+	for (int i = 0; i < RESPONSES; i++)
+	{
+		connection->setConnectionClass(eTCC_Short);
+		FormerResponse response;
+		response.setHeader("Content-Type", ContentType::HTML);
+		response.setHeader("Connection", "keep-alive");
+		response.setHeader("Content-Length", String(sizeof(BODY) - 1));
+		MemoryDataStream* stream = new MemoryDataStream();
+		stream->print(BODY);
+		response.send(*connection, stream);
+		received += drain(pcb);
+	}
+	report("former (baseline)", counters, received);
+	ok &= received == current;
+	host_tcp_free(pcb);
+
+	// Request parsing, handler and response
+	pcb = host_tcp_accept(PORT);
+	const char* request = "GET /index.html HTTP/1.1\r\nHost: device\r\n\r\n";
+	start(counters);
+	received = 0;
+	for (int i = 0; i < RESPONSES; i++)
+	{
+		host_tcp_receive(pcb, request, strlen(request), 0);
+		received += drain(pcb);
+	}
+	report("keep-alive request", counters, received);
+	ok &= !host_tcp_closed(pcb) && received > 0;
+	host_tcp_remote_close(pcb);
+	host_tcp_free(pcb);
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// HttpStaticFiles index of 100 assets in SPIFFS: build and rescan time, lookup
+// against opening files by name like HttpResponse::sendFile() does, and index size.
+// File rewritten in place with the same size must be sent with new ETag.
+// Usage: HttpStaticFilesBench [flash file]
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include "../host.h"
+#include "FileSystem.h"
+#include "Network/HttpStaticFiles.h"
+#include "Network/HttpRequest.h"
+#include "Network/HttpResponse.h"
+
+#define ASSETS 100
+#define LOOKUPS 20000
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static String assetName(int index)
+{
+	static const char* extensions[] = { "css", "js", "png", "html" };
+	char name[32];
+	sprintf(name, "asset%02d.%s", index, extensions[index % 4]);
+	return name;
+}
+
+static void createAssets()
+{
+	char content[2048];
+	for (int i = 0; i < ASSETS; i++)
+	{
+		int size = 200 + i * 18;
+		memset(content, 'a' + i % 26, size);
+		content[size] = '\0';
+		// Scripts are stored compressed only
+		String name = assetName(i);
+		fileSetContent(i % 4 == 1 ? name + ".gz" : name, content);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const char* flashFile = argc > 1 ? argv[1] : "static_files_bench.bin";
+	remove(flashFile);
+	if (!host_flash_init(flashFile))
+		return 1;
+	spiffs_mount();
+	createAssets();
+
+	String names[ASSETS];
+	for (int i = 0; i < ASSETS; i++)
+		names[i] = assetName(i);
+
+	HttpStaticFiles index;
+	double t = now();
+	bool built = index.build();
+	double buildTime = now() - t;
+
+	// Name lookup of each request, as index does
+	int found = 0;
+	t = now();
+	for (int i = 0; i < LOOKUPS; i++)
+	{
+		const String& name = names[i % ASSETS];
+		if (index.find(name.c_str(), name.length()) != NULL)
+			found++;
+	}
+	double findTime = (now() - t) / LOOKUPS;
+
+	// Compressed file is tried first, then plain one.
+	// SPIFFS is called directly, fileOpen() logs every missing file.
+	int opened = 0;
+	t = now();
+	for (int i = 0; i < LOOKUPS; i++)
+	{
+		const String& name = names[i % ASSETS];
+		file_t file = SPIFFS_open(&_filesystemStorageHandle, (name + ".gz").c_str(), SPIFFS_RDONLY, 0);
+		if (file < 0)
+			file = SPIFFS_open(&_filesystemStorageHandle, name.c_str(), SPIFFS_RDONLY, 0);
+		if (file >= 0)
+		{
+			opened++;
+			SPIFFS_close(&_filesystemStorageHandle, file);
+		}
+	}
+	double openTime = (now() - t) / LOOKUPS;
+
+	// Any change of file system rescans directory, files are hashed again when sent
+	fileSetContent("asset00.css", "changed");
+	t = now();
+	index.find("asset00.css", 11);
+	double rescanTime = now() - t;
+
+	// Same object and size, other content
+	HttpRequest request;
+	HttpResponse before;
+	index.send(names[2], request, before);
+	String tag = index.getETag(*index.find(names[2].c_str(), names[2].length()));
+	String content = fileGetContent(names[2]);
+	content.setCharAt(0, content[0] + 1);
+	file_t file = fileOpen(names[2], eFO_WriteOnly | eFO_Truncate);
+	fileWrite(file, content.c_str(), content.length());
+	fileClose(file);
+	HttpResponse after;
+	index.send(names[2], request, after);
+	const HttpStaticFile* sent = index.find(names[2].c_str(), names[2].length());
+	bool retagged = sent != NULL && sent->hashed && index.getETag(*sent) != tag;
+
+	int namesSize = 0;
+	for (int i = 0; i < ASSETS; i++)
+		namesSize += names[i].length();
+
+	host_printf("build: %s, %.0f us for %d files\n", built ? "ok" : "FAILED", buildTime * 1e6, ASSETS);
+	host_printf("index lookup: %.2f us, %d found\n", findTime * 1e6, found);
+	host_printf("open by name: %.2f us, %d found\n", openTime * 1e6, opened);
+	host_printf("rescan after change: %.0f us\n", rescanTime * 1e6);
+	host_printf("rewritten in place with same size: %s\n", retagged ? "new ETag" : "FAILED, stale ETag");
+	host_printf("index size: about %d bytes\n", (int)(index.count() * sizeof(HttpStaticFile)) + namesSize);
+
+	spiffs_unmount();
+	host_flash_end();
+	remove(flashFile);
+	return built && found == LOOKUPS && opened == LOOKUPS && retagged ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// MemoryDataStream append throughput, allocations and peak heap when a page is
+// printed piece by piece, against the single realloc() grown buffer it replaced.
+// Then peak heap while a large stream is sent over emulated TCP: chunks must go
+// back to the pool as their data is acknowledged, not when the stream is deleted.
+// On x86 gcc inlines memcpy into a chunk, bounded by chunk size, as "rep movs",
+// which is slow for short appends. HOST_CFLAGS=-mstringop-strategy=libcall calls
+// memcpy like the device does.
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include <malloc.h>
+#include <unistd.h>
+#include "../host.h"
+#include "DataSourceStream.h"
+#include "Network/HttpServer.h"
+#include "Network/HttpRequest.h"
+#include "Network/HttpResponse.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+// Whole program heap use, everything goes through these
+static size_t heapUsed = 0;
+static size_t heapPeak = 0;
+static long allocations = 0;
+
+static void* counted(void* ptr)
+{
+	if (ptr != NULL)
+	{
+		heapUsed += malloc_usable_size(ptr);
+		if (heapUsed > heapPeak)
+			heapPeak = heapUsed;
+		allocations++;
+	}
+	return ptr;
+}
+
+extern "C" void* malloc(size_t size)
+{
+	return counted(__libc_malloc(size));
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+	return counted(__libc_calloc(count, size));
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+	if (ptr != NULL)
+		heapUsed -= malloc_usable_size(ptr);
+	return counted(__libc_realloc(ptr, size));
+}
+
+extern "C" void free(void* ptr)
+{
+	if (ptr != NULL)
+		heapUsed -= malloc_usable_size(ptr);
+	__libc_free(ptr);
+}
+
+// Former MemoryDataStream storage
+class ReallocStream : public Print
+{
+public:
+	~ReallocStream() { free(buf); }
+
+	virtual size_t write(uint8_t charToWrite) { return write(&charToWrite, 1); }
+
+	virtual size_t write(const uint8_t* data, size_t len)
+	{
+		if (buf == NULL)
+		{
+			buf = (char*)malloc(len + 1);
+			buf[len] = '\0';
+			memcpy(buf, data, len);
+		}
+		else
+		{
+			int required = size + len + 1;
+			if (required > capacity)
+			{
+				capacity = required < 256 ? required + 128 : required + 64;
+				buf = (char*)realloc(buf, capacity);
+			}
+			buf[size + len] = '\0';
+			memcpy(buf + size, data, len);
+		}
+		size += len;
+		return len;
+	}
+
+	int getStreamLength() { return size; }
+
+private:
+	char* buf = NULL;
+	int size = 0;
+	int capacity = 0;
+};
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Table rows, like page rendered with print()
+static int printPage(Print& out, int rows)
+{
+	for (int i = 0; i < rows; i++)
+	{
+		out.print("<tr><td>");
+		out.print(i);
+		out.print("</td><td>sensor value</td><td>");
+		out.print(i * 17 % 1000);
+		out.println("</td></tr>");
+	}
+	return 0;
+}
+
+template<typename S>
+static int append(const char* name, int rows, int repeat)
+{
+	int length = 0;
+	allocations = 0;
+	size_t before = heapUsed;
+	heapPeak = heapUsed;
+	double t = now();
+	for (int r = 0; r < repeat; r++)
+	{
+		S* stream = new S();
+		printPage(*stream, rows);
+		length = stream->getStreamLength();
+		delete stream;
+	}
+	t = now() - t;
+	host_printf("%-8s %6d bytes: %7.1f MB/s, %6.1f allocations, peak heap %6u bytes\n",
+		name, length, (double)length * repeat / t / 1e6, (double)allocations / repeat, (unsigned)(heapPeak - before));
+	return length;
+}
+
+#define SEND_LENGTH (32 * 1024)
+
+static void onPage(HttpRequest& request, HttpResponse& response)
+{
+	MemoryDataStream* stream = new MemoryDataStream();
+	char line[64];
+	memset(line, 'x', sizeof(line));
+	line[sizeof(line) - 1] = '\n';
+	for (int i = 0; i < SEND_LENGTH / (int)sizeof(line); i++)
+		stream->write((uint8_t*)line, sizeof(line));
+	response.sendDataStream(stream);
+}
+
+// Heap held by the stream while it's sent and acknowledged segment by segment
+static bool send()
+{
+	HttpServer server;
+	server.setDefaultHandler(onPage);
+	server.listen(80);
+
+	tcp_pcb* pcb = host_tcp_accept(80);
+	const char* request = "GET /page HTTP/1.1\r\nConnection: close\r\n\r\n";
+	size_t before = heapUsed;
+	host_tcp_receive(pcb, request, strlen(request), 0);
+	// Stream is complete before sending starts
+	size_t built = heapUsed - before;
+
+	size_t half = 0;
+	uint32_t received = 0;
+	double deadline = now() + 5;
+	while (!host_tcp_closed(pcb) || host_tcp_unacked(pcb) > 0)
+	{
+		if (host_tcp_unacked(pcb) == 0)
+		{
+			// Server continues long transfers from its send round timer,
+			// connection is closed from lwIP poll
+			int64_t wait = host_service_timers();
+			host_tcp_poll(pcb);
+			if (host_tcp_unacked(pcb) > 0)
+				continue;
+			if (wait < 0 || now() > deadline)
+				break;
+			usleep(wait);
+			continue;
+		}
+		received += host_tcp_read(pcb, NULL, host_tcp_available(pcb));
+		host_tcp_ack(pcb, min(host_tcp_unacked(pcb), (uint32_t)TCP_MSS));
+		if (half == 0 && received >= SEND_LENGTH / 2)
+			half = heapUsed - before;
+	}
+	bool ok = host_tcp_closed(pcb) && received > SEND_LENGTH;
+	host_tcp_free(pcb);
+
+	host_printf("send %d KB stream: %u bytes held when built, %u bytes when half is acknowledged%s\n",
+		SEND_LENGTH / 1024, (unsigned)built, (unsigned)half, ok ? "" : " - FAILED");
+	// Acknowledged chunks are released
+	return ok && half < built * 3 / 4;
+}
+
+int main()
+{
+	host_set_quiet(true);
+
+	int rows[] = { 20, 200, 500 };
+	for (unsigned i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+	{
+		append<MemoryDataStream>("chunked", rows[i], 2000);
+		append<ReallocStream>("realloc", rows[i], 2000);
+	}
+
+	return send() ? 0 : 1;
+}
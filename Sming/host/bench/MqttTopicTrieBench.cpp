@@ -0,0 +1,146 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// MqttTopicTrie matching time against comparing topic with every subscribed filter,
+// for 10, 50, 100 and 200 filters with exact names, '+' and '#' wildcards.
+// Number of matches is checked to be the same for both.
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include "../host.h"
+#include "Network/MqttTopicTrie.h"
+
+#define MATCHES 200000
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Baseline: one filter against one topic
+static bool filterMatches(const char* filter, const char* topic)
+{
+	if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#'))
+		return false;
+
+	while (true)
+	{
+		if (*filter == '#')
+			return true;
+		if (*filter == '+')
+		{
+			filter++;
+			while (*topic != '\0' && *topic != '/')
+				topic++;
+		}
+		else
+		{
+			while (*filter != '\0' && *filter != '/' && *filter == *topic)
+			{
+				filter++;
+				topic++;
+			}
+			if ((*filter != '\0' && *filter != '/') || (*topic != '\0' && *topic != '/'))
+				return false;
+		}
+
+		if (*filter == '\0')
+			return *topic == '\0';
+		filter++;
+		if (*topic == '\0')
+			return strcmp(filter, "#") == 0; // "a/#" matches "a"
+		topic++;
+	}
+}
+
+static bool run(int filtersCount)
+{
+	String* filters = new String[filtersCount];
+	MqttTopicTrie trie;
+	char buf[64];
+	for (int i = 0; i < filtersCount; i++)
+	{
+		int room = i / 3;
+		switch (i % 3)
+		{
+		case 0:
+			sprintf(buf, "home/room%d/temperature", room);
+			break;
+		case 1:
+			sprintf(buf, "+/room%d/humidity", room);
+			break;
+		default:
+			sprintf(buf, "office/room%d/#", room);
+		}
+		filters[i] = buf;
+		trie.add(filters[i], MqttStringSubscriptionCallback());
+	}
+
+	// Matching and not matching topics
+	const int topicsCount = 64;
+	String topics[topicsCount];
+	for (int i = 0; i < topicsCount; i++)
+	{
+		int room = i * 7 % (filtersCount / 3 + 4);
+		switch (i % 4)
+		{
+		case 0:
+			sprintf(buf, "home/room%d/temperature", room);
+			break;
+		case 1:
+			sprintf(buf, "garage/room%d/humidity", room);
+			break;
+		case 2:
+			sprintf(buf, "office/room%d/lights/desk", room);
+			break;
+		default:
+			sprintf(buf, "home/room%d/pressure", room);
+		}
+		topics[i] = buf;
+	}
+
+	MqttTopicNode* found[MQTT_MAX_MATCHES];
+	long trieMatches = 0;
+	double t = now();
+	for (int i = 0; i < MATCHES; i++)
+	{
+		const String& topic = topics[i % topicsCount];
+		trieMatches += trie.match(topic.c_str(), topic.length(), found);
+	}
+	double trieTime = (now() - t) * 1e9 / MATCHES;
+
+	long linearMatches = 0;
+	t = now();
+	for (int i = 0; i < MATCHES; i++)
+	{
+		const char* topic = topics[i % topicsCount].c_str();
+		for (int f = 0; f < filtersCount; f++)
+		{
+			if (filterMatches(filters[f].c_str(), topic))
+				linearMatches++;
+		}
+	}
+	double linearTime = (now() - t) * 1e9 / MATCHES;
+
+	host_printf("%3d filters: trie %6.1f ns, each filter %7.1f ns, %.2f matches per topic%s\n",
+		filtersCount, trieTime, linearTime, (double)trieMatches / MATCHES,
+		trieMatches == linearMatches ? "" : " - MISMATCH");
+	delete[] filters;
+	return trieMatches == linearMatches;
+}
+
+int main()
+{
+	bool ok = run(10);
+	ok &= run(50);
+	ok &= run(100);
+	ok &= run(200);
+	return ok ? 0 : 1;
+}
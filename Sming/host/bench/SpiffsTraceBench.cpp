@@ -0,0 +1,229 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// Static files of a web interface are put into an image by spiffy, which is
+// loaded into emulated flash. Then a trace of browser page loads is replayed
+// through HttpServer and HttpStaticFiles, four connections at a time, with
+// SPIFFS mounted with 2 cache pages up to its limit. Reported are CPU time, throughput
+// and cache hit rate. Every request must be answered with whole file.
+// Usage: SpiffsTraceBench [flash file]
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../host.h"
+#include "FileSystem.h"
+#include "flashmem.h"
+#include "Network/HttpServer.h"
+#include "Network/HttpStaticFiles.h"
+
+#ifndef SPIFFY
+#define SPIFFY "../spiffy/spiffy"
+#endif
+
+#define WWW_DIR "out/www"
+#define IMAGE_FILE "out/www.bin"
+#define IMAGE_SIZE (512 * 1024)
+#define PORT 80
+#define CONNECTIONS 4
+#define PAGE_LOADS 40
+
+struct WebFile
+{
+	const char* name;
+	int size;
+};
+
+static const WebFile webFiles[] = {
+	{ "index.html", 6200 }, { "style.css", 14300 }, { "app.js", 48600 }, { "logo.png", 9100 },
+	{ "favicon.ico", 1150 }, { "config.json", 540 }, { "icon0.png", 1400 }, { "icon1.png", 1650 },
+	{ "icon2.png", 1210 }, { "icon3.png", 1880 }, { "icon4.png", 1330 }, { "icon5.png", 1720 },
+	{ "icon6.png", 1560 }, { "icon7.png", 1290 }, { "font.woff", 31800 },
+};
+
+#define WEB_FILES (sizeof(webFiles) / sizeof(webFiles[0]))
+
+static double cpuTime()
+{
+	timespec t;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static bool createImage()
+{
+	mkdir(WWW_DIR, 0755);
+	for (unsigned i = 0; i < WEB_FILES; i++)
+	{
+		FILE* f = fopen((String(WWW_DIR "/") + webFiles[i].name).c_str(), "wb");
+		if (f == NULL)
+			return false;
+		for (int n = 0; n < webFiles[i].size; n++)
+			fputc("abcdefghijklmnopqrstuvwxyz0123456789 \n"[(n * 7 + i) % 38], f);
+		fclose(f);
+	}
+	char command[256];
+	sprintf(command, SPIFFY " %d " WWW_DIR " " IMAGE_FILE " > /dev/null", IMAGE_SIZE);
+	return system(command) == 0;
+}
+
+// Image goes where file system of device is
+static bool loadImage(spiffs_config& cfg)
+{
+	FILE* f = fopen(IMAGE_FILE, "rb");
+	if (f == NULL)
+		return false;
+	uint8_t* image = new uint8_t[IMAGE_SIZE];
+	bool ok = fread(image, 1, IMAGE_SIZE, f) == IMAGE_SIZE;
+	fclose(f);
+	cfg = spiffs_get_storage_config();
+	for (uint32_t offset = 0; ok && offset < IMAGE_SIZE; offset += INTERNAL_FLASH_SECTOR_SIZE)
+	{
+		flashmem_erase_sector(flashmem_get_sector_of_address(cfg.phys_addr + offset));
+		ok = flashmem_write(image + offset, cfg.phys_addr + offset, INTERNAL_FLASH_SECTOR_SIZE) == INTERNAL_FLASH_SECTOR_SIZE;
+	}
+	delete[] image;
+	return ok;
+}
+
+// Browser loads page, its styles, scripts and font, then pictures and settings
+static void buildTrace(Vector<int>& trace)
+{
+	for (int load = 0; load < PAGE_LOADS; load++)
+	{
+		for (int i = 0; i < 6; i++)
+			trace.add(i);
+		for (int i = 0; i < 4; i++)
+			trace.add(6 + (load * 3 + i) % 8);
+		// Font is cached by browser after few loads
+		if (load % 8 == 0)
+			trace.add(WEB_FILES - 1);
+	}
+}
+
+// Requests are answered at the same time, segments acknowledged in turn
+static uint32_t fetch(const int* files, int count)
+{
+	tcp_pcb* pcbs[CONNECTIONS];
+	char request[128];
+	for (int i = 0; i < count; i++)
+	{
+		pcbs[i] = host_tcp_accept(PORT);
+		sprintf(request, "GET /%s HTTP/1.1\r\nHost: device\r\nConnection: close\r\n\r\n", webFiles[files[i]].name);
+		host_tcp_receive(pcbs[i], request, strlen(request), 0);
+	}
+
+	uint32_t received = 0;
+	int open = count;
+	time_t deadline = time(NULL) + 10;
+	while (open > 0 && time(NULL) < deadline)
+	{
+		bool progress = false;
+		open = 0;
+		for (int i = 0; i < count; i++)
+		{
+			if (host_tcp_unacked(pcbs[i]) > 0)
+			{
+				received += host_tcp_read(pcbs[i], NULL, host_tcp_available(pcbs[i]));
+				host_tcp_ack(pcbs[i], min(host_tcp_unacked(pcbs[i]), (uint32_t)TCP_MSS));
+				progress = true;
+			}
+			if (!host_tcp_closed(pcbs[i]) || host_tcp_unacked(pcbs[i]) > 0)
+				open++;
+		}
+		if (progress)
+			continue;
+		// Long transfers continue from timer, connections are closed from lwIP poll
+		int64_t wait = host_service_timers();
+		for (int i = 0; i < count; i++)
+			host_tcp_poll(pcbs[i]);
+		if (wait > 0)
+			usleep(min(wait, (int64_t)1000));
+	}
+	for (int i = 0; i < count; i++)
+		host_tcp_free(pcbs[i]);
+	return received;
+}
+
+static bool replay(const Vector<int>& trace, int cachePages)
+{
+	fileSetMountConfig(CONNECTIONS + 1, cachePages);
+	spiffs_config cfg = spiffs_get_storage_config();
+	spiffs_mount_manual(cfg.phys_addr, IMAGE_SIZE);
+
+	HttpStaticFiles files;
+	HttpServer server;
+	bool ok = files.build();
+	server.setStaticFiles(&files);
+	server.listen(PORT);
+
+	uint32_t expected = 0;
+	uint32_t received = 0;
+	spiffs_sming_stats before;
+	fileSystemStats(&before);
+	double t = cpuTime();
+	for (int i = 0; i < trace.count(); i += CONNECTIONS)
+	{
+		int batch[CONNECTIONS];
+		int count = min(CONNECTIONS, trace.count() - i);
+		for (int n = 0; n < count; n++)
+		{
+			batch[n] = trace[i + n];
+			expected += webFiles[batch[n]].size;
+		}
+		received += fetch(batch, count);
+	}
+	t = cpuTime() - t;
+	spiffs_sming_stats stats;
+	fileSystemStats(&stats);
+	uint32_t hits = stats.cache_hits - before.cache_hits;
+	uint32_t misses = stats.cache_misses - before.cache_misses;
+
+	// Headers come on top of files
+	ok &= stats.cache_pages > 0 && received > expected
+		&& files.getSentFiles() == (uint32_t)trace.count();
+	host_printf("%2d cache pages: %6.1f ms, %5.1f MB/s, %5.1f%% cache hits, %6u misses%s\n", stats.cache_pages,
+		t * 1e3, expected / t / 1e6, hits + misses > 0 ? hits * 100.0 / (hits + misses) : 0.0, misses,
+		ok ? "" : " - FAILED");
+	spiffs_unmount();
+	return ok;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* flashFile = argc > 1 ? argv[1] : "spiffs_trace_bench.bin";
+	if (!createImage())
+	{
+		host_printf("can't build image with " SPIFFY "\n");
+		return 1;
+	}
+	remove(flashFile);
+	if (!host_flash_init(flashFile))
+		return 1;
+	host_set_quiet(true);
+	spiffs_config cfg;
+	if (!loadImage(cfg))
+		return 1;
+
+	Vector<int> trace;
+	buildTrace(trace);
+	uint32_t bytes = 0;
+	for (int i = 0; i < trace.count(); i++)
+		bytes += webFiles[trace[i]].size;
+	host_printf("%d requests, %u KB in %d files\n", trace.count(), bytes / 1024, WEB_FILES);
+
+	bool ok = true;
+	int pages[] = { 2, 4, 8, 16, 32 };
+	for (unsigned i = 0; i < sizeof(pages) / sizeof(pages[0]); i++)
+		ok &= replay(trace, pages[i]);
+
+	host_flash_end();
+	remove(flashFile);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// Heap allocations made while HttpServer serves a recorded browser session:
+// page, assets, AJAX polling with query parameters and a form post, on one
+// keep-alive connection. Then header lines split into name and value with
+// String substring() against StringView. "make bench" runs it twice, second
+// time built with STRING_SSO_CAPACITY=0, where every String is on heap like before.
+
+#include <user_config.h>
+#include <stdio.h>
+#include "../host.h"
+#include "Network/HttpServer.h"
+#include "Network/HttpRequest.h"
+#include "Network/HttpResponse.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static long allocations = 0;
+// Fitting into inline buffer of String with terminator
+static long shortAllocations = 0;
+
+static void* counted(void* ptr, size_t size)
+{
+	allocations++;
+	if (size <= 12)
+		shortAllocations++;
+	return ptr;
+}
+
+extern "C" void* malloc(size_t size)
+{
+	return counted(__libc_malloc(size), size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+	return counted(__libc_calloc(count, size), count * size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size)
+{
+	return counted(__libc_realloc(ptr, size), size);
+}
+
+extern "C" void free(void* ptr)
+{
+	__libc_free(ptr);
+}
+
+#if STRING_SSO_CAPACITY > 0
+#define VARIANT "inline buffer"
+#else
+#define VARIANT "heap only"
+#endif
+
+#define PORT 80
+#define SESSIONS 100
+
+#define BROWSER_HEADERS \
+	"Host: 192.168.1.50\r\n" \
+	"Connection: keep-alive\r\n" \
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:52.0) Gecko/20100101 Firefox/52.0\r\n" \
+	"Accept-Language: en-US,en;q=0.5\r\n" \
+	"Accept-Encoding: gzip, deflate\r\n"
+
+// Captured from a browser opening device settings page, then polling state
+static const char* session[] = {
+	"GET / HTTP/1.1\r\n" BROWSER_HEADERS
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n\r\n",
+	"GET /style.css HTTP/1.1\r\n" BROWSER_HEADERS
+	"Accept: text/css,*/*;q=0.1\r\nReferer: http://192.168.1.50/\r\n\r\n",
+	"GET /app.js HTTP/1.1\r\n" BROWSER_HEADERS
+	"Accept: */*\r\nReferer: http://192.168.1.50/\r\n\r\n",
+	"GET /api/state?sensor=2&unit=c HTTP/1.1\r\n" BROWSER_HEADERS
+	"Accept: application/json\r\nX-Requested-With: XMLHttpRequest\r\nReferer: http://192.168.1.50/\r\n\r\n",
+	"GET /api/state?sensor=3&unit=f HTTP/1.1\r\n" BROWSER_HEADERS
+	"Accept: application/json\r\nX-Requested-With: XMLHttpRequest\r\nReferer: http://192.168.1.50/\r\n\r\n",
+	"POST /settings HTTP/1.1\r\n" BROWSER_HEADERS
+	"Content-Type: application/x-www-form-urlencoded\r\nContent-Length: 36\r\n"
+	"Referer: http://192.168.1.50/\r\n\r\n"
+	"ssid=home&password=secret&mode=auto",
+	"GET /favicon.ico HTTP/1.1\r\n" BROWSER_HEADERS
+	"Accept: image/png,image/*;q=0.8,*/*;q=0.5\r\n\r\n",
+};
+
+#define REQUESTS (sizeof(session) / sizeof(session[0]))
+
+static void onIndex(HttpRequest& request, HttpResponse& response)
+{
+	response.setContentType(ContentType::HTML);
+	response.sendString("<html><head><link rel=\"stylesheet\" href=\"style.css\"><script src=\"app.js\"></script>"
+		"</head><body><div id=\"state\"></div></body></html>");
+}
+
+static void onAsset(HttpRequest& request, HttpResponse& response)
+{
+	response.setCache(86400, true);
+	response.sendString("/* asset */");
+}
+
+static void onState(HttpRequest& request, HttpResponse& response)
+{
+	String sensor = request.getQueryParameter("sensor");
+	String unit = request.getQueryParameter("unit", "c");
+	response.setContentType(ContentType::JSON);
+	response.setHeader("Cache-Control", "no-cache");
+	response.sendString("{\"sensor\":" + sensor + ",\"value\":21.5,\"unit\":\"" + unit + "\"}");
+}
+
+static void onSettings(HttpRequest& request, HttpResponse& response)
+{
+	String ssid = request.getPostParameter("ssid");
+	String mode = request.getPostParameter("mode");
+	response.setContentType(ContentType::JSON);
+	response.sendString(ssid.length() > 0 && mode == "auto" ? "{\"saved\":true}" : "{\"saved\":false}");
+}
+
+static void onNotFound(HttpRequest& request, HttpResponse& response)
+{
+	response.notFound();
+	response.sendString("Not found");
+}
+
+// Everything sent is taken and acknowledged
+static uint32_t drain(tcp_pcb* pcb)
+{
+	uint32_t received = 0;
+	while (host_tcp_available(pcb) > 0 || host_tcp_unacked(pcb) > 0)
+	{
+		received += host_tcp_read(pcb, NULL, host_tcp_available(pcb));
+		host_tcp_ack(pcb, host_tcp_unacked(pcb));
+	}
+	return received;
+}
+
+static bool serve()
+{
+	HttpServer server;
+	server.addPath("/", onIndex);
+	server.addPath("/style.css", onAsset);
+	server.addPath("/app.js", onAsset);
+	server.addPath("/api/state", onState);
+	server.addPath("/settings", onSettings);
+	server.setDefaultHandler(onNotFound);
+	server.listen(PORT);
+
+	tcp_pcb* pcb = host_tcp_accept(PORT);
+	uint32_t received = 0;
+	long before = allocations;
+	long beforeShort = shortAllocations;
+	for (int s = 0; s < SESSIONS; s++)
+	{
+		for (unsigned r = 0; r < REQUESTS; r++)
+		{
+			host_tcp_receive(pcb, session[r], strlen(session[r]), 0);
+			received += drain(pcb);
+		}
+	}
+	bool ok = !host_tcp_closed(pcb) && received > 0;
+	host_tcp_remote_close(pcb);
+	host_tcp_free(pcb);
+
+	host_printf("%-14s HTTP session: %5.1f allocations per request, %5.1f of them up to 12 bytes%s\n", VARIANT,
+		(double)(allocations - before) / (SESSIONS * REQUESTS),
+		(double)(shortAllocations - beforeShort) / (SESSIONS * REQUESTS), ok ? "" : " - FAILED");
+	return ok;
+}
+
+// Header lines of the session, split like HttpRequest does
+static bool splitHeaders()
+{
+	int lines = 0;
+	long contentLength = 0;
+	long before = allocations;
+	for (unsigned r = 0; r < REQUESTS; r++)
+	{
+		String request = session[r];
+		int pos = request.indexOf('\n') + 1;
+		int next;
+		while ((next = request.indexOf('\n', pos)) > pos + 1)
+		{
+			int end = next - 1;
+			int colon = request.indexOf(':', pos);
+			String name = request.substring(pos, colon);
+			String value = request.substring(colon + 1, end);
+			value.trim();
+			if (name.equalsIgnoreCase("Content-Length"))
+				contentLength += value.toInt();
+			pos = next + 1;
+			lines++;
+		}
+	}
+	long stringAllocations = allocations - before;
+
+	long viewLength = 0;
+	before = allocations;
+	for (unsigned r = 0; r < REQUESTS; r++)
+	{
+		StringView request = session[r];
+		int pos = request.indexOf('\n') + 1;
+		int next;
+		while ((next = request.indexOf('\n', pos)) > pos + 1)
+		{
+			int end = next - 1;
+			int colon = request.indexOf(':', pos);
+			StringView name = request.substring(pos, colon);
+			StringView value = request.substring(colon + 1, end).trim();
+			if (name.equalsIgnoreCase("Content-Length"))
+				viewLength += value.toInt();
+			pos = next + 1;
+		}
+	}
+	long viewAllocations = allocations - before;
+
+	host_printf("%-14s %d header lines: String %ld allocations, StringView %ld%s\n", VARIANT, lines,
+		stringAllocations, viewAllocations, contentLength == viewLength ? "" : " - MISMATCH");
+	return contentLength == viewLength && contentLength > 0;
+}
+
+int main()
+{
+	host_set_quiet(true);
+
+	bool ok = serve();
+	ok &= splitHeaders();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// TemplateFileStream rendering of a page with variables in SPIFFS, against the
+// former stream scanning text for variables on each read. Template rewritten
+// in place with the same size must be rendered with new content, and nothing
+// may be stored next to it.
+// Usage: TemplateFileStreamBench [flash file]
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include "../host.h"
+#include "FileSystem.h"
+#include "DataSourceStream.h"
+#include "Network/TcpConnection.h"
+
+#define TEMPLATE_NAME	"page.html"
+#define VARIABLES		20
+#define RENDERS			500
+
+// Former TemplateFileStream, looks for variables in each block read from file
+class ScanningTemplateStream : public FileStream
+{
+public:
+	ScanningTemplateStream(String templateFileName) : FileStream(templateFileName) {}
+
+	virtual uint16_t readMemoryBlock(char* data, int bufSize)
+	{
+		if (state == eTES_StartVar)
+		{
+			if (templateData.contains(varName))
+			{
+				int available = templateData[varName].length();
+				memcpy(data, templateData[varName].c_str(), available);
+				seek(skipBlockSize);
+				varDataPos = 0;
+				state = eTES_SendingVar;
+				return available;
+			}
+			state = eTES_Wait;
+			int len = FileStream::readMemoryBlock(data, bufSize);
+			return min(len, skipBlockSize);
+		}
+		else if (state == eTES_SendingVar)
+		{
+			String& val = templateData[varName];
+			if (varDataPos < (int)val.length())
+			{
+				int available = val.length() - varDataPos;
+				memcpy(data, val.c_str() + varDataPos, available);
+				return available;
+			}
+			state = eTES_Wait;
+		}
+
+		int len = FileStream::readMemoryBlock(data, bufSize);
+		char* tpl = data;
+		if (len > 0)
+		{
+			char* end = tpl + len;
+			char* cur = (char*)memchr(tpl, '{', len);
+			char* lastFound = cur;
+			while (cur != NULL)
+			{
+				lastFound = cur;
+				char* p = cur + 1;
+				for (; p < end; p++)
+				{
+					if (isspace(*p) || p - cur > TEMPLATE_MAX_VAR_NAME_LEN || *p == '{')
+						break;
+					if (*p == '}')
+					{
+						varName = String(cur + 1, p - cur - 1);
+						state = eTES_Found;
+						varWaitSize = cur - tpl;
+						skipBlockSize = p - cur + 1;
+						return cur - tpl;
+					}
+				}
+				cur = (char*)memchr(p, '{', len - (p - tpl));
+			}
+			if (lastFound != NULL && (lastFound - tpl) > (len - TEMPLATE_MAX_VAR_NAME_LEN))
+				len = lastFound - tpl;
+		}
+		return len;
+	}
+
+	virtual bool seek(int len)
+	{
+		if (len < 0) return false;
+		if (state == eTES_Found)
+		{
+			varWaitSize -= len;
+			if (varWaitSize == 0) state = eTES_StartVar;
+		}
+		else if (state == eTES_SendingVar)
+		{
+			varDataPos += len;
+			return false;
+		}
+		return FileStream::seek(len);
+	}
+
+	virtual bool isFinished() { return FileStream::isFinished() && state == eTES_Wait; }
+
+	void setVar(String name, String value) { templateData[name] = value; }
+
+private:
+	enum { eTES_Wait, eTES_Found, eTES_StartVar, eTES_SendingVar } state = eTES_Wait;
+	HashMap<String, String> templateData;
+	String varName;
+	int varWaitSize = 0;
+	int skipBlockSize = 0;
+	int varDataPos = 0;
+};
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Table of settings, each row has a variable, and expected rendering
+static void createTemplate(const char* name, char marker, String& expected)
+{
+	String content = "<html><body><table>\n";
+	expected = content;
+	char line[128];
+	for (int row = 0; row < 60; row++)
+	{
+		int var = row % VARIABLES;
+		sprintf(line, "<tr><td>setting %c%02d</td><td class=\"value\">{var%d}</td><td>unit</td></tr>\n", marker, row, var);
+		content += line;
+		sprintf(line, "<tr><td>setting %c%02d</td><td class=\"value\">value %d</td><td>unit</td></tr>\n", marker, row, var);
+		expected += line;
+	}
+	content += "</table></body></html>\n";
+	expected += "</table></body></html>\n";
+	fileSetContent(name, content);
+}
+
+template<typename S>
+static String render(S& stream)
+{
+	char var[16], value[16];
+	for (int i = 0; i < VARIABLES; i++)
+	{
+		sprintf(var, "var%d", i);
+		sprintf(value, "value %d", i);
+		stream.setVar(var, value);
+	}
+
+	String result;
+	char block[NETWORK_SEND_BUFFER_SIZE + 1];
+	while (!stream.isFinished())
+	{
+		int len = stream.readMemoryBlock(block, NETWORK_SEND_BUFFER_SIZE);
+		block[len] = '\0';
+		result += block;
+		stream.seek(len);
+	}
+	return result;
+}
+
+template<typename S>
+static double measure(const char* name, const char* fileName, const String& expected, bool& ok)
+{
+	double t = now();
+	for (int i = 0; i < RENDERS; i++)
+	{
+		S stream(fileName);
+		if (render(stream) != expected)
+			ok = false;
+	}
+	t = (now() - t) / RENDERS;
+	host_printf("%-18s %6.1f us per page, %5.2f MB/s\n", name, t * 1e6, expected.length() / t / 1e6);
+	return t;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* flashFile = argc > 1 ? argv[1] : "template_bench.bin";
+	remove(flashFile);
+	if (!host_flash_init(flashFile))
+		return 1;
+	host_set_quiet(true);
+	spiffs_mount();
+
+	String expected;
+	createTemplate(TEMPLATE_NAME, 'a', expected);
+	int filesCount = fileList().count();
+	bool ok = true;
+
+	host_printf("%d bytes page\n", expected.length());
+	measure<TemplateFileStream>("compiled", TEMPLATE_NAME, expected, ok);
+	measure<ScanningTemplateStream>("scanning (former)", TEMPLATE_NAME, expected, ok);
+
+	// Same size, other content: variables are at other offsets
+	String content = fileGetContent(TEMPLATE_NAME);
+	content.replace("{var1}", "{var2}");
+	content.replace("setting a", "setting b");
+	content = "\n" + content.substring(0, content.length() - 1);
+	file_t file = fileOpen(TEMPLATE_NAME, eFO_WriteOnly | eFO_Truncate);
+	fileWrite(file, content.c_str(), content.length());
+	fileClose(file);
+	String rewritten;
+	createTemplate("expected.html", 'b', rewritten);
+	fileDelete("expected.html");
+	rewritten.replace("value 1<", "value 2<");
+	rewritten = "\n" + rewritten.substring(0, rewritten.length() - 1);
+	{
+		TemplateFileStream stream(TEMPLATE_NAME);
+		bool same = render(stream) == rewritten;
+		host_printf("rewritten in place with same size: %s\n", same ? "ok" : "FAILED, stale compiled template");
+		ok &= same;
+	}
+
+	if (fileList().count() != filesCount)
+	{
+		host_printf("files were added next to template\n");
+		ok = false;
+	}
+
+	spiffs_unmount();
+	host_flash_end();
+	remove(flashFile);
+	return ok ? 0 : 1;
+}
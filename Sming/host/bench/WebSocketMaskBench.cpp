@@ -0,0 +1,78 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// WebSocket payload unmasking speed of wsMaskData() for 16 bytes to 16 KB,
+// against the former byte loop. Payload at word boundary, and one byte after
+// it with key offset 3, like a continued frame part. Results must be the same.
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include "../host.h"
+#include "../../Services/cWebsocket/websocket.h"
+
+#define BYTES_PER_SIZE (64 * 1024 * 1024)
+#define MAX_SIZE (16 * 1024)
+
+// Former wsMaskData()
+static void __attribute__((noinline)) formerMaskData(uint8_t* data, size_t length, const uint8_t* maskingKey, size_t maskOffset)
+{
+	for (size_t i = 0; i < length; i++)
+		data[i] ^= maskingKey[(maskOffset + i) % 4];
+}
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+typedef void (*MaskFunction)(uint8_t* data, size_t length, const uint8_t* maskingKey, size_t maskOffset);
+
+static double measure(MaskFunction mask, uint8_t* data, size_t size, size_t maskOffset)
+{
+	static const uint8_t key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+	int repeat = BYTES_PER_SIZE / size;
+	double t = now();
+	for (int i = 0; i < repeat; i++)
+		mask(data, size, key, maskOffset);
+	t = now() - t;
+	return (double)size * repeat / t / 1e6;
+}
+
+static bool run(size_t size, size_t misalign, size_t maskOffset)
+{
+	static uint32_t storage[2][MAX_SIZE / 4 + 1];
+	uint8_t* current = (uint8_t*)storage[0] + misalign;
+	uint8_t* former = (uint8_t*)storage[1] + misalign;
+	for (size_t i = 0; i < size; i++)
+		current[i] = former[i] = (uint8_t)(i * 7);
+
+	// Repeat count is even, so both end with original data
+	double currentSpeed = measure(wsMaskData, current, size, maskOffset);
+	double formerSpeed = measure(formerMaskData, former, size, maskOffset);
+	static const uint8_t key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+	wsMaskData(current, size, key, maskOffset);
+	formerMaskData(former, size, key, maskOffset);
+	bool same = memcmp(current, former, size) == 0;
+
+	host_printf("%5u bytes %-9s %7.0f MB/s, former %6.0f MB/s%s\n", (unsigned)size,
+		misalign ? "unaligned" : "", currentSpeed, formerSpeed, same ? "" : " - MISMATCH");
+	return same;
+}
+
+int main()
+{
+	bool ok = true;
+	for (size_t size = 16; size <= MAX_SIZE; size *= 4)
+	{
+		ok &= run(size, 0, 0);
+		ok &= run(size, 1, 3);
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#ifndef _SMING_HOST_H_
+#define _SMING_HOST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of new flash file, existing file keeps its size
+#ifndef HOST_FLASH_SIZE
+#define HOST_FLASH_SIZE (4 * 1024 * 1024)
+#endif
+// Flash used by firmware on device, file system starts after it
+#ifndef HOST_FLASH_CODE_SIZE
+#define HOST_FLASH_CODE_SIZE 0x100000
+#endif
+// Reported by system_get_free_heap_size() unless changed with host_set_free_heap()
+#ifndef HOST_FREE_HEAP
+#define HOST_FREE_HEAP 40000
+#endif
+
+bool host_flash_init(const char* fileName);
+void host_flash_end();
+// Simulates power loss: flash is changed only by next given number of written bytes,
+// the last write is torn. Call with -1 to power on again.
+void host_flash_power_cut(int32_t bytes);
+
+struct host_flash_stats
+{
+	uint32_t reads; // spi_flash_read() calls
+	uint32_t readBytes;
+	uint32_t erases; // Sectors
+};
+
+void host_flash_get_stats(struct host_flash_stats* stats);
+void host_flash_reset_stats();
+// Sector erase takes this long, like on device (tens of ms), 0 - instant
+void host_flash_set_erase_time(uint32_t us);
+
+// Emulated TCP, host_tcp.c. Framework side uses lwIP API, these functions act
+// as the other side of connections. Results are lwIP err_t codes.
+struct tcp_pcb;
+
+struct host_tcp_stats
+{
+	uint32_t writes; // tcp_write() calls
+	uint32_t segments; // Data split by MSS between tcp_output() calls
+	uint32_t bytes;
+	uint32_t copied; // Written with TCP_WRITE_FLAG_COPY
+	uint32_t aborts;
+};
+
+// Connects to listening port, returns NULL if nothing listens or connection was refused
+struct tcp_pcb* host_tcp_accept(uint16_t port);
+// Connection created by the last tcp_connect(), completed by host_tcp_connected()
+struct tcp_pcb* host_tcp_last_connect();
+int8_t host_tcp_connected(struct tcp_pcb* pcb);
+// Delivers data as one pbuf chain with pbufs of pbufLength bytes, 0 - single pbuf
+int8_t host_tcp_receive(struct tcp_pcb* pcb, const void* data, int length, int pbufLength);
+int8_t host_tcp_remote_close(struct tcp_pcb* pcb);
+// Takes data written by the framework, buffer can be NULL to drop it
+int host_tcp_read(struct tcp_pcb* pcb, void* buffer, int size);
+uint32_t host_tcp_available(struct tcp_pcb* pcb);
+// Acknowledges sent data and calls sent callback, send buffer space is returned
+int8_t host_tcp_ack(struct tcp_pcb* pcb, uint32_t length);
+uint32_t host_tcp_unacked(struct tcp_pcb* pcb);
+int8_t host_tcp_poll(struct tcp_pcb* pcb);
+// Closed or aborted by the framework
+bool host_tcp_closed(struct tcp_pcb* pcb);
+// Connections are kept after close, so results can be checked. Free them only when closed.
+void host_tcp_free(struct tcp_pcb* pcb);
+void host_tcp_get_stats(struct host_tcp_stats* stats);
+void host_tcp_reset_stats();
+
+// Free heap size seen by the framework, to test low memory paths
+void host_set_free_heap(uint32_t size);
+
+// Runs expired timers and posted tasks.
+// Returns microseconds until next timer, -1 when no timer is armed.
+int64_t host_service_timers();
+// Services timers until host_stop()
+void host_loop();
+void host_stop();
+
+int host_printf(const char* fmt, ...);
+// Drops framework debug output, host_printf() isn't affected
+void host_set_quiet(bool quiet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SMING_HOST_H_ */
@@ -0,0 +1,164 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// SPI flash emulated by a file mapped into memory.
+// Like NOR flash, writes only clear bits and erase sets whole sector to 0xFF.
+
+#include <user_config.h>
+#include "flashmem.h"
+#include "host.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint8_t* flash = NULL;
+static uint32_t flashSize = 0;
+static int flashFile = -1;
+static int32_t powerCut = -1; // Bytes written until power is lost, -1 - never
+static struct host_flash_stats stats;
+static uint32_t eraseTime = 0; // us
+
+bool host_flash_init(const char* fileName)
+{
+	if (flash != NULL)
+		return true;
+
+	flashFile = open(fileName, O_RDWR | O_CREAT, 0644);
+	if (flashFile < 0)
+	{
+		host_printf("flash: can't open %s\n", fileName);
+		return false;
+	}
+
+	struct stat st;
+	fstat(flashFile, &st);
+	bool created = st.st_size == 0;
+	flashSize = created ? HOST_FLASH_SIZE : st.st_size;
+	if (created && ftruncate(flashFile, flashSize) != 0)
+	{
+		close(flashFile);
+		flashFile = -1;
+		return false;
+	}
+
+	flash = (uint8_t*)mmap(NULL, flashSize, PROT_READ | PROT_WRITE, MAP_SHARED, flashFile, 0);
+	if (flash == MAP_FAILED)
+	{
+		flash = NULL;
+		close(flashFile);
+		flashFile = -1;
+		return false;
+	}
+	if (created)
+		memset(flash, 0xFF, flashSize);
+
+	host_printf("flash: %s, %u KB\n", fileName, flashSize / 1024);
+	return true;
+}
+
+void host_flash_end()
+{
+	if (flash == NULL)
+		return;
+	munmap(flash, flashSize);
+	close(flashFile);
+	flash = NULL;
+	flashFile = -1;
+}
+
+void host_flash_power_cut(int32_t bytes)
+{
+	powerCut = bytes;
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint16_t sec)
+{
+	uint32_t offset = sec * SPI_FLASH_SEC_SIZE;
+	if (flash == NULL || offset + SPI_FLASH_SEC_SIZE > flashSize)
+		return SPI_FLASH_RESULT_ERR;
+	if (powerCut == 0)
+		return SPI_FLASH_RESULT_OK; // Device is off, nothing changes
+	stats.erases++;
+	if (eraseTime > 0)
+		usleep(eraseTime);
+	memset(flash + offset, 0xFF, SPI_FLASH_SEC_SIZE);
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_write(uint32_t des_addr, uint32_t *src_addr, uint32_t size)
+{
+	if (flash == NULL || des_addr + size > flashSize)
+		return SPI_FLASH_RESULT_ERR;
+	const uint8_t* src = (const uint8_t*)src_addr;
+	if (powerCut >= 0)
+	{
+		// Write is torn, caller doesn't notice as it isn't running any more
+		if (size > (uint32_t)powerCut)
+			size = powerCut;
+		powerCut -= size;
+	}
+	uint32_t i;
+	for (i = 0; i < size; i++)
+		flash[des_addr + i] &= src[i];
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_read(uint32_t src_addr, uint32_t *des_addr, uint32_t size)
+{
+	if (flash == NULL || src_addr + size > flashSize)
+		return SPI_FLASH_RESULT_ERR;
+	stats.reads++;
+	stats.readBytes += size;
+	memcpy(des_addr, flash + src_addr, size);
+	return SPI_FLASH_RESULT_OK;
+}
+
+void host_flash_get_stats(struct host_flash_stats* result)
+{
+	*result = stats;
+}
+
+void host_flash_reset_stats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void host_flash_set_erase_time(uint32_t us)
+{
+	eraseTime = us;
+}
+
+SPIFlashInfo flashmem_get_info()
+{
+	SPIFlashInfo info;
+	memset(&info, 0, sizeof(info));
+	switch (flashSize)
+	{
+	case 256 * 1024:
+		info.size = SIZE_2MBIT;
+		break;
+	case 512 * 1024:
+		info.size = SIZE_4MBIT;
+		break;
+	case 1024 * 1024:
+		info.size = SIZE_8MBIT;
+		break;
+	case 2048 * 1024:
+		info.size = SIZE_16MBIT;
+		break;
+	default:
+		info.size = SIZE_32MBIT;
+	}
+	return info;
+}
+
+// There is no firmware in flash file, file system follows reserved area
+uint32_t flashmem_get_first_free_block_address()
+{
+	return INTERNAL_FLASH_START_ADDRESS + HOST_FLASH_CODE_SIZE;
+}
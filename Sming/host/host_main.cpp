@@ -0,0 +1,28 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// Host replacement of appinit/user_main.cpp.
+// Flash file name is taken from SMING_HOST_FLASH, "flash.bin" by default.
+
+#include <user_config.h>
+#include <stdlib.h>
+#include "host.h"
+
+extern void init();
+
+int main(int argc, char* argv[])
+{
+	const char* flashFile = getenv("SMING_HOST_FLASH");
+	if (!host_flash_init(flashFile != NULL ? flashFile : "flash.bin"))
+		return 1;
+
+	init(); // User code init
+	host_loop();
+
+	host_flash_end();
+	return 0;
+}
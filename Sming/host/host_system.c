@@ -0,0 +1,301 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// System API of Espressif SDK used by Sming Core, implemented on host.
+// Timers and tasks run from host_service_timers(), never concurrently with caller.
+
+#include <user_config.h>
+#include "host.h"
+#include <stdlib.h>
+#include <time.h>
+
+#define HOST_TASK_PRIORITIES 3
+
+struct host_task
+{
+	os_task_t task;
+	os_event_t *queue;
+	uint8_t length;
+	uint8_t head;
+	uint8_t count;
+};
+
+static ETSTimer* timers = NULL; // Sorted by expire time
+static struct host_task tasks[HOST_TASK_PRIORITIES];
+static uint32_t freeHeap = HOST_FREE_HEAP;
+static volatile bool stopped = false;
+static bool quiet = false;
+static struct rst_info resetInfo;
+
+static uint64_t host_time_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int host_printf(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	int n = vprintf(fmt, args);
+	va_end(args);
+	return n;
+}
+
+/* Timers */
+
+static void host_timer_remove(ETSTimer *ptimer)
+{
+	ETSTimer** p;
+	for (p = &timers; *p != NULL; p = &(*p)->timer_next)
+	{
+		if (*p == ptimer)
+		{
+			*p = ptimer->timer_next;
+			break;
+		}
+	}
+	ptimer->timer_next = NULL;
+}
+
+static void host_timer_insert(ETSTimer *ptimer)
+{
+	ETSTimer** p = &timers;
+	while (*p != NULL && (*p)->timer_expire <= ptimer->timer_expire)
+		p = &(*p)->timer_next;
+	ptimer->timer_next = *p;
+	*p = ptimer;
+}
+
+void ets_timer_setfn(ETSTimer *t, ETSTimerFunc *pfunction, void *parg)
+{
+	host_timer_remove(t);
+	t->timer_func = pfunction;
+	t->timer_arg = parg;
+}
+
+void ets_timer_arm_new(ETSTimer *ptimer, uint32_t milliseconds, bool repeat_flag, int isMstimer)
+{
+	uint32_t us = isMstimer ? milliseconds * 1000 : milliseconds;
+	host_timer_remove(ptimer);
+	ptimer->timer_expire = host_time_us() + us;
+	ptimer->timer_period = repeat_flag ? us : 0;
+	host_timer_insert(ptimer);
+}
+
+void ets_timer_disarm(ETSTimer *a)
+{
+	host_timer_remove(a);
+}
+
+/* Tasks */
+
+bool system_os_task(os_task_t task, uint8_t prio, os_event_t *queue, uint8_t qlen)
+{
+	if (prio >= HOST_TASK_PRIORITIES || queue == NULL || qlen == 0)
+		return false;
+	struct host_task* t = &tasks[prio];
+	t->task = task;
+	t->queue = queue;
+	t->length = qlen;
+	t->head = 0;
+	t->count = 0;
+	return true;
+}
+
+bool system_os_post(uint8_t prio, os_signal_t sig, os_param_t par)
+{
+	if (prio >= HOST_TASK_PRIORITIES)
+		return false;
+	struct host_task* t = &tasks[prio];
+	if (t->task == NULL || t->count == t->length)
+		return false;
+	os_event_t* e = &t->queue[(t->head + t->count++) % t->length];
+	e->sig = sig;
+	e->par = par;
+	return true;
+}
+
+static bool host_run_task()
+{
+	int prio;
+	for (prio = HOST_TASK_PRIORITIES - 1; prio >= 0; prio--)
+	{
+		struct host_task* t = &tasks[prio];
+		if (t->count == 0)
+			continue;
+		os_event_t e = t->queue[t->head];
+		t->head = (t->head + 1) % t->length;
+		t->count--;
+		t->task(&e);
+		return true;
+	}
+	return false;
+}
+
+/* Event loop */
+
+int64_t host_service_timers()
+{
+	while (host_run_task())
+		;
+
+	uint64_t now = host_time_us();
+	while (timers != NULL && timers->timer_expire <= now)
+	{
+		ETSTimer* t = timers;
+		host_timer_remove(t);
+		// Repeated timer is armed again before callback, callback may disarm it
+		if (t->timer_period != 0)
+		{
+			t->timer_expire += t->timer_period;
+			if (t->timer_expire < now)
+				t->timer_expire = now;
+			host_timer_insert(t);
+		}
+		if (t->timer_func != NULL)
+			t->timer_func(t->timer_arg);
+
+		while (host_run_task())
+			;
+	}
+
+	if (timers == NULL)
+		return -1;
+	now = host_time_us();
+	return timers->timer_expire > now ? timers->timer_expire - now : 0;
+}
+
+void host_loop()
+{
+	stopped = false;
+	while (!stopped)
+	{
+		int64_t wait = host_service_timers();
+		if (wait < 0)
+			break; // Nothing can happen anymore
+		if (wait > 0)
+		{
+			struct timespec ts = { wait / 1000000, (wait % 1000000) * 1000 };
+			nanosleep(&ts, NULL);
+		}
+	}
+}
+
+void host_stop()
+{
+	stopped = true;
+}
+
+/* System */
+
+uint32_t system_get_time(void)
+{
+	return (uint32_t)host_time_us();
+}
+
+void host_set_free_heap(uint32_t size)
+{
+	freeHeap = size;
+}
+
+uint32_t system_get_free_heap_size(void)
+{
+	return freeHeap;
+}
+
+const char* system_get_sdk_version(void)
+{
+	return "host";
+}
+
+struct rst_info* system_get_rst_info(void)
+{
+	return &resetInfo;
+}
+
+void system_soft_wdt_feed(void)
+{
+}
+
+void system_soft_wdt_restart(void)
+{
+}
+
+void system_soft_wdt_stop(void)
+{
+}
+
+void system_restart(void)
+{
+	host_printf("system_restart\n");
+	exit(0);
+}
+
+void ets_wdt_enable(void)
+{
+}
+
+void ets_wdt_disable(void)
+{
+}
+
+void ets_intr_lock()
+{
+}
+
+void ets_intr_unlock()
+{
+}
+
+void ets_delay_us(uint32_t us)
+{
+	struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+	nanosleep(&ts, NULL);
+}
+
+void *pvPortMalloc(size_t xWantedSize)
+{
+	return malloc(xWantedSize);
+}
+
+void *pvPortZalloc(size_t size)
+{
+	return calloc(1, size);
+}
+
+void vPortFree(void *ptr)
+{
+	free(ptr);
+}
+
+void uart_tx_one_char(char ch)
+{
+	putchar(ch);
+}
+
+int m_vsnprintf(char *buf, size_t maxLen, const char *fmt, va_list args)
+{
+	return vsnprintf(buf, maxLen, fmt, args);
+}
+
+void host_set_quiet(bool value)
+{
+	quiet = value;
+}
+
+int m_printf(const char *fmt, ...)
+{
+	if (quiet)
+		return 0;
+	va_list args;
+	va_start(args, fmt);
+	int n = vprintf(fmt, args);
+	va_end(args);
+	return n;
+}
@@ -0,0 +1,417 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// lwIP raw TCP API emulated in memory, nothing goes to network.
+// Data written by the framework is collected per connection. Other side of
+// connection is driven by host_tcp_*() functions, which call the callbacks
+// like lwIP does: received data, acknowledgements, polls and remote close.
+
+#include <user_config.h>
+#include "lwip/tcp.h"
+#include "lwip/dns.h"
+#include "host.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define HOST_TCP_QUEUE 16
+
+struct host_pcb
+{
+	struct tcp_pcb pcb;
+	struct host_pcb* link; // All connections
+	uint8_t* out; // Written, not taken by host_tcp_read()
+	uint32_t outLength;
+	uint32_t outSize;
+	uint32_t unsent; // Written since last tcp_output()
+	// Lengths of writes waiting for acknowledge, like lwIP send queue
+	uint16_t queue[HOST_TCP_QUEUE];
+	uint8_t queueHead;
+	bool closed; // By framework
+};
+
+const ip_addr_t ip_addr_any = { 0 };
+
+static struct host_pcb* pcbs = NULL;
+static struct tcp_pcb* lastConnect = NULL;
+static struct host_tcp_stats stats;
+
+static void host_tcp_segments(struct host_pcb* hp)
+{
+	stats.segments += (hp->unsent + TCP_MSS - 1) / TCP_MSS;
+	hp->unsent = 0;
+}
+
+struct tcp_pcb* tcp_new(void)
+{
+	struct host_pcb* hp = (struct host_pcb*)calloc(1, sizeof(struct host_pcb));
+	if (hp == NULL)
+		return NULL;
+	hp->pcb.state = CLOSED;
+	hp->pcb.snd_buf = TCP_SND_BUF;
+	hp->pcb.mss = TCP_MSS;
+	hp->link = pcbs;
+	pcbs = hp;
+	return &hp->pcb;
+}
+
+void tcp_arg(struct tcp_pcb *pcb, void *arg)
+{
+	pcb->callback_arg = arg;
+}
+
+void tcp_recv(struct tcp_pcb *pcb, tcp_recv_fn recv)
+{
+	pcb->recv = recv;
+}
+
+void tcp_sent(struct tcp_pcb *pcb, tcp_sent_fn sent)
+{
+	pcb->sent = sent;
+}
+
+void tcp_err(struct tcp_pcb *pcb, tcp_err_fn err)
+{
+	pcb->errf = err;
+}
+
+void tcp_poll(struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interval)
+{
+	pcb->poll = poll;
+	pcb->pollinterval = interval;
+}
+
+void tcp_accept(struct tcp_pcb *pcb, tcp_accept_fn accept)
+{
+	pcb->accept = accept;
+}
+
+err_t tcp_bind(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port)
+{
+	pcb->local_port = port;
+	return ERR_OK;
+}
+
+struct tcp_pcb* tcp_listen_with_backlog(struct tcp_pcb *pcb, u8_t backlog)
+{
+	pcb->state = LISTEN;
+	return pcb;
+}
+
+err_t tcp_connect(struct tcp_pcb *pcb, ip_addr_t *ipaddr, u16_t port, tcp_connected_fn connected)
+{
+	pcb->remote_port = port;
+	if (ipaddr != NULL)
+		pcb->remote_ip = *ipaddr;
+	pcb->connected = connected;
+	pcb->state = SYN_SENT;
+	lastConnect = pcb;
+	return ERR_OK;
+}
+
+err_t tcp_write(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags)
+{
+	struct host_pcb* hp = (struct host_pcb*)pcb;
+	if (hp->closed || pcb->state != ESTABLISHED)
+		return ERR_CONN;
+	if (len > pcb->snd_buf || pcb->snd_queuelen >= TCP_SND_QUEUELEN)
+		return ERR_MEM;
+	if (len == 0)
+		return ERR_OK;
+
+	if (hp->outLength + len > hp->outSize)
+	{
+		uint32_t size = hp->outSize * 2 + len;
+		uint8_t* out = (uint8_t*)realloc(hp->out, size);
+		if (out == NULL)
+			return ERR_MEM;
+		hp->out = out;
+		hp->outSize = size;
+	}
+	// Referenced data is copied at once, framework keeps it until acknowledge anyway
+	memcpy(hp->out + hp->outLength, dataptr, len);
+	hp->outLength += len;
+	hp->unsent += len;
+
+	hp->queue[(hp->queueHead + pcb->snd_queuelen) % HOST_TCP_QUEUE] = len;
+	pcb->snd_queuelen++;
+	pcb->snd_buf -= len;
+
+	stats.writes++;
+	stats.bytes += len;
+	if (apiflags & TCP_WRITE_FLAG_COPY)
+		stats.copied += len;
+	return ERR_OK;
+}
+
+err_t tcp_output(struct tcp_pcb *pcb)
+{
+	host_tcp_segments((struct host_pcb*)pcb);
+	return ERR_OK;
+}
+
+void tcp_recved(struct tcp_pcb *pcb, u16_t len)
+{
+}
+
+err_t tcp_close(struct tcp_pcb *pcb)
+{
+	struct host_pcb* hp = (struct host_pcb*)pcb;
+	host_tcp_segments(hp);
+	hp->closed = true;
+	pcb->callback_arg = NULL;
+	pcb->recv = NULL;
+	pcb->sent = NULL;
+	pcb->poll = NULL;
+	pcb->errf = NULL;
+	pcb->accept = NULL;
+	return ERR_OK;
+}
+
+void tcp_abort(struct tcp_pcb *pcb)
+{
+	tcp_err_fn errf = pcb->errf;
+	void* arg = pcb->callback_arg;
+	tcp_close(pcb);
+	stats.aborts++;
+	if (errf != NULL)
+		errf(arg, ERR_ABRT);
+}
+
+struct pbuf* pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+	struct pbuf* p = (struct pbuf*)malloc(sizeof(struct pbuf) + length);
+	if (p == NULL)
+		return NULL;
+	memset(p, 0, sizeof(struct pbuf));
+	p->payload = p + 1;
+	p->len = length;
+	p->tot_len = length;
+	p->type = type;
+	p->ref = 1;
+	return p;
+}
+
+void pbuf_ref(struct pbuf *p)
+{
+	if (p != NULL)
+		p->ref++;
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+	u8_t count = 0;
+	while (p != NULL && --p->ref == 0)
+	{
+		struct pbuf* next = p->next;
+		free(p);
+		count++;
+		p = next;
+	}
+	return count;
+}
+
+void pbuf_cat(struct pbuf *head, struct pbuf *tail)
+{
+	struct pbuf* p;
+	for (p = head; p->next != NULL; p = p->next)
+		p->tot_len += tail->tot_len;
+	p->tot_len += tail->tot_len;
+	p->next = tail;
+}
+
+u16_t pbuf_copy_partial(struct pbuf *buf, void *dataptr, u16_t len, u16_t offset)
+{
+	u16_t copied = 0;
+	struct pbuf* p;
+	for (p = buf; p != NULL && copied < len; p = p->next)
+	{
+		if (offset >= p->len)
+		{
+			offset -= p->len;
+			continue;
+		}
+		u16_t n = p->len - offset;
+		if (n > len - copied)
+			n = len - copied;
+		memcpy((uint8_t*)dataptr + copied, (uint8_t*)p->payload + offset, n);
+		copied += n;
+		offset = 0;
+	}
+	return copied;
+}
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg)
+{
+	// Only addresses can be used
+	unsigned a, b, c, d;
+	char end;
+	if (sscanf(hostname, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+		return ERR_ARG;
+	IP4_ADDR(addr, a, b, c, d);
+	return ERR_OK;
+}
+
+/* Other side of connection */
+
+struct tcp_pcb* host_tcp_accept(uint16_t port)
+{
+	struct host_pcb* listener;
+	for (listener = pcbs; listener != NULL; listener = listener->link)
+	{
+		if (listener->pcb.state == LISTEN && listener->pcb.local_port == port && !listener->closed)
+			break;
+	}
+	if (listener == NULL || listener->pcb.accept == NULL)
+		return NULL;
+
+	struct tcp_pcb* pcb = tcp_new();
+	pcb->state = ESTABLISHED;
+	pcb->local_port = port;
+	if (listener->pcb.accept(listener->pcb.callback_arg, pcb, ERR_OK) != ERR_OK)
+		return NULL; // Aborted, test still frees it
+	return pcb;
+}
+
+struct tcp_pcb* host_tcp_last_connect()
+{
+	return lastConnect;
+}
+
+err_t host_tcp_connected(struct tcp_pcb* pcb)
+{
+	pcb->state = ESTABLISHED;
+	if (pcb->connected == NULL)
+		return ERR_OK;
+	return pcb->connected(pcb->callback_arg, pcb, ERR_OK);
+}
+
+err_t host_tcp_receive(struct tcp_pcb* pcb, const void* data, int length, int pbufLength)
+{
+	struct host_pcb* hp = (struct host_pcb*)pcb;
+	if (hp->closed || pcb->recv == NULL)
+		return ERR_CLSD;
+	if (pbufLength <= 0)
+		pbufLength = length;
+
+	// Chain of pbufs, like one segment split by driver
+	struct pbuf* head = NULL;
+	int pos;
+	for (pos = 0; pos < length; pos += pbufLength)
+	{
+		int n = length - pos < pbufLength ? length - pos : pbufLength;
+		struct pbuf* p = pbuf_alloc(PBUF_RAW, n, PBUF_RAM);
+		memcpy(p->payload, (const uint8_t*)data + pos, n);
+		if (head == NULL)
+			head = p;
+		else
+			pbuf_cat(head, p);
+	}
+	if (head == NULL)
+		return ERR_OK;
+	return pcb->recv(pcb->callback_arg, pcb, head, ERR_OK);
+}
+
+err_t host_tcp_remote_close(struct tcp_pcb* pcb)
+{
+	struct host_pcb* hp = (struct host_pcb*)pcb;
+	if (hp->closed || pcb->recv == NULL)
+		return ERR_CLSD;
+	return pcb->recv(pcb->callback_arg, pcb, NULL, ERR_OK);
+}
+
+int host_tcp_read(struct tcp_pcb* pcb, void* buffer, int size)
+{
+	struct host_pcb* hp = (struct host_pcb*)pcb;
+	host_tcp_segments(hp);
+	if (size > (int)hp->outLength)
+		size = hp->outLength;
+	if (buffer != NULL)
+		memcpy(buffer, hp->out, size);
+	memmove(hp->out, hp->out + size, hp->outLength - size);
+	hp->outLength -= size;
+	return size;
+}
+
+uint32_t host_tcp_available(struct tcp_pcb* pcb)
+{
+	return ((struct host_pcb*)pcb)->outLength;
+}
+
+uint32_t host_tcp_unacked(struct tcp_pcb* pcb)
+{
+	return TCP_SND_BUF - pcb->snd_buf;
+}
+
+err_t host_tcp_ack(struct tcp_pcb* pcb, uint32_t length)
+{
+	struct host_pcb* hp = (struct host_pcb*)pcb;
+	uint32_t unacked = host_tcp_unacked(pcb);
+	if (length > unacked)
+		length = unacked;
+	host_tcp_segments(hp);
+
+	// Whole writes leave send queue
+	uint32_t left = length;
+	while (pcb->snd_queuelen > 0 && left > 0)
+	{
+		uint16_t* queued = &hp->queue[hp->queueHead];
+		uint32_t n = left < *queued ? left : *queued;
+		*queued -= n;
+		left -= n;
+		if (*queued == 0)
+		{
+			hp->queueHead = (hp->queueHead + 1) % HOST_TCP_QUEUE;
+			pcb->snd_queuelen--;
+		}
+	}
+	pcb->snd_buf += length;
+
+	if (hp->closed || pcb->sent == NULL || length == 0)
+		return ERR_OK;
+	return pcb->sent(pcb->callback_arg, pcb, length);
+}
+
+err_t host_tcp_poll(struct tcp_pcb* pcb)
+{
+	struct host_pcb* hp = (struct host_pcb*)pcb;
+	if (hp->closed || pcb->poll == NULL)
+		return ERR_OK;
+	return pcb->poll(pcb->callback_arg, pcb);
+}
+
+bool host_tcp_closed(struct tcp_pcb* pcb)
+{
+	return ((struct host_pcb*)pcb)->closed;
+}
+
+void host_tcp_free(struct tcp_pcb* pcb)
+{
+	struct host_pcb* hp = (struct host_pcb*)pcb;
+	struct host_pcb** p;
+	for (p = &pcbs; *p != NULL; p = &(*p)->link)
+	{
+		if (*p == hp)
+		{
+			*p = hp->link;
+			break;
+		}
+	}
+	if (lastConnect == pcb)
+		lastConnect = NULL;
+	free(hp->out);
+	free(hp);
+}
+
+void host_tcp_get_stats(struct host_tcp_stats* result)
+{
+	*result = stats;
+}
+
+void host_tcp_reset_stats()
+{
+	memset(&stats, 0, sizeof(stats));
+}
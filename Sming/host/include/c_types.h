@@ -0,0 +1 @@
+// Host replacement of Espressif SDK header, types come from espinc/c_types_compatible.h
@@ -0,0 +1,68 @@
+// Host replacement of Espressif SDK header
+
+#ifndef _HOST_EAGLE_SOC_H_
+#define _HOST_EAGLE_SOC_H_
+
+#define BIT31	0x80000000
+#define BIT30	0x40000000
+#define BIT29	0x20000000
+#define BIT28	0x10000000
+#define BIT27	0x08000000
+#define BIT26	0x04000000
+#define BIT25	0x02000000
+#define BIT24	0x01000000
+#define BIT23	0x00800000
+#define BIT22	0x00400000
+#define BIT21	0x00200000
+#define BIT20	0x00100000
+#define BIT19	0x00080000
+#define BIT18	0x00040000
+#define BIT17	0x00020000
+#define BIT16	0x00010000
+#define BIT15	0x00008000
+#define BIT14	0x00004000
+#define BIT13	0x00002000
+#define BIT12	0x00001000
+#define BIT11	0x00000800
+#define BIT10	0x00000400
+#define BIT9	0x00000200
+#define BIT8	0x00000100
+#define BIT7	0x00000080
+#define BIT6	0x00000040
+#define BIT5	0x00000020
+#define BIT4	0x00000010
+#define BIT3	0x00000008
+#define BIT2	0x00000004
+#define BIT1	0x00000002
+#define BIT0	0x00000001
+
+// Pin multiplexer registers and functions, writes are ignored on host
+#define PERIPHS_IO_MUX_GPIO0_U	0
+#define PERIPHS_IO_MUX_U0TXD_U	0
+#define PERIPHS_IO_MUX_GPIO2_U	0
+#define PERIPHS_IO_MUX_U0RXD_U	0
+#define PERIPHS_IO_MUX_GPIO4_U	0
+#define PERIPHS_IO_MUX_GPIO5_U	0
+#define PERIPHS_IO_MUX_SD_DATA2_U	0
+#define PERIPHS_IO_MUX_SD_DATA3_U	0
+#define PERIPHS_IO_MUX_MTDI_U	0
+#define PERIPHS_IO_MUX_MTCK_U	0
+#define PERIPHS_IO_MUX_MTMS_U	0
+#define PERIPHS_IO_MUX_MTDO_U	0
+#define FUNC_GPIO0	0
+#define FUNC_GPIO1	0
+#define FUNC_GPIO2	0
+#define FUNC_GPIO3	0
+#define FUNC_GPIO4	0
+#define FUNC_GPIO5	0
+#define FUNC_GPIO9	0
+#define FUNC_GPIO10	0
+#define FUNC_GPIO12	0
+#define FUNC_GPIO13	0
+#define FUNC_GPIO14	0
+#define FUNC_GPIO15	0
+#define PIN_FUNC_SELECT(reg, func)
+#define PIN_PULLUP_EN(reg)
+#define PIN_PULLUP_DIS(reg)
+
+#endif /* _HOST_EAGLE_SOC_H_ */
@@ -0,0 +1 @@
+// Host replacement of Espressif SDK header, nothing is used on host
@@ -0,0 +1,45 @@
+// Host replacement of Espressif SDK header
+
+#ifndef _HOST_ETS_SYS_H_
+#define _HOST_ETS_SYS_H_
+
+#include <stdint.h>
+#include "eagle_soc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void ETSTimerFunc(void *timer_arg);
+
+typedef struct _ETSTIMER_
+{
+	struct _ETSTIMER_ *timer_next;
+	uint64_t timer_expire; // Microseconds of host monotonic clock
+	uint32_t timer_period; // Microseconds, 0 - not repeated
+	ETSTimerFunc *timer_func;
+	void *timer_arg;
+} ETSTimer;
+
+// Hardware timer is replaced by host clock in microseconds
+uint32_t system_get_time(void);
+#define NOW() system_get_time()
+#define TIMER_CLK_FREQ 1000000
+
+#define ICACHE_FLASH_ATTR
+#define ICACHE_RODATA_ATTR
+
+#define ETS_INTR_LOCK()
+#define ETS_INTR_UNLOCK()
+#define ETS_GPIO_INTR_DISABLE()
+#define ETS_GPIO_INTR_ENABLE()
+#define ETS_UNCACHED_ADDR(addr) (addr)
+
+#define READ_PERI_REG(addr) 0
+#define WRITE_PERI_REG(addr, val)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_ETS_SYS_H_ */
@@ -0,0 +1,16 @@
+// Host replacement of Espressif SDK header
+
+#ifndef _HOST_GPIO_H_
+#define _HOST_GPIO_H_
+
+typedef enum
+{
+	GPIO_PIN_INTR_DISABLE = 0,
+	GPIO_PIN_INTR_POSEDGE = 1,
+	GPIO_PIN_INTR_NEGEDGE = 2,
+	GPIO_PIN_INTR_ANYEDGE = 3,
+	GPIO_PIN_INTR_LOLEVEL = 4,
+	GPIO_PIN_INTR_HILEVEL = 5
+} GPIO_INT_TYPE;
+
+#endif /* _HOST_GPIO_H_ */
@@ -0,0 +1,22 @@
+// Host replacement of Espressif SDK header
+
+#ifndef _HOST_OS_TYPE_H_
+#define _HOST_OS_TYPE_H_
+
+#include "ets_sys.h"
+
+typedef ETSTimer os_timer_t;
+typedef ETSTimerFunc os_timer_func_t;
+
+typedef uint32_t os_signal_t;
+typedef uint32_t os_param_t;
+
+typedef struct
+{
+	os_signal_t sig;
+	os_param_t par;
+} os_event_t;
+
+typedef void (*os_task_t)(os_event_t *e);
+
+#endif /* _HOST_OS_TYPE_H_ */
@@ -0,0 +1,33 @@
+// Host replacement of Espressif SDK header
+
+#ifndef _HOST_OSAPI_H_
+#define _HOST_OSAPI_H_
+
+#include <string.h>
+#include <stdio.h>
+#include "os_type.h"
+
+#define os_bzero(s, n) memset(s, 0, n)
+#define os_memcmp memcmp
+#define os_memcpy memcpy
+#define os_memmove memmove
+#define os_memset memset
+#define os_strcat strcat
+#define os_strchr strchr
+#define os_strcmp strcmp
+#define os_strcpy strcpy
+#define os_strlen strlen
+#define os_strncmp strncmp
+#define os_strncpy strncpy
+#define os_strstr strstr
+#define os_sprintf sprintf
+#define os_printf printf
+
+#define os_delay_us(us) ets_delay_us(us)
+
+#define os_timer_arm(t, ms, repeat) ets_timer_arm_new(t, ms, repeat, 1)
+#define os_timer_arm_us(t, us, repeat) ets_timer_arm_new(t, us, repeat, 0)
+#define os_timer_disarm(t) ets_timer_disarm(t)
+#define os_timer_setfn(t, fn, arg) ets_timer_setfn(t, fn, arg)
+
+#endif /* _HOST_OSAPI_H_ */
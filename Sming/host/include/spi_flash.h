@@ -0,0 +1,29 @@
+// Host replacement of Espressif SDK header
+
+#ifndef _HOST_SPI_FLASH_H_
+#define _HOST_SPI_FLASH_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+	SPI_FLASH_RESULT_OK,
+	SPI_FLASH_RESULT_ERR,
+	SPI_FLASH_RESULT_TIMEOUT
+} SpiFlashOpResult;
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+SpiFlashOpResult spi_flash_erase_sector(uint16_t sec);
+SpiFlashOpResult spi_flash_write(uint32_t des_addr, uint32_t *src_addr, uint32_t size);
+SpiFlashOpResult spi_flash_read(uint32_t src_addr, uint32_t *des_addr, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_SPI_FLASH_H_ */
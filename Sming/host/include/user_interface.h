@@ -0,0 +1,88 @@
+// Host replacement of Espressif SDK header
+
+#ifndef _HOST_USER_INTERFACE_H_
+#define _HOST_USER_INTERFACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "os_type.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Wi-Fi types used by Sming Core headers, Wi-Fi isn't available on host
+
+typedef enum
+{
+	AUTH_OPEN = 0,
+	AUTH_WEP,
+	AUTH_WPA_PSK,
+	AUTH_WPA2_PSK,
+	AUTH_WPA_WPA2_PSK,
+	AUTH_MAX
+} AUTH_MODE;
+
+struct bss_info
+{
+	struct
+	{
+		struct bss_info *stqe_next;
+	} next;
+	uint8_t bssid[6];
+	uint8_t ssid[32];
+	uint8_t channel;
+	int8_t rssi;
+	AUTH_MODE authmode;
+	uint8_t is_hidden;
+};
+
+struct softap_config
+{
+	uint8_t ssid[32];
+	uint8_t password[64];
+	uint8_t ssid_len;
+	uint8_t channel;
+	AUTH_MODE authmode;
+	uint8_t ssid_hidden;
+	uint8_t max_connection;
+	uint16_t beacon_interval;
+};
+
+struct station_config
+{
+	uint8_t ssid[32];
+	uint8_t password[64];
+	uint8_t bssid_set;
+	uint8_t bssid[6];
+};
+
+struct rst_info
+{
+	uint32_t reason;
+	uint32_t exccause;
+	uint32_t epc1;
+	uint32_t epc2;
+	uint32_t epc3;
+	uint32_t excvaddr;
+	uint32_t depc;
+};
+
+// Microseconds of monotonic host clock
+uint32_t system_get_time(void);
+uint32_t system_get_free_heap_size(void);
+const char* system_get_sdk_version(void);
+struct rst_info* system_get_rst_info(void);
+void system_soft_wdt_feed(void);
+void system_soft_wdt_restart(void);
+void system_soft_wdt_stop(void);
+void system_restart(void);
+
+bool system_os_task(os_task_t task, uint8_t prio, os_event_t *queue, uint8_t qlen);
+bool system_os_post(uint8_t prio, os_signal_t sig, os_param_t par);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_USER_INTERFACE_H_ */
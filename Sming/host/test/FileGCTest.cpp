@@ -0,0 +1,218 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// Worst case latency of file system calls while logs are rotated in a small
+// SPIFFS, with sector erase taking time like on device. Without background
+// garbage collection some writes have to erase blocks. With fileStartBackgroundGC()
+// blocks are erased in idle time between bursts and writes don't wait for erase.
+// Truncating a file is a change too, collection waits for the next quiet tick.
+// Usage: FileGCTest [flash file]
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "../host.h"
+#include "WString.h"
+#include "FileSystem.h"
+
+#define FS_SIZE				(128 * 1024)
+#define ERASE_TIME			1000 // us, a quarter of what device takes
+#define GC_INTERVAL			5 // ms
+// spiffs collects on write when 3 blocks are left, a burst takes about one 8 KB block
+#define GC_RESERVE_BLOCKS	6
+#define IDLE_TIME			30 // ms between bursts
+#define LOG_FILES			5
+#define LOG_SIZE			(6 * 1024)
+#define WRITE_SIZE			128
+#define BURSTS				80
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { host_printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static uint32_t erases()
+{
+	host_flash_stats stats;
+	host_flash_get_stats(&stats);
+	return stats.erases;
+}
+
+// Slowest single call
+struct Latency
+{
+	double time = 0;
+	uint32_t erases = 0;
+	uint32_t calls = 0;
+	uint32_t erasingCalls = 0;
+
+	void start()
+	{
+		startTime = now();
+		startErases = ::erases();
+	}
+
+	void stop()
+	{
+		double t = now() - startTime;
+		uint32_t e = ::erases() - startErases;
+		if (t > time)
+			time = t;
+		if (e > erases)
+			erases = e;
+		if (e > 0)
+			erasingCalls++;
+		calls++;
+	}
+
+private:
+	double startTime;
+	uint32_t startErases;
+};
+
+static void idle()
+{
+	double end = now() + IDLE_TIME / 1000.0;
+	while (now() < end)
+	{
+		int64_t wait = host_service_timers();
+		if (wait < 0)
+			break;
+		double left = (end - now()) * 1e6;
+		usleep(wait < left ? wait : (left > 0 ? left : 0));
+	}
+}
+
+static String logName(int index)
+{
+	return "log" + String(index) + ".txt";
+}
+
+// New log is written in small pieces, then the oldest is deleted
+static void rotate(Latency& latency, bool backgroundGC)
+{
+	spiffs_config cfg = spiffs_get_storage_config();
+	spiffs_format_manual(cfg.phys_addr, FS_SIZE);
+	if (backgroundGC)
+		fileStartBackgroundGC(GC_INTERVAL, GC_RESERVE_BLOCKS);
+
+	char data[WRITE_SIZE];
+	bool written = true;
+	for (int burst = 0; burst < BURSTS; burst++)
+	{
+		memset(data, 'a' + burst % 26, sizeof(data));
+		latency.start();
+		file_t file = fileOpen(logName(burst), eFO_CreateIfNotExist | eFO_Truncate | eFO_WriteOnly);
+		latency.stop();
+		for (int pos = 0; pos < LOG_SIZE; pos += WRITE_SIZE)
+		{
+			latency.start();
+			written &= fileWrite(file, data, WRITE_SIZE) == WRITE_SIZE;
+			latency.stop();
+		}
+		latency.start();
+		fileClose(file);
+		latency.stop();
+		if (burst >= LOG_FILES)
+		{
+			latency.start();
+			fileDelete(logName(burst - LOG_FILES));
+			latency.stop();
+		}
+		idle();
+	}
+	CHECK(written);
+	CHECK(fileGetContent(logName(BURSTS - 1)).length() == LOG_SIZE);
+	CHECK(fileList().count() == LOG_FILES);
+
+	if (backgroundGC)
+		fileStopBackgroundGC();
+	spiffs_unmount();
+}
+
+static uint32_t backgroundBlocks()
+{
+	spiffs_sming_stats stats;
+	fileSystemStats(&stats);
+	return stats.gc_background;
+}
+
+// Waits for the next garbage collection tick, the only armed timer
+static void tick()
+{
+	int64_t wait = host_service_timers();
+	if (wait > 0)
+		usleep(wait);
+	host_service_timers();
+}
+
+static void testTruncate()
+{
+	spiffs_config cfg = spiffs_get_storage_config();
+	spiffs_format_manual(cfg.phys_addr, FS_SIZE);
+	char data[LOG_SIZE];
+	memset(data, 'x', sizeof(data));
+	for (int i = 0; i < 2; i++)
+	{
+		file_t file = fileOpen(logName(i), eFO_CreateIfNotExist | eFO_WriteOnly);
+		fileWrite(file, data, sizeof(data));
+		fileClose(file);
+	}
+	fileDelete(logName(0));
+
+	// Reserve larger than file system, collection is always wanted
+	fileStartBackgroundGC(GC_INTERVAL, 100);
+	tick();
+	uint32_t collected = backgroundBlocks();
+	file_t file = fileOpen(logName(1), eFO_Truncate | eFO_WriteOnly);
+	fileClose(file);
+	tick();
+	CHECK(backgroundBlocks() == collected);
+	tick();
+	CHECK(backgroundBlocks() == collected + 1);
+	fileStopBackgroundGC();
+	spiffs_unmount();
+}
+
+int main(int argc, char* argv[])
+{
+	const char* flashFile = argc > 1 ? argv[1] : "file_gc_test.bin";
+	remove(flashFile);
+	if (!host_flash_init(flashFile))
+		return 1;
+	host_set_quiet(true);
+	host_flash_set_erase_time(ERASE_TIME);
+
+	testTruncate();
+
+	Latency onWrite, background;
+	rotate(onWrite, false);
+	rotate(background, true);
+
+	host_printf("garbage collection on write: %5.1f ms worst call, %u erases, %u of %u calls erase\n",
+		onWrite.time * 1e3, onWrite.erases, onWrite.erasingCalls, onWrite.calls);
+	host_printf("background collection:       %5.1f ms worst call, %u erases, %u of %u calls erase\n",
+		background.time * 1e3, background.erases, background.erasingCalls, background.calls);
+
+	// Workload needs garbage collection, background one keeps writes from doing it
+	CHECK(onWrite.erases > 0);
+	CHECK(background.erasingCalls < onWrite.erasingCalls);
+	CHECK(background.erases < onWrite.erases);
+
+	host_flash_set_erase_time(0);
+	host_flash_end();
+	remove(flashFile);
+	host_printf("FileGCTest: %s, %d failures\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
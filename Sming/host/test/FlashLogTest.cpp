@@ -0,0 +1,271 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// FlashLog on emulated flash: recovery of torn records and sector headers,
+// wrap-around and time filtering, then append rate, recovery time and
+// write amplification. Power loss is simulated by host_flash_power_cut().
+// Usage: FlashLogTest [flash file]
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include "../host.h"
+#include "FlashLog.h"
+
+#define LOG_SECTORS			4
+#define LOG_OFFSET			(HOST_FLASH_SIZE - 64 * INTERNAL_FLASH_SECTOR_SIZE)
+#define RECORD_LENGTH		20
+// Aligned header and data
+#define RECORD_SIZE			32
+#define SECTOR_RECORDS		((INTERNAL_FLASH_SECTOR_SIZE - sizeof(FlashLogSectorHeader)) / RECORD_SIZE)
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { host_printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Payload is made from sequence, so each record read back can be verified
+static bool append(FlashLog& log, uint32_t timestamp, int length = RECORD_LENGTH)
+{
+	uint8_t data[FLASH_LOG_MAX_RECORD_SIZE];
+	uint32_t sequence = log.getNextSequence();
+	for (int i = 0; i < length; i++)
+		data[i] = (uint8_t)(sequence + i);
+	return log.append(timestamp, data, length);
+}
+
+// Records must come oldest first, without gaps and with intact payload
+class RecordChecker
+{
+public:
+	int read(FlashLog& log, uint32_t from = 0, uint32_t to = UINT32_MAX, int stopAfter = -1)
+	{
+		count = 0;
+		valid = true;
+		limit = stopAfter;
+		int res = log.read(from, to, FlashLogReadDelegate(&RecordChecker::onRecord, this));
+		CHECK(res == count);
+		CHECK(valid);
+		return count;
+	}
+
+	bool onRecord(uint32_t sequence, uint32_t timestamp, const uint8_t* data, int length)
+	{
+		if (count > 0 && (sequence != last + 1 || timestamp < lastTime))
+			valid = false;
+		if (count == 0)
+		{
+			first = sequence;
+			firstTime = timestamp;
+		}
+		for (int i = 0; i < length; i++)
+		{
+			if (data[i] != (uint8_t)(sequence + i))
+				valid = false;
+		}
+		last = sequence;
+		lastTime = timestamp;
+		count++;
+		return count != limit;
+	}
+
+	int count = 0;
+	bool valid = true;
+	int limit = -1;
+	uint32_t first = 0;
+	uint32_t last = 0;
+	uint32_t firstTime = 0;
+	uint32_t lastTime = 0;
+};
+
+// Restarts device, RAM state is rebuilt from flash
+static void reboot(FlashLog& log, int sectors = LOG_SECTORS)
+{
+	host_flash_power_cut(-1);
+	CHECK(log.begin(LOG_OFFSET, sectors));
+}
+
+static void testTornRecord()
+{
+	FlashLog log;
+	RecordChecker checker;
+
+	// Cut at every byte of the record
+	for (int cut = 0; cut <= RECORD_SIZE; cut++)
+	{
+		reboot(log);
+		log.clear();
+		uint32_t base = log.getNextSequence();
+		for (int i = 0; i < 5; i++)
+			append(log, i);
+
+		host_flash_power_cut(cut);
+		append(log, 5);
+		reboot(log);
+
+		bool complete = cut == RECORD_SIZE;
+		CHECK(checker.read(log) == (complete ? 6 : 5));
+		CHECK(checker.first == base);
+		CHECK(log.getNextSequence() == base + (complete ? 6 : 5));
+
+		// Sector with broken record is sealed, appending continues in next one
+		uint32_t erased = log.getErasedSectors();
+		CHECK(append(log, 6));
+		CHECK(log.getErasedSectors() == erased + (complete || cut == 0 ? 0 : 1));
+		CHECK(checker.read(log) == (complete ? 7 : 6));
+		reboot(log);
+		CHECK(checker.read(log) == (complete ? 7 : 6));
+		CHECK(checker.last == log.getNextSequence() - 1);
+	}
+}
+
+static void testWrapAround()
+{
+	FlashLog log;
+	RecordChecker checker;
+	reboot(log);
+	log.clear();
+	uint32_t base = log.getNextSequence();
+
+	// Two and half rounds over all sectors
+	uint32_t total = SECTOR_RECORDS * LOG_SECTORS * 5 / 2;
+	for (uint32_t i = 0; i < total; i++)
+		CHECK(append(log, i));
+	CHECK(log.getNextSequence() == base + total);
+
+	// Oldest sectors were reused, only last ones are kept
+	int kept = checker.read(log);
+	CHECK(kept > (int)(SECTOR_RECORDS * (LOG_SECTORS - 1)));
+	CHECK(kept <= (int)(SECTOR_RECORDS * LOG_SECTORS));
+	CHECK(checker.last == base + total - 1);
+	CHECK(checker.first == base + total - kept);
+
+	reboot(log);
+	CHECK(log.getNextSequence() == base + total);
+	CHECK(checker.read(log) == kept);
+	CHECK(checker.last == base + total - 1);
+}
+
+static void testTornSectorHeader()
+{
+	FlashLog log;
+	RecordChecker checker;
+
+	// Cut at every byte of sector header and first record in it
+	for (int cut = 0; cut <= (int)sizeof(FlashLogSectorHeader) + RECORD_SIZE; cut++)
+	{
+		// Log is full, next sector to be erased has the oldest records
+		reboot(log);
+		log.clear();
+		uint32_t base = log.getNextSequence();
+		uint32_t total = SECTOR_RECORDS * LOG_SECTORS;
+		for (uint32_t i = 0; i < total; i++)
+			append(log, i);
+		CHECK(checker.read(log) == total);
+
+		host_flash_power_cut(cut);
+		append(log, total);
+		reboot(log);
+
+		// Erase wasn't done at all, or the oldest sector is lost with it
+		int kept = checker.read(log);
+		bool complete = cut == sizeof(FlashLogSectorHeader) + RECORD_SIZE;
+		CHECK(kept == (cut == 0 ? total : complete ? total - SECTOR_RECORDS + 1 : total - SECTOR_RECORDS));
+		CHECK(checker.last == base + (complete ? total : total - 1));
+
+		CHECK(append(log, total + 1));
+		CHECK(checker.read(log) > 0);
+		CHECK(checker.last == log.getNextSequence() - 1);
+	}
+}
+
+static void testTimeRange()
+{
+	FlashLog log;
+	RecordChecker checker;
+	reboot(log);
+	log.clear();
+	uint32_t base = log.getNextSequence();
+
+	// Spans several sectors
+	for (int i = 0; i < 500; i++)
+		append(log, 1000 + i * 10);
+
+	CHECK(checker.read(log, 2000, 2990) == 100);
+	CHECK(checker.firstTime == 2000);
+	CHECK(checker.lastTime == 2990);
+	CHECK(checker.first == base + 100);
+
+	CHECK(checker.read(log, 2005, 2005) == 0);
+	CHECK(checker.read(log, 0, 999) == 0);
+	CHECK(checker.read(log, 6000, UINT32_MAX) == 0);
+	CHECK(checker.read(log, 5990, UINT32_MAX) == 1);
+
+	// Reading stops when callback returns false
+	CHECK(checker.read(log, 0, UINT32_MAX, 3) == 3);
+	CHECK(checker.first == base);
+}
+
+static void benchmark()
+{
+	FlashLog log;
+	RecordChecker checker;
+	const int sectors = 16;
+	const int samples = 100000;
+	reboot(log, sectors);
+
+	int lengths[] = { 4, 16, 64 };
+	for (unsigned l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+	{
+		log.clear();
+		uint32_t erased = log.getErasedSectors();
+		uint32_t written = log.getWrittenBytes();
+		uint32_t payload = log.getPayloadBytes();
+
+		double t = now();
+		for (int i = 0; i < samples; i++)
+			append(log, i, lengths[l]);
+		t = now() - t;
+
+		written = log.getWrittenBytes() - written;
+		payload = log.getPayloadBytes() - payload;
+		host_printf("append %2d bytes: %.0f samples/s, write amplification %.2f, %u sectors erased\n",
+			lengths[l], samples / t, (double)written / payload, log.getErasedSectors() - erased);
+	}
+
+	double t = now();
+	reboot(log, sectors);
+	t = now() - t;
+	int kept = checker.read(log);
+	host_printf("recovery of %d sectors: %.0f us, %d records\n", sectors, t * 1e6, kept);
+}
+
+int main(int argc, char* argv[])
+{
+	const char* flashFile = argc > 1 ? argv[1] : "flashlog_test.bin";
+	remove(flashFile);
+	if (!host_flash_init(flashFile))
+		return 1;
+
+	testTornRecord();
+	testWrapAround();
+	testTornSectorHeader();
+	testTimeRange();
+	if (failures == 0)
+		benchmark();
+
+	host_flash_end();
+	remove(flashFile);
+	host_printf("FlashLogTest: %s, %d failures\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
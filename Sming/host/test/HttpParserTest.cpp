@@ -0,0 +1,223 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// HTTP request parser fed through emulated TCP: every request is split in two
+// segments at every byte, sent one byte per segment and as a chain of one byte
+// pbufs. Each way must give the same handler calls. Parsing time of whole
+// requests and of one byte segments is reported.
+
+#include <user_config.h>
+#include <stdio.h>
+#include <time.h>
+#include "../host.h"
+#include "Network/HttpServer.h"
+#include "Network/HttpRequest.h"
+#include "Network/HttpResponse.h"
+
+#define PORT 80
+#define MAX_HANDLED 2
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { host_printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+struct ExpectedRequest
+{
+	const char* method;
+	const char* path;
+	const char* token; // Header enabled for processing
+	const char* parameter;
+	const char* value; // Of query or post parameter
+};
+
+struct TestRequest
+{
+	const char* name;
+	const char* data;
+	int count;
+	ExpectedRequest expected[MAX_HANDLED];
+};
+
+static const TestRequest requests[] =
+{
+	{
+		"GET with query",
+		"GET /index.html?x=1&y=two HTTP/1.1\r\nHost: device\r\nX-Token: abc123\r\nX-Ignored: zzz\r\nConnection: close\r\n\r\n",
+		1, { { "GET", "/index.html", "abc123", "y", "two" } }
+	},
+	{
+		"POST form",
+		"POST /form HTTP/1.1\r\nHost: d\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+		"Content-Length: 19\r\nX-Token:   spaced\r\n\r\nname=sming&value=42",
+		1, { { "POST", "/form", "spaced", "value", "42" } }
+	},
+	{
+		"Pipelined",
+		"GET /a?p=1 HTTP/1.1\r\nHost: d\r\n\r\nPOST /form HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+		"Content-Length: 7\r\nConnection: close\r\n\r\nvalue=b",
+		2, { { "GET", "/a", "", "p", "1" }, { "POST", "/form", "", "value", "b" } }
+	}
+};
+
+struct HandledRequest
+{
+	String method;
+	String path;
+	String token;
+	String value;
+};
+
+static HandledRequest handled[MAX_HANDLED];
+static int handledCount = 0;
+static const TestRequest* current = NULL;
+
+static void onRequest(HttpRequest& request, HttpResponse& response)
+{
+	if (handledCount < MAX_HANDLED)
+	{
+		HandledRequest& h = handled[handledCount];
+		const ExpectedRequest& expected = current->expected[handledCount];
+		h.method = request.getRequestMethod();
+		h.path = request.getPath();
+		h.token = request.getHeader("X-Token");
+		h.value = h.method == "POST" ? request.getPostParameter(expected.parameter) : request.getQueryParameter(expected.parameter);
+	}
+	handledCount++;
+	response.sendString("ok");
+}
+
+static double now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Takes response and acknowledges it, until nothing more is sent
+static int pump(tcp_pcb* pcb, char* response, int size)
+{
+	int length = 0;
+	while (host_tcp_available(pcb) > 0)
+	{
+		length += host_tcp_read(pcb, response + length, size - length - 1);
+		host_tcp_ack(pcb, host_tcp_unacked(pcb));
+	}
+	response[length] = '\0';
+	return length;
+}
+
+// Sends request split into parts at given positions, returns false on failed checks
+static bool run(const TestRequest& test, const int* splits, int splitsCount, int pbufLength)
+{
+	current = &test;
+	handledCount = 0;
+	tcp_pcb* pcb = host_tcp_accept(PORT);
+	if (pcb == NULL)
+		return false;
+
+	char response[4096];
+	int responseLength = 0;
+	int length = strlen(test.data);
+	int pos = 0;
+	for (int i = 0; i <= splitsCount; i++)
+	{
+		int end = i < splitsCount ? splits[i] : length;
+		if (host_tcp_closed(pcb))
+			break;
+		host_tcp_receive(pcb, test.data + pos, end - pos, pbufLength);
+		responseLength += pump(pcb, response + responseLength, sizeof(response) - responseLength);
+		pos = end;
+	}
+	if (!host_tcp_closed(pcb))
+		host_tcp_remote_close(pcb);
+	bool closed = host_tcp_closed(pcb);
+	host_tcp_free(pcb);
+
+	bool ok = closed && handledCount == test.count && memcmp(response, "HTTP/1.1 200", 12) == 0;
+	for (int i = 0; ok && i < test.count; i++)
+	{
+		const ExpectedRequest& expected = test.expected[i];
+		ok = handled[i].method == expected.method && handled[i].path == expected.path
+				&& handled[i].token == expected.token && handled[i].value == expected.value;
+	}
+	return ok;
+}
+
+static void testSplits(const TestRequest& test)
+{
+	int length = strlen(test.data);
+
+	CHECK(run(test, NULL, 0, 0));
+
+	// Two segments
+	int failed = 0;
+	for (int split = 1; split < length; split++)
+	{
+		if (!run(test, &split, 1, 0))
+		{
+			if (failed++ == 0)
+				host_printf("FAIL %s: split at %d\n", test.name, split);
+		}
+	}
+	CHECK(failed == 0);
+
+	// Segment for each byte
+	int* splits = new int[length];
+	for (int i = 0; i < length - 1; i++)
+		splits[i] = i + 1;
+	CHECK(run(test, splits, length - 1, 0));
+	delete[] splits;
+
+	// One segment in pbuf for each byte
+	CHECK(run(test, NULL, 0, 1));
+}
+
+static void benchmark(const TestRequest& test)
+{
+	const int repeat = 2000;
+	int length = strlen(test.data);
+	int* splits = new int[length];
+	for (int i = 0; i < length - 1; i++)
+		splits[i] = i + 1;
+
+	double t = now();
+	for (int i = 0; i < repeat; i++)
+		run(test, NULL, 0, 0);
+	double whole = (now() - t) / repeat;
+
+	t = now();
+	for (int i = 0; i < repeat; i++)
+		run(test, splits, length - 1, 0);
+	double bytes = (now() - t) / repeat;
+	delete[] splits;
+
+	host_printf("%-14s %3d bytes: whole %6.2f us, byte segments %7.2f us per request\n",
+		test.name, length, whole * 1e6, bytes * 1e6);
+}
+
+int main()
+{
+	host_set_quiet(true);
+
+	HttpServer server;
+	server.enableHeaderProcessing("X-Token");
+	server.addPath("/form", onRequest);
+	server.setDefaultHandler(onRequest);
+	server.listen(PORT);
+
+	int count = sizeof(requests) / sizeof(requests[0]);
+	for (int i = 0; i < count; i++)
+		testSplits(requests[i]);
+	if (failures == 0)
+	{
+		for (int i = 0; i < count; i++)
+			benchmark(requests[i]);
+	}
+
+	host_printf("HttpParserTest: %s, %d failures\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
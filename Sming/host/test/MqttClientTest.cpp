@@ -0,0 +1,271 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/anakod/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+// MqttClient against a broker stand-in on emulated TCP. Broker PUBLISH packets
+// are sent whole and split at every byte. Packets too short for their topic
+// and message id are dropped without acknowledge, packets with a topic longer
+// than receive buffer are dropped but acknowledged with their message id, and
+// large payloads are streamed.
+
+#include <user_config.h>
+#include <stdio.h>
+#include "../host.h"
+#include "Network/MqttClient.h"
+
+#define BROKER_PORT 1883
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { host_printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+static int delivered = 0;
+static String deliveredTopic;
+static String deliveredMessage;
+static uint32_t streamedBytes = 0;
+static uint32_t streamedTotal = 0;
+
+static void onMessage(String topic, String message)
+{
+	delivered++;
+	deliveredTopic = topic;
+	deliveredMessage = message;
+}
+
+static void onPayload(const String& topic, const uint8_t* data, size_t size, size_t offset, size_t total)
+{
+	if (offset == streamedBytes)
+		streamedBytes += size;
+	streamedTotal = total;
+}
+
+// PUBLISH packet from broker, id is used for QoS 1 and 2
+static String publishPacket(int qos, const String& topic, uint16_t id, const String& payload)
+{
+	String body;
+	body += (char)(topic.length() >> 8);
+	body += (char)(topic.length() & 0xFF);
+	body += topic;
+	if (qos > 0)
+	{
+		body += (char)(id >> 8);
+		body += (char)(id & 0xFF);
+	}
+	body += payload;
+	return body;
+}
+
+static String packet(uint8_t header, const String& body)
+{
+	String result;
+	result += (char)header;
+	uint32_t length = body.length();
+	do
+	{
+		uint8_t digit = length & 0x7F;
+		length >>= 7;
+		result += (char)(length > 0 ? digit | 0x80 : digit);
+	} while (length > 0);
+	result += body;
+	return result;
+}
+
+class Broker
+{
+public:
+	Broker(MqttClient& client) : client(client)
+	{
+		client.connect("test");
+		pcb = host_tcp_last_connect();
+		if (pcb == NULL)
+			return;
+		host_tcp_connected(pcb);
+		// CONNACK, accepted
+		send(String("\x20\x02\x00\x00", 4));
+		take();
+	}
+
+	~Broker()
+	{
+		if (pcb != NULL)
+			host_tcp_free(pcb);
+	}
+
+	// Data sent by client since last call, queued data is sent on poll
+	String take()
+	{
+		host_tcp_poll(pcb);
+		char data[256];
+		int length = host_tcp_read(pcb, data, sizeof(data));
+		host_tcp_ack(pcb, host_tcp_unacked(pcb));
+		return String(data, length);
+	}
+
+	void send(const String& data, int splitAt = 0)
+	{
+		if (splitAt > 0 && splitAt < (int)data.length())
+		{
+			host_tcp_receive(pcb, data.c_str(), splitAt, 0);
+			host_tcp_receive(pcb, data.c_str() + splitAt, data.length() - splitAt, 0);
+		}
+		else
+			host_tcp_receive(pcb, data.c_str(), data.length(), 0);
+	}
+
+	bool connected() { return pcb != NULL && !host_tcp_closed(pcb); }
+
+	MqttClient& client;
+	tcp_pcb* pcb = NULL;
+};
+
+static String ack(uint8_t type, uint16_t id)
+{
+	char data[4] = { (char)type, 2, (char)(id >> 8), (char)(id & 0xFF) };
+	return String(data, sizeof(data));
+}
+
+// String comparison stops at zero byte
+static bool isAck(const String& sent, uint8_t type, uint16_t id)
+{
+	return sent.length() == 4 && memcmp(sent.c_str(), ack(type, id).c_str(), 4) == 0;
+}
+
+static void testDelivery()
+{
+	MqttClient client("127.0.0.1", BROKER_PORT, onMessage);
+	Broker broker(client);
+	CHECK(broker.connected());
+	client.subscribe("room/+/temp");
+	broker.take();
+
+	String data = packet(MQTT_MSG_PUBLISH | (1 << 1), publishPacket(1, "room/1/temp", 0x1234, "21.5"));
+	int failed = 0;
+	for (int split = 0; split < (int)data.length(); split++)
+	{
+		delivered = 0;
+		broker.send(data, split);
+		if (delivered != 1 || deliveredMessage != "21.5" || !isAck(broker.take(), MQTT_MSG_PUBACK, 0x1234))
+		{
+			if (failed++ == 0)
+				host_printf("FAIL QoS 1 PUBLISH split at %d\n", split);
+		}
+	}
+	CHECK(failed == 0);
+	CHECK(broker.connected());
+}
+
+static void testShortPublish()
+{
+	MqttClient client("127.0.0.1", BROKER_PORT, onMessage);
+	Broker broker(client);
+	client.subscribe("#");
+	broker.take();
+
+	// Topic length points past the end of packet, no room for message id
+	String body = publishPacket(0, "abcdef", 0, "");
+	body.setCharAt(1, 20);
+	delivered = 0;
+	broker.send(packet(MQTT_MSG_PUBLISH | (1 << 1), body));
+	CHECK(delivered == 0);
+	CHECK(broker.take().length() == 0);
+
+	// Topic without message id
+	broker.send(packet(MQTT_MSG_PUBLISH | (2 << 1), publishPacket(0, "abc", 0, "")));
+	CHECK(delivered == 0);
+	CHECK(broker.take().length() == 0);
+
+	// Nothing at all, or half of topic length
+	broker.send(packet(MQTT_MSG_PUBLISH | (1 << 1), ""));
+	broker.send(packet(MQTT_MSG_PUBLISH, String("\x00", 1)));
+	CHECK(delivered == 0);
+	CHECK(broker.take().length() == 0);
+
+	// Connection is still usable
+	broker.send(packet(MQTT_MSG_PUBLISH | (1 << 1), publishPacket(1, "ok", 7, "yes")));
+	CHECK(delivered == 1 && deliveredTopic == "ok" && deliveredMessage == "yes");
+	CHECK(isAck(broker.take(), MQTT_MSG_PUBACK, 7));
+	CHECK(broker.connected());
+}
+
+static void testLongTopic()
+{
+	MqttClient client("127.0.0.1", BROKER_PORT, onMessage);
+	Broker broker(client);
+	client.subscribe("#");
+	broker.take();
+
+	String topic;
+	for (int i = 0; i < MQTT_MAX_BUFFER_SIZE + 100; i++)
+		topic += (char)('a' + i % 26);
+	String payload = "value";
+
+	// Message id is acknowledged, whatever segments it comes in
+	int qos[] = { 1, 2 };
+	for (int q = 0; q < 2; q++)
+	{
+		uint16_t id = 0x4321 + q;
+		uint8_t expected = qos[q] == 1 ? MQTT_MSG_PUBACK : MQTT_MSG_PUBREC;
+		String data = packet(MQTT_MSG_PUBLISH | (qos[q] << 1), publishPacket(qos[q], topic, id, payload));
+		int splits[] = { 0, MQTT_MAX_BUFFER_SIZE, (int)data.length() - (int)payload.length() - 3,
+				(int)data.length() - (int)payload.length() - 1, (int)data.length() - 1 };
+		for (unsigned i = 0; i < sizeof(splits) / sizeof(splits[0]); i++)
+		{
+			delivered = 0;
+			broker.send(data, splits[i]);
+			String sent = broker.take();
+			if (delivered != 0 || !isAck(sent, expected, id))
+			{
+				host_printf("FAIL QoS %d long topic split at %d\n", qos[q], splits[i]);
+				failures++;
+			}
+			if (qos[q] == 2)
+				broker.send(ack(MQTT_MSG_PUBREL | 0x02, id));
+			broker.take();
+		}
+	}
+	CHECK(broker.connected());
+}
+
+static void testStreamed()
+{
+	MqttClient client("127.0.0.1", BROKER_PORT, onMessage);
+	client.setPayloadCallback(onPayload);
+	Broker broker(client);
+	client.subscribe("big/#");
+	broker.take();
+
+	String payload;
+	for (int i = 0; i < MQTT_MAX_BUFFER_SIZE * 3; i++)
+		payload += (char)('0' + i % 10);
+	String data = packet(MQTT_MSG_PUBLISH | (1 << 1), publishPacket(1, "big/file", 0x0102, payload));
+	int splits[] = { 0, 3, 12, 13, 14, MQTT_MAX_BUFFER_SIZE };
+	for (unsigned i = 0; i < sizeof(splits) / sizeof(splits[0]); i++)
+	{
+		streamedBytes = 0;
+		streamedTotal = 0;
+		broker.send(data, splits[i]);
+		String sent = broker.take();
+		if (streamedBytes != payload.length() || streamedTotal != payload.length() || !isAck(sent, MQTT_MSG_PUBACK, 0x0102))
+		{
+			host_printf("FAIL streamed split at %d: %u of %u bytes\n", splits[i], streamedBytes, payload.length());
+			failures++;
+		}
+	}
+	CHECK(broker.connected());
+}
+
+int main()
+{
+	host_set_quiet(true);
+
+	testDelivery();
+	testShortPublish();
+	testLongTopic();
+	testStreamed();
+
+	host_printf("MqttClientTest: %s, %d failures\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
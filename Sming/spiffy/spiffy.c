@@ -3,6 +3,9 @@
 #include <dirent.h>
 #include <spiffs.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <zlib.h>
 
 #define LOG_PAGE_SIZE       256
 #define SPI_FLASH_SEC_SIZE 4096
@@ -13,6 +16,10 @@
 #define DEFAULT_ROM_NAME "spiff_rom.bin"
 #define DEFAULT_ROM_SIZE 0x30000
 
+#define MANIFEST_SUFFIX  ".manifest"
+#define GZIP_SUFFIX      ".gz"
+#define MAX_THREADS      32
+
 static spiffs fs;
 static u8_t spiffs_work_buf[LOG_PAGE_SIZE*2];
 static u8_t spiffs_fds[32*4];
@@ -21,7 +28,29 @@ static u8_t spiffs_cache_buf[(LOG_PAGE_SIZE+32)*4];
 #define S_DBG
 //#define S_DBG printf
 
-static FILE *rom = 0;
+// Image is built in memory and written out once
+static u8_t *rom = 0;
+static u32_t rom_size = 0;
+
+// One file of the folder, with its compressed sibling
+typedef struct {
+	char name[SPIFFS_OBJ_NAME_LEN];
+	u8_t *data;
+	int size;
+	unsigned long long hash;
+	int duplicate_of; // index of file with same content, or -1
+	int compress;
+	int gz_wanted; // a duplicate needs compressed content
+	u8_t *gz_data;
+	int gz_size;
+} spiffy_file;
+
+static spiffy_file *files = 0;
+static int file_count = 0;
+
+// Compression work shared by threads
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_job = 0;
 
 void hexdump_mem(u8_t *b, u32_t len) {
 	int i;
@@ -35,77 +64,40 @@ void hexdump_mem(u8_t *b, u32_t len) {
 
 static s32_t my_spiffs_read(u32_t addr, u32_t size, u8_t *dst) {
 
-	int res;
-
-	if (fseek(rom, addr, SEEK_SET)) {
-		printf("Unable to seek to %d.\n", addr);
-		return SPIFFS_ERR_END_OF_OBJECT;
-	}
-
-	res = fread(dst, 1, size, rom);
-	if (res != size) {
-		printf("Unable to read - tried to get %d bytes only got %d.\n", size, res);
+	if (addr + size > rom_size) {
+		printf("Unable to read %d bytes at %d.\n", size, addr);
 		return SPIFFS_ERR_NOT_READABLE;
 	}
 
+	memcpy(dst, rom + addr, size);
 	S_DBG("Read %d bytes from offset %d.\n", size, addr);
-	//hexdump_mem(dst, size);
 	return SPIFFS_OK;
 }
 
 static s32_t my_spiffs_write(u32_t addr, u32_t size, u8_t *src) {
 
-	int ret = SPIFFS_OK;
-	u8_t *buff = 0;
+	int i;
 
-	buff = malloc(size);
-	if (!buff) {
-		printf("Unable to malloc %d bytes.\n", size);
-		ret = SPIFFS_ERR_INTERNAL;
-	} else {
-		ret = my_spiffs_read(addr, size, buff);
-		if (ret == SPIFFS_OK) {
-			int i;
-			for(i = 0; i < size; i++) buff[i] &= src[i];
-			//hexdump_mem(buff, size);
-			if (fseek(rom, addr, SEEK_SET)) {
-				printf("Unable to seek to %d.\n", addr);
-				ret = SPIFFS_ERR_END_OF_OBJECT;
-			} else {
-				if (fwrite(src, 1, size, rom) != size) {
-					printf("Unable to write.\n");
-					ret = SPIFFS_ERR_NOT_WRITABLE;
-				} else {
-					fflush(rom);
-					S_DBG("Wrote %d bytes to offset %d.\n", size, addr);
-				}
-			}
-		}
+	if (addr + size > rom_size) {
+		printf("Unable to write %d bytes at %d.\n", size, addr);
+		return SPIFFS_ERR_NOT_WRITABLE;
 	}
 
-	if (buff) free (buff);
-	return ret;
+	// Like flash, writing can only clear bits
+	for (i = 0; i < size; i++) rom[addr + i] &= src[i];
+	S_DBG("Wrote %d bytes to offset %d.\n", size, addr);
+	return SPIFFS_OK;
 }
 
 static s32_t my_spiffs_erase(u32_t addr, u32_t size) {
 
-	int i;
-
-	if (fseek(rom, addr, SEEK_SET)) {
-		printf("Unable to seek to %d.\n", addr);
-		return SPIFFS_ERR_END_OF_OBJECT;
-	}
-
-	for (i = 0; i < size; i++) {
-		if (fputc(ROM_ERASE, rom) == EOF) {
-			printf("Unable to write.\n");
-			return SPIFFS_ERR_NOT_WRITABLE;
-		}
+	if (addr + size > rom_size) {
+		printf("Unable to erase %d bytes at %d.\n", size, addr);
+		return SPIFFS_ERR_NOT_WRITABLE;
 	}
 
-	fflush(rom);
+	memset(rom + addr, ROM_ERASE, size);
 	S_DBG("Erased %d bytes at offset %d.\n", size, addr);
-
 	return SPIFFS_OK;
 }
 
@@ -167,7 +159,40 @@ int write_to_spiffs(char *fname, u8_t *data, int size) {
 	return ret;
 }
 
-int add_file(const char* fdir, char* fname) {
+// FNV-1a, identifies file content in manifest and for deduplication
+static unsigned long long content_hash(const u8_t *data, int size) {
+
+	unsigned long long hash = 14695981039346656037ULL;
+	int i;
+	for (i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Web assets can be stored compressed only, HttpResponse::sendFile and HttpStaticFiles
+// serve name.gz for name
+static int is_web_asset(const char *fname) {
+
+	static const char *exts[] = { ".html", ".htm", ".css", ".js", ".json", ".svg", ".xml", ".txt", ".csv", ".map", 0 };
+	const char *ext = strrchr(fname, '.');
+	int i;
+	if (!ext) return 0;
+	for (i = 0; exts[i]; i++)
+		if (strcasecmp(ext, exts[i]) == 0) return 1;
+	return 0;
+}
+
+static int has_file(const char *fname) {
+
+	int i;
+	for (i = 0; i < file_count; i++)
+		if (strcmp(files[i].name, fname) == 0) return 1;
+	return 0;
+}
+
+int load_file(const char* fdir, char* fname) {
 
 	int ret = 0;
 	int size;
@@ -175,6 +200,11 @@ int add_file(const char* fdir, char* fname) {
 	FILE *fp = 0;
 	char *path = 0;
 
+	if (strlen(fname) >= SPIFFS_OBJ_NAME_LEN) {
+		printf("Skipping '%s', name is too long.\n", fname);
+		return 0;
+	}
+
 	path = malloc(1024);
 	if (!path) {
 		printf("Unable to malloc %d bytes.\n", 1024);
@@ -189,19 +219,22 @@ int add_file(const char* fdir, char* fname) {
 				S_DBG("Unable to open '%s'.\n", fname);
 			} else {
 				size = (int)st.st_size;
-				buff = malloc(size);
+				buff = malloc(size > 0 ? size : 1);
 				if (!buff) {
 					printf("Unable to malloc %d bytes.\n", size);
+				} else if (fread(buff, 1, size, fp) != size) {
+					printf("Unable to read file '%s'.\n", fname);
 				} else {
-					if (fread(buff, 1, size, fp) != size) {
-						printf("Unable to read file '%s'.\n", fname);
-					} else {
-						S_DBG("%d bytes read from '%s'.\n", size, fname);
-						if (write_to_spiffs(fname, buff, size)) {
-							printf("Added '%s' to spiffs (%d bytes).\n", fname, size);
-							ret = 1;
-						}
-					}
+					S_DBG("%d bytes read from '%s'.\n", size, fname);
+					spiffy_file *f = &files[file_count++];
+					memset(f, 0, sizeof(spiffy_file));
+					strcpy(f->name, fname);
+					f->data = buff;
+					f->size = size;
+					f->hash = content_hash(buff, size);
+					f->duplicate_of = -1;
+					buff = 0;
+					ret = 1;
 				}
 			}
 		}
@@ -214,6 +247,169 @@ int add_file(const char* fdir, char* fname) {
 	return ret;
 }
 
+static int compare_files(const void *a, const void *b) {
+	return strcmp(((const spiffy_file *)a)->name, ((const spiffy_file *)b)->name);
+}
+
+int load_folder(const char *folder) {
+
+	DIR *dir;
+	struct dirent *ent;
+	int capacity = 0;
+
+	if ((dir = opendir(folder)) == NULL) return 0;
+	while ((ent = readdir(dir)) != NULL) {
+		if (file_count == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			files = realloc(files, capacity * sizeof(spiffy_file));
+		}
+		load_file(folder, ent->d_name);
+	}
+	closedir(dir);
+
+	// Same image for same files, whatever order directory lists them in
+	qsort(files, file_count, sizeof(spiffy_file), compare_files);
+	return 1;
+}
+
+// Files with same content are compressed once
+void find_duplicates() {
+
+	int i, j;
+	for (i = 0; i < file_count; i++) {
+		spiffy_file *f = &files[i];
+		for (j = 0; j < i; j++) {
+			spiffy_file *o = &files[j];
+			if (o->duplicate_of < 0 && o->hash == f->hash && o->size == f->size &&
+					memcmp(o->data, f->data, f->size) == 0) {
+				f->duplicate_of = j;
+				break;
+			}
+		}
+
+		char gz_name[SPIFFS_OBJ_NAME_LEN + sizeof(GZIP_SUFFIX)];
+		sprintf(gz_name, "%s" GZIP_SUFFIX, f->name);
+		f->compress = is_web_asset(f->name) && strlen(gz_name) < SPIFFS_OBJ_NAME_LEN && !has_file(gz_name);
+		if (f->compress && f->duplicate_of >= 0) files[f->duplicate_of].gz_wanted = 1;
+	}
+}
+
+static void compress_file(spiffy_file *f) {
+
+	z_stream zs;
+	uLong bound;
+
+	memset(&zs, 0, sizeof(zs));
+	// windowBits 15 + 16 writes gzip header
+	if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+
+	bound = deflateBound(&zs, f->size) + 32;
+	f->gz_data = malloc(bound);
+	if (f->gz_data) {
+		zs.next_in = f->data;
+		zs.avail_in = f->size;
+		zs.next_out = f->gz_data;
+		zs.avail_out = bound;
+		if (deflate(&zs, Z_FINISH) == Z_STREAM_END && zs.total_out < f->size) {
+			f->gz_size = zs.total_out;
+		} else {
+			// Not worth it
+			free(f->gz_data);
+			f->gz_data = 0;
+		}
+	}
+	deflateEnd(&zs);
+}
+
+static void *compress_worker(void *arg) {
+
+	while (1) {
+		pthread_mutex_lock(&job_lock);
+		int i = next_job++;
+		pthread_mutex_unlock(&job_lock);
+		if (i >= file_count) break;
+
+		spiffy_file *f = &files[i];
+		if ((f->compress || f->gz_wanted) && f->duplicate_of < 0) compress_file(f);
+	}
+	return 0;
+}
+
+void compress_files(int threads) {
+
+	pthread_t workers[MAX_THREADS];
+	int started = 0;
+	int i;
+
+	next_job = 0;
+	for (i = 0; i < threads; i++) {
+		if (pthread_create(&workers[started], 0, compress_worker, 0) == 0) started++;
+	}
+	if (started == 0) compress_worker(0);
+	for (i = 0; i < started; i++) pthread_join(workers[i], 0);
+}
+
+// Returns number of files which didn't fit
+int add_files() {
+
+	int i;
+	int failed = 0;
+	for (i = 0; i < file_count; i++) {
+		spiffy_file *f = &files[i];
+		spiffy_file *src = f->duplicate_of < 0 ? f : &files[f->duplicate_of];
+
+		// Compressed file replaces plain one, so image isn't bigger than without compression
+		if (f->compress && src->gz_data) {
+			char gz_name[SPIFFS_OBJ_NAME_LEN + sizeof(GZIP_SUFFIX)];
+			sprintf(gz_name, "%s" GZIP_SUFFIX, f->name);
+			if (write_to_spiffs(gz_name, src->gz_data, src->gz_size)) {
+				printf("Added '%s' to spiffs (%d bytes).\n", gz_name, src->gz_size);
+			} else {
+				failed++;
+			}
+		} else if (write_to_spiffs(f->name, f->data, f->size)) {
+			printf("Added '%s' to spiffs (%d bytes).\n", f->name, f->size);
+		} else {
+			failed++;
+		}
+	}
+	return failed;
+}
+
+// Name, size, size of .gz stored instead (0 if stored plain), content hash and duplicate
+int write_manifest(const char *fname) {
+
+	FILE *fp = fopen(fname, "w");
+	int i;
+
+	if (!fp) {
+		printf("Unable to open file '%s' for writing.\n", fname);
+		return 0;
+	}
+
+	fprintf(fp, "# name size gz_size fnv1a64 duplicate_of\n");
+	for (i = 0; i < file_count; i++) {
+		spiffy_file *f = &files[i];
+		spiffy_file *src = f->duplicate_of < 0 ? f : &files[f->duplicate_of];
+		fprintf(fp, "%s %d %d %016llx %s\n", f->name, f->size, f->compress && src->gz_data ? src->gz_size : 0,
+				f->hash, f->duplicate_of < 0 ? "-" : src->name);
+	}
+	fclose(fp);
+	return 1;
+}
+
+void free_files() {
+
+	int i;
+	for (i = 0; i < file_count; i++) {
+		free(files[i].data);
+		free(files[i].gz_data);
+	}
+	free(files);
+	files = 0;
+	file_count = 0;
+}
+
 int get_rom_size (const char *str) {
 
 	long val;
@@ -229,11 +425,44 @@ int get_rom_size (const char *str) {
 	return (int)val;
 }
 
+static double elapsed(struct timeval *start) {
+
+	struct timeval now;
+	gettimeofday(&now, 0);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
 int main(int argc, char **argv) {
 
 	const char *folder;
 	const char *romfile;
 	int romsize;
+	int gzip = 0;
+	int failed = 0;
+	int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	struct timeval start;
+
+	gettimeofday(&start, 0);
+
+	while ((opt = getopt(argc, argv, "zj:")) != -1) {
+		if (opt == 'z') {
+			gzip = 1;
+		} else if (opt == 'j') {
+			threads = atoi(optarg);
+		} else {
+			printf ("Usage: %s [-z] [-j threads] <FsSizeInBytes> <FilesDir> [OutFile.bin]\n"
+					"  -z  store web files compressed, as name.gz only. They are served\n"
+					"      by HttpResponse::sendFile, but can't be read as plain files,\n"
+					"      so templates must not be in the folder.\n"
+					"  -j  number of compression threads\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (threads < 1) threads = 1;
+	if (threads > MAX_THREADS) threads = MAX_THREADS;
 
 	if (argc == 1) {
 		romsize = DEFAULT_ROM_SIZE;
@@ -253,41 +482,71 @@ int main(int argc, char **argv) {
 		folder = argv[2];
 		romfile = argv[3];
 	} else {
-		printf ("Usage: %s <FsSizeInBytes> <FilesDir> [OutFile.bin]\n", argv[0]);
+		printf ("Usage: %s [-z] [-j threads] <FsSizeInBytes> <FilesDir> [OutFile.bin]\n", argv[0]);
 		exit(EXIT_FAILURE);
 	}
 
 	printf("Creating rom '%s' of size 0x%x (%d) bytes.\n", romfile, romsize, romsize);
-	rom = fopen(romfile, "wb+");
-
+	rom_size = romsize;
+	rom = malloc(rom_size);
 	if (!rom) {
-		printf("Unable to open file '%s' for writing.\n", romfile);
-	} else {
+		printf("Unable to malloc %d bytes.\n", romsize);
+		exit(EXIT_FAILURE);
+	}
+	memset(rom, ROM_ERASE, rom_size);
 
-		int i;
-		for (i = 0; i < romsize; i++) {
-			fputc(ROM_ERASE, rom);
+	if (my_spiffs_mount(romsize)) {
+		printf("Adding files in directory '%s'.\n", folder);
+		if (!load_folder(folder)) {
+			printf("Unable to open directory '%s'.\n", folder);
+			exit(EXIT_FAILURE);
 		}
-		fflush(rom);
-
-		if (my_spiffs_mount(romsize)) {
-			printf("Adding files in directory '%s'.\n", folder);
-			DIR *dir;
-			struct dirent *ent;
-			if ((dir = opendir(folder)) != NULL) {
-				while ((ent = readdir(dir)) != NULL) {
-					add_file(folder, ent->d_name);
-				}
-				closedir(dir);
-			} else {
-				printf("Unable to open directory '%s'.\n", folder);
-				fclose(rom);
-				unlink(romfile);
-				exit(EXIT_FAILURE);
-			}
+
+		find_duplicates();
+		if (gzip) {
+			compress_files(threads);
+		} else {
+			int i;
+			for (i = 0; i < file_count; i++) files[i].compress = 0;
+		}
+		failed = add_files();
+
+		if (failed == 0) {
+			char *manifest = malloc(strlen(romfile) + sizeof(MANIFEST_SUFFIX));
+			sprintf(manifest, "%s" MANIFEST_SUFFIX, romfile);
+			write_manifest(manifest);
+			free(manifest);
 		}
+
+		u32_t total = 0, used = 0;
+		SPIFFS_info(&fs, &total, &used);
+		printf("%d files, %d bytes of %d used (%d%%), built in %.3f s.\n",
+				file_count, used, total, total ? (int)((unsigned long long)used * 100 / total) : 0, elapsed(&start));
+		free_files();
+	} else {
+		exit(EXIT_FAILURE);
+	}
+
+	// Firmware would miss files, image isn't written
+	if (failed > 0) {
+		printf("%d files don't fit in %d bytes, image '%s' isn't written.\n", failed, romsize, romfile);
+		unlink(romfile);
+		exit(EXIT_FAILURE);
+	}
+
+	FILE *fp = fopen(romfile, "wb");
+	if (!fp) {
+		printf("Unable to open file '%s' for writing.\n", romfile);
+		exit(EXIT_FAILURE);
+	}
+	if (fwrite(rom, 1, rom_size, fp) != rom_size) {
+		printf("Unable to write.\n");
+		fclose(fp);
+		unlink(romfile);
+		exit(EXIT_FAILURE);
 	}
+	fclose(fp);
+	free(rom);
 
-	if (rom) fclose(rom);
 	exit(EXIT_SUCCESS);
 }
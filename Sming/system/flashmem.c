@@ -4,7 +4,9 @@
 // Based on NodeMCU platform_flash
 // https://github.com/nodemcu/nodemcu-firmware
 
+#ifndef SMING_HOST
 extern char _flash_code_end[];
+#endif
 
 uint32_t flashmem_write( const void *from, uint32_t toaddr, uint32_t size )
 {
@@ -101,12 +103,15 @@ bool flashmem_erase_sector( uint32_t sector_id )
   return spi_flash_erase_sector( sector_id ) == SPI_FLASH_RESULT_OK;
 }
 
+// Host build emulates flash header and code area in host/host_flashmem.c
+#ifndef SMING_HOST
 SPIFlashInfo flashmem_get_info()
 {
     volatile SPIFlashInfo spi_flash_info STORE_ATTR;
     spi_flash_info = *((SPIFlashInfo *)(INTERNAL_FLASH_START_ADDRESS));
     return spi_flash_info;
 }
+#endif
 
 uint8_t flashmem_get_size_type()
 {
@@ -211,6 +216,7 @@ uint32_t flashmem_read_internal( void *to, uint32_t fromaddr, uint32_t size )
   }
 }
 
+#ifndef SMING_HOST
 uint32_t flashmem_get_first_free_block_address()
 {
   if (_flash_code_end == NULL)
@@ -224,3 +230,4 @@ uint32_t flashmem_get_first_free_block_address()
   flashmem_find_sector( ( uint32_t )_flash_code_end - 1, NULL, &end);
   return end + 1;
 }
+#endif
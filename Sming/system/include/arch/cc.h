@@ -53,8 +53,13 @@ typedef unsigned   char    u8_t;
 typedef signed     char    s8_t;
 typedef unsigned   short   u16_t;
 typedef signed     short   s16_t;
+#ifdef SMING_HOST
+typedef unsigned   int     u32_t;
+typedef signed     int     s32_t;
+#else
 typedef unsigned   long    u32_t;
 typedef signed     long    s32_t;
+#endif
 typedef unsigned long   mem_ptr_t;
 
 #define S16_F "d"
@@ -48,15 +48,22 @@ typedef double              real64;
 /* Additional type names */
 typedef unsigned char       u8_t;
 typedef unsigned short      u16_t;
-typedef unsigned long       u32_t;
-
 typedef signed char         s8_t;
 typedef signed short        s16_t;
+#ifdef SMING_HOST
+// 32 bits like on device, long is 64 bits on host. File system structures depend on it.
+typedef unsigned int        u32_t;
+typedef signed int          s32_t;
+#else
+typedef unsigned long       u32_t;
 typedef signed long         s32_t;
+#endif
 
 #define __le16      u16
 
+#ifndef SMING_HOST
 typedef unsigned int        size_t;
+#endif
 
 #define __packed        __attribute__((packed))
 